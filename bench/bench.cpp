@@ -0,0 +1,344 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+
+#include <algorithm>
+#include <stdio.h>
+
+#include "compiler.h"
+#include "parser.h"
+#include "typeinference.h"
+#include "version.h"
+#include "virtualmachine.h"
+
+///////////////////////////////////////////
+///
+/// Benchmarks of the parser, the compiler and whole programs. Every
+/// benchmark reports the latency percentiles of its iterations and the
+/// throughput of the mean iteration as JSON.
+///
+/// hound_bench [--iterations N] [--filter TEXT] [--output FILE] [--verbose]
+///
+
+struct BenchmarkOptions {
+    int iterations;
+
+    // Only benchmarks whose name contains it run
+    QString filter;
+};
+
+struct BenchmarkResult {
+    QString name;
+
+    // Nanoseconds of every iteration
+    QVector<qint64> latencies;
+
+    // Work of one iteration for the throughput, like bytes or functions
+    double work;
+    QString unit;
+};
+
+static const int DefaultIterations = 10;
+
+// Functions of the synthetic sources
+static const int SmallSourceSize = 100;
+static const int LargeSourceSize = 10000;
+static const int CompiledFunctionCount = 200;
+
+static const char * const Programs[] = { "fib", "loops", "digits", "calls" };
+
+///////////////////////////////////////////
+
+// Nearest rank of the sorted latencies
+qint64 percentile(const QVector<qint64> & sorted, int percent) {
+    int rank = ( sorted.size() * percent + 99 ) / 100;
+
+    return sorted.at(qBound(0, rank - 1, sorted.size() - 1));
+}
+
+QJsonObject toJson(const BenchmarkResult & result) {
+    QVector<qint64> sorted = result.latencies;
+    std::sort(sorted.begin(), sorted.end());
+
+    qint64 total = 0;
+
+    for ( qint64 latency : sorted ) {
+        total += latency;
+    }
+
+    double mean = double(total) / sorted.size();
+
+    QJsonObject latency;
+    latency.insert("min", sorted.first());
+    latency.insert("p50", percentile(sorted, 50));
+    latency.insert("p90", percentile(sorted, 90));
+    latency.insert("p99", percentile(sorted, 99));
+    latency.insert("max", sorted.last());
+    latency.insert("mean", mean);
+
+    QJsonObject benchmark;
+    benchmark.insert("name", result.name);
+    benchmark.insert("iterations", sorted.size());
+    benchmark.insert("latencyNs", latency);
+    benchmark.insert("throughput", mean > 0 ? result.work * 1e9 / mean : 0.0);
+    benchmark.insert("throughputUnit", result.unit + "/s");
+
+    return benchmark;
+}
+
+bool isSelected(const BenchmarkOptions & options, const QString & name) {
+    return options.filter.isEmpty() || name.contains(options.filter);
+}
+
+// Functions which call their predecessor, with all kinds of expressions
+QByteArray syntheticSource(int functionCount) {
+    QByteArray source = "fn f0(a, b) ->\n    a + b\n\n";
+
+    for ( int i = 1; i < functionCount; ++i ) {
+        QByteArray name = "f" + QByteArray::number(i);
+        QByteArray callee = "f" + QByteArray::number(i - 1);
+        QByteArray constant = QByteArray::number(i);
+
+        source += "# Function " + constant + "\n";
+        source += "fn " + name + "(a, b) ->\n";
+        source += "    if a < b then\n";
+        source += "        a * " + constant + " + b - " + callee + "(b, a) / 3\n";
+        source += "    else\n";
+        source += "        " + callee + "(a - 1, b + " + constant + ") ** 2\n\n";
+    }
+
+    source += "f" + QByteArray::number(functionCount - 1) + "(1, 2)\n";
+
+    return source;
+}
+
+QSharedPointer<SyntaxTree> parseSource(const QByteArray & source) {
+    Parser parser("");
+    parser.setSource(source);
+
+    return parser.parse();
+}
+
+///////////////////////////////////////////
+
+bool benchmarkParse(const BenchmarkOptions & options, int functionCount, QList<BenchmarkResult> * results) {
+    BenchmarkResult result;
+    result.name = QString("parse/synthetic-%1").arg(functionCount);
+    result.unit = "bytes";
+
+    if ( !isSelected(options, result.name) )
+        return true;
+
+    QByteArray source = syntheticSource(functionCount);
+    result.work = source.size();
+
+    for ( int i = 0; i < options.iterations; ++i ) {
+        QElapsedTimer timer;
+        timer.start();
+
+        QSharedPointer<SyntaxTree> tree = parseSource(source);
+
+        result.latencies.append(timer.nsecsElapsed());
+
+        if ( !tree ) {
+            qWarning() << "Could not parse " << result.name;
+            return false;
+        }
+    }
+
+    results->append(result);
+
+    return true;
+}
+
+// Every function on its own and the whole program
+bool benchmarkCompile(const BenchmarkOptions & options, int functionCount, QList<BenchmarkResult> * results) {
+    BenchmarkResult function;
+    function.name = QString("compile/function-of-%1").arg(functionCount);
+    function.work = 1;
+    function.unit = "functions";
+
+    BenchmarkResult program;
+    program.name = QString("compile/synthetic-%1").arg(functionCount);
+    program.work = functionCount;
+    program.unit = "functions";
+
+    if ( !isSelected(options, function.name) && !isSelected(options, program.name) )
+        return true;
+
+    QSharedPointer<SyntaxTree> tree = parseSource(syntheticSource(functionCount));
+    ExpressionList expressions = tree ? tree->expressions() : ExpressionList();
+
+    if ( !tree || !inferTypes(expressions) ) {
+        qWarning() << "Could not prepare " << program.name;
+        return false;
+    }
+
+    QList<Symbol> symbols;
+
+    for ( Expression * expr : expressions ) {
+        if ( expr->is(ExpressionType::FunctionExpressionType) )
+            symbols.append(static_cast<FunctionExpression *>(expr)->symbol());
+    }
+
+    for ( int i = 0; i < options.iterations; ++i ) {
+        // Nothing is cached or left over from the iteration before
+        VirtualMachine machine;
+        VmCompiler compiler(&machine);
+
+        QElapsedTimer programTimer;
+        programTimer.start();
+
+        if ( !compiler.prepare(expressions) ) {
+            qWarning() << "Could not prepare " << program.name;
+            return false;
+        }
+
+        for ( Symbol symbol : symbols ) {
+            QElapsedTimer timer;
+            timer.start();
+
+            if ( !compiler.compileFunction(symbol) ) {
+                qWarning() << "Could not compile " << SymbolTable::global().name(symbol);
+                return false;
+            }
+
+            function.latencies.append(timer.nsecsElapsed());
+        }
+
+        program.latencies.append(programTimer.nsecsElapsed());
+    }
+
+    if ( isSelected(options, function.name) )
+        results->append(function);
+    if ( isSelected(options, program.name) )
+        results->append(program);
+
+    return true;
+}
+
+// Loading and running the program, hot functions are compiled unless
+// everything is interpreted
+bool benchmarkProgram(const BenchmarkOptions & options, const QString & program, bool interpreted,
+                      QList<BenchmarkResult> * results) {
+    BenchmarkResult result;
+    result.name = QString("run/%1/%2").arg(program).arg(interpreted ? "interpreted" : "tiered");
+    result.work = 1;
+    result.unit = "runs";
+
+    if ( !isSelected(options, result.name) )
+        return true;
+
+    Parser parser(QString(":/programs/%1.hound").arg(program));
+    QSharedPointer<SyntaxTree> tree = parser.parse();
+
+    if ( !tree ) {
+        qWarning() << "Could not parse " << program;
+        return false;
+    }
+
+    int expected = 0;
+
+    for ( int i = 0; i < options.iterations; ++i ) {
+        VirtualMachine machine;
+
+        if ( interpreted )
+            machine.setTierUpThreshold(-1);
+
+        QElapsedTimer timer;
+        timer.start();
+
+        if ( !machine.load(tree->expressions()) ) {
+            qWarning() << "Could not load " << program;
+            return false;
+        }
+
+        int value = machine.execute();
+
+        result.latencies.append(timer.nsecsElapsed());
+
+        // Every run has to compute the same
+        if ( i > 0 && value != expected ) {
+            qWarning() << "Different results of " << result.name << ": " << value << " and " << expected;
+            return false;
+        }
+
+        expected = value;
+    }
+
+    results->append(result);
+
+    return true;
+}
+
+///////////////////////////////////////////
+
+static void discardMessage(QtMsgType type, const QMessageLogContext & context, const QString & message) {
+    Q_UNUSED(context)
+
+    // Failures of the benchmarks are warnings
+    if ( type != QtDebugMsg )
+        fprintf(stderr, "%s\n", message.toLocal8Bit().constData());
+}
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    QStringList arguments = app.arguments();
+
+    BenchmarkOptions options;
+    options.iterations = DefaultIterations;
+
+    if ( arguments.contains("--iterations") )
+        options.iterations = qMax(1, arguments.value(arguments.indexOf("--iterations") + 1).toInt());
+    if ( arguments.contains("--filter") )
+        options.filter = arguments.value(arguments.indexOf("--filter") + 1);
+
+    // The front end is chatty, that would be measured as well
+    if ( !arguments.contains("--verbose") )
+        qInstallMessageHandler(&discardMessage);
+
+    QList<BenchmarkResult> results;
+    bool ok = benchmarkParse(options, SmallSourceSize, &results) &&
+              benchmarkParse(options, LargeSourceSize, &results) &&
+              benchmarkCompile(options, CompiledFunctionCount, &results);
+
+    for ( const char * program : Programs ) {
+        ok = ok && benchmarkProgram(options, program, true, &results) &&
+                   benchmarkProgram(options, program, false, &results);
+    }
+
+    if ( !ok ) {
+        fprintf(stderr, "Benchmarks failed\n");
+        return 1;
+    }
+
+    QJsonArray benchmarks;
+
+    for ( const BenchmarkResult & result : results ) {
+        benchmarks.append(toJson(result));
+    }
+
+    QJsonObject report;
+    report.insert("version", QString(HOUND_VERSION));
+    report.insert("benchmarks", benchmarks);
+
+    QByteArray json = QJsonDocument(report).toJson();
+
+    if ( arguments.contains("--output") ) {
+        QFile file(arguments.value(arguments.indexOf("--output") + 1));
+
+        if ( !file.open(QIODevice::WriteOnly) || file.write(json) != json.size() ) {
+            fprintf(stderr, "Could not write %s\n", qPrintable(file.fileName()));
+            return 1;
+        }
+    }
+    else {
+        fwrite(json.constData(), 1, size_t(json.size()), stdout);
+    }
+
+    return 0;
+}
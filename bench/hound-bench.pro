@@ -0,0 +1,23 @@
+#-------------------------------------------------
+#
+# Benchmarks of the parser, the compiler and whole programs, results
+# are printed as JSON
+#
+#-------------------------------------------------
+
+QT       += core
+
+QT       -= gui
+
+TARGET = hound_bench
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+include(../src/hound.pri)
+
+SOURCES += bench.cpp
+
+RESOURCES += \
+    bench.qrc
@@ -0,0 +1,561 @@
+#include "bytecode.h"
+
+#include <QtCore/QDebug>
+
+struct LoweringData {
+    BytecodeFunction * function;
+    const BytecodeProgram * program;
+
+    // Register of every parameter of the current function, indexed by
+    // symbol. Symbols which aren't parameters have the register -1.
+    QVector<int> variableRegisters;
+
+    // Registers from this one on are free, temporaries are released
+    // by resetting it
+    int freeRegister;
+};
+
+static const char * const opcodeNames[] = {
+#define HOUND_OPCODE_NAME(name) #name,
+    HOUND_OPCODES(HOUND_OPCODE_NAME)
+#undef HOUND_OPCODE_NAME
+};
+
+const char * opcodeName(Opcode op) {
+    return op < Opcode::OpcodeCount ? opcodeNames[int(op)] : "Unknown";
+}
+
+bool lowerExpr(LoweringData * data, Expression * expr, int target, DataType * type);
+
+int allocateRegister(LoweringData * data) {
+    if ( data->freeRegister >= MaxRegisters ) {
+        qDebug() << "Too many registers in function: " << SymbolTable::global().name(data->function->symbol);
+        return -1;
+    }
+
+    int reg = data->freeRegister++;
+    data->function->registerCount = qMax(data->function->registerCount, data->freeRegister);
+
+    return reg;
+}
+
+int emit(LoweringData * data, Instruction instruction) {
+    data->function->code.append(instruction);
+    return data->function->code.size() - 1;
+}
+
+// Lets the jump at the position continue behind the last instruction
+bool patchJump(LoweringData * data, int position) {
+    Instruction & jump = data->function->code[position];
+    int offset = data->function->code.size() - ( position + 1 );
+
+    if ( offset > SignedOffset ) {
+        qDebug() << "Function is too big: " << SymbolTable::global().name(data->function->symbol);
+        return false;
+    }
+
+    jump = encodeASBx(opcodeOf(jump), argA(jump), offset);
+
+    return true;
+}
+
+int addConstant(LoweringData * data, Register value) {
+    QVector<Register> & constants = data->function->constants;
+
+    for ( int i = 0; i < constants.size(); ++i ) {
+        if ( constants.at(i).bits == value.bits ) {
+            return i;
+        }
+    }
+
+    constants.append(value);
+
+    return constants.size() - 1;
+}
+
+void emitZero(LoweringData * data, int target, DataType type) {
+    if ( type == DataType::Float ) {
+        Register zero;
+        zero.bits = 0;
+        zero.float32 = 0.0f;
+        emit(data, encodeABx(Opcode::LoadConstant, target, addConstant(data, zero)));
+    }
+    else {
+        emit(data, encodeASBx(Opcode::LoadInt, target, 0));
+    }
+}
+
+// Converts the register in place
+void emitConversion(LoweringData * data, int reg, DataType from, DataType to) {
+    if ( from == DataType::Int32 && to == DataType::Float )
+        emit(data, encodeABC(Opcode::IntToFloat, reg, reg, 0));
+    else if ( from == DataType::Float && to == DataType::Int32 )
+        emit(data, encodeABC(Opcode::FloatToInt, reg, reg, 0));
+}
+
+// Converts into a temporary, the operand may be a parameter
+bool convertOperand(LoweringData * data, int * reg, DataType from, DataType to) {
+    if ( from == to ) {
+        return true;
+    }
+
+    int converted = allocateRegister(data);
+
+    if ( converted < 0 ) {
+        return false;
+    }
+
+    Opcode opcode = to == DataType::Float ? Opcode::IntToFloat : Opcode::FloatToInt;
+    emit(data, encodeABC(opcode, converted, *reg, 0));
+
+    *reg = converted;
+
+    return true;
+}
+
+// Parameters are used directly, everything else goes into a temporary
+bool lowerOperand(LoweringData * data, Expression * expr, int * reg, DataType * type) {
+
+    if ( expr && expr->isVariable() ) {
+        VariableExpression * variable = static_cast<VariableExpression *>(expr);
+        Symbol symbol = variable->symbol();
+        int variableReg = symbol < Symbol(data->variableRegisters.size()) ? data->variableRegisters.at(symbol) : -1;
+
+        if ( variableReg < 0 ) {
+            qDebug() << "Unknown variable: " << variable->name();
+            return false;
+        }
+
+        *reg = variableReg;
+        *type = data->function->parameterTypes.at(variableReg);
+        return true;
+    }
+
+    *reg = allocateRegister(data);
+
+    return *reg >= 0 && lowerExpr(data, expr, *reg, type);
+}
+
+bool lowerRawDataExpr(LoweringData * data, RawDataExpression * expr, int target, DataType * type) {
+    Register value;
+    value.bits = 0;
+
+    switch ( expr->dataType() )
+    {
+    case DataType::Int32:
+        value.int32 = expr->data().toInt();
+
+        // Small numbers are part of the instruction
+        if ( value.int32 >= -SignedOffset && value.int32 <= 0xffff - SignedOffset )
+            emit(data, encodeASBx(Opcode::LoadInt, target, value.int32));
+        else
+            emit(data, encodeABx(Opcode::LoadConstant, target, addConstant(data, value)));
+        break;
+
+    case DataType::Float:
+        value.float32 = expr->data().toFloat();
+        emit(data, encodeABx(Opcode::LoadConstant, target, addConstant(data, value)));
+        break;
+
+    default:
+        qDebug() << "Unsupported data type: " << getDataTypeName( expr->dataType() );
+        return false;
+    }
+
+    if ( data->function->constants.size() > 0xffff ) {
+        qDebug() << "Too many constants in function: " << SymbolTable::global().name(data->function->symbol);
+        return false;
+    }
+
+    *type = expr->dataType();
+
+    return true;
+}
+
+bool lowerVariableExpr(LoweringData * data, VariableExpression * expr, int target, DataType * type) {
+    int reg;
+
+    if ( !lowerOperand(data, expr, &reg, type) ) {
+        return false;
+    }
+
+    emit(data, encodeABC(Opcode::Move, target, reg, 0));
+
+    return true;
+}
+
+bool lowerBinaryExpr(LoweringData * data, BinaryExpression * expr, int target, DataType * type) {
+    int mark = data->freeRegister;
+
+    int left, right;
+    DataType leftType, rightType;
+
+    if ( !lowerOperand(data, expr->leftExpression(), &left, &leftType) ||
+         !lowerOperand(data, expr->rightExpression(), &right, &rightType) ) {
+        return false;
+    }
+
+    // The type inference decides what the operands are computed as
+    DataType operandType = expr->operandType();
+
+    if ( operandType == DataType::NoDataType || expr->dataType() == DataType::NoDataType ) {
+        qDebug() << "Types of the operator aren't inferred";
+        return false;
+    }
+
+    if ( !convertOperand(data, &left, leftType, operandType) ||
+         !convertOperand(data, &right, rightType, operandType) ) {
+        return false;
+    }
+
+    LanguageOperator op = expr->theOperator();
+    bool isFloat = operandType == DataType::Float;
+    Opcode opcode;
+
+    switch ( op )
+    {
+    case LanguageOperator::PlusOperator:     opcode = isFloat ? Opcode::AddFloat : Opcode::AddInt; break;
+    case LanguageOperator::MinusOperator:    opcode = isFloat ? Opcode::SubFloat : Opcode::SubInt; break;
+    case LanguageOperator::MultiplyOperator: opcode = isFloat ? Opcode::MulFloat : Opcode::MulInt; break;
+    case LanguageOperator::DivideOperator:   opcode = isFloat ? Opcode::DivFloat : Opcode::DivInt; break;
+    case LanguageOperator::PowerOfOperator:  opcode = isFloat ? Opcode::PowFloat : Opcode::PowInt; break;
+    case LanguageOperator::LessOperator:     opcode = isFloat ? Opcode::LessFloat : Opcode::LessInt; break;
+    case LanguageOperator::GreaterOperator:  opcode = isFloat ? Opcode::GreaterFloat : Opcode::GreaterInt; break;
+    case LanguageOperator::AndOperator:      opcode = Opcode::And; break;
+    case LanguageOperator::OrOperator:       opcode = Opcode::Or; break;
+    case LanguageOperator::XorOperator:      opcode = Opcode::Xor; break;
+
+    default:
+        qDebug() << "Unsupported operator: " << op;
+        return false;
+    }
+
+    emit(data, encodeABC(opcode, target, left, right));
+
+    *type = expr->dataType();
+
+    data->freeRegister = mark;
+
+    return true;
+}
+
+bool lowerIfExpr(LoweringData * data, IfExpression * ifExpr, ElseExpression * elseExpr, int target, DataType * type) {
+    int mark = data->freeRegister;
+
+    int condition;
+    DataType conditionType;
+
+    if ( !lowerOperand(data, ifExpr->condition(), &condition, &conditionType) ) {
+        return false;
+    }
+
+    if ( conditionType != DataType::Int32 ) {
+        qDebug() << "Condition has to be an integer";
+        return false;
+    }
+
+    data->freeRegister = mark;
+
+    int jumpToElse = emit(data, encodeASBx(Opcode::JumpIfFalse, condition, 0));
+
+    DataType thenType;
+
+    if ( !lowerExpr(data, ifExpr->block(), target, &thenType) ) {
+        return false;
+    }
+
+    // Both values are converted to the inferred type of the if
+    DataType ifType = ifExpr->dataType() == DataType::NoDataType ? thenType : ifExpr->dataType();
+    emitConversion(data, target, thenType, ifType);
+
+    int jumpToEnd = emit(data, encodeASBx(Opcode::Jump, 0, 0));
+
+    if ( !patchJump(data, jumpToElse) ) {
+        return false;
+    }
+
+    // Without else the value of the if is 0
+    if ( !elseExpr ) {
+        emitZero(data, target, ifType);
+    }
+    else {
+        DataType elseType;
+
+        if ( !lowerExpr(data, elseExpr->block(), target, &elseType) ) {
+            return false;
+        }
+
+        emitConversion(data, target, elseType, ifType);
+    }
+
+    *type = ifType;
+
+    return patchJump(data, jumpToEnd);
+}
+
+bool lowerCodeBlockExpr(LoweringData * data, CodeBlockExpression * expr, int target, DataType * type) {
+    ExpressionList expressions = expr->expressions();
+    bool hasValue = false;
+
+    // The value of a block is the value of its last expression
+    for ( int i = 0; i < expressions.size(); ++i ) {
+        Expression * codeExpr = expressions.at(i);
+
+        if ( codeExpr->isComment() ) {
+            continue;
+        }
+
+        if ( codeExpr->isIf() ) {
+            IfExpression * ifExpr = static_cast<IfExpression *>(codeExpr);
+
+            if ( !lowerIfExpr(data, ifExpr, takeElse(expressions, &i), target, type) ) {
+                return false;
+            }
+        }
+        else if ( codeExpr->isElse() ) {
+            qDebug() << "Else without if";
+            return false;
+        }
+        else if ( !lowerExpr(data, codeExpr, target, type) ) {
+            return false;
+        }
+
+        hasValue = true;
+    }
+
+    if ( !hasValue ) {
+        emitZero(data, target, DataType::Int32);
+        *type = DataType::Int32;
+    }
+
+    return true;
+}
+
+bool lowerFunctionInvokationExpr(LoweringData * data, FunctionInvokationExpression * expr, int target, DataType * type) {
+    int slot = data->program->slot(expr->functionSymbol());
+
+    if ( slot < 0 ) {
+        qDebug() << "Unknown function: " << expr->functionName();
+        return false;
+    }
+
+    const BytecodeFunction & function = data->program->functions.at(slot);
+    ExpressionList parameters = expr->parameters();
+
+    if ( parameters.size() != function.parameterCount ) {
+        qDebug() << "Wrong number of parameters for function: " << expr->functionName();
+        return false;
+    }
+
+    // The arguments become the first registers of the called function,
+    // the result is returned in the first of them
+    int mark = data->freeRegister;
+    int base = data->freeRegister;
+
+    for ( int i = 0; i < qMax(parameters.size(), 1); ++i ) {
+        if ( allocateRegister(data) < 0 ) {
+            return false;
+        }
+    }
+
+    for ( int i = 0; i < parameters.size(); ++i ) {
+        DataType argumentType;
+
+        if ( !lowerExpr(data, parameters.at(i), base + i, &argumentType) ) {
+            return false;
+        }
+
+        emitConversion(data, base + i, argumentType, function.parameterTypes.at(i));
+    }
+
+    emit(data, encodeABx(Opcode::Call, base, slot));
+
+    if ( target != base ) {
+        emit(data, encodeABC(Opcode::Move, target, base, 0));
+    }
+
+    *type = function.returnType;
+
+    data->freeRegister = mark;
+
+    return true;
+}
+
+bool lowerExpr(LoweringData * data, Expression * expr, int target, DataType * type) {
+
+    if ( !expr ) {
+        qDebug() << "Missing expression";
+        return false;
+    }
+
+    switch ( expr->type() )
+    {
+    case ExpressionType::RawData:
+        return lowerRawDataExpr(data, static_cast<RawDataExpression *>(expr), target, type);
+
+    case ExpressionType::Variable:
+        return lowerVariableExpr(data, static_cast<VariableExpression *>(expr), target, type);
+
+    case ExpressionType::BinaryExpr:
+        return lowerBinaryExpr(data, static_cast<BinaryExpression *>(expr), target, type);
+
+    case ExpressionType::CodeBlock:
+        return lowerCodeBlockExpr(data, static_cast<CodeBlockExpression *>(expr), target, type);
+
+    case ExpressionType::FunctionInvokation:
+        return lowerFunctionInvokationExpr(data, static_cast<FunctionInvokationExpression *>(expr), target, type);
+
+    case ExpressionType::If:
+        return lowerIfExpr(data, static_cast<IfExpression *>(expr), 0, target, type);
+
+    default:
+        break;
+    }
+
+    qDebug() << "Unsupported expression: " << expr->toString();
+
+    return false;
+}
+
+bool lowerFunctionExpr(LoweringData * data, FunctionExpression * expr) {
+    ExpressionList parameters = expr->parameters();
+
+    data->freeRegister = parameters.size();
+
+    for ( int i = 0; i < parameters.size(); ++i ) {
+        data->variableRegisters[static_cast<VariableExpression *>( parameters.at(i) )->symbol()] = i;
+    }
+
+    int result = allocateRegister(data);
+    DataType resultType;
+
+    bool lowered = result >= 0 && lowerExpr(data, expr->code(), result, &resultType);
+
+    // Parameters are only visible inside of their function
+    for ( Expression * param : parameters ) {
+        data->variableRegisters[static_cast<VariableExpression *>(param)->symbol()] = -1;
+    }
+
+    if ( !lowered ) {
+        qDebug() << "Could not lower function: " << expr->name();
+        return false;
+    }
+
+    emitConversion(data, result, resultType, data->function->returnType);
+    emit(data, encodeABx(Opcode::Return, result, 0));
+
+    return true;
+}
+
+bool lowerEntryExpr(LoweringData * data, const QList<Expression *> & expressions) {
+    data->freeRegister = 0;
+
+    int result = allocateRegister(data);
+    DataType resultType = DataType::Int32;
+
+    emitZero(data, result, resultType);
+
+    for ( Expression * expr : expressions ) {
+        if ( !lowerExpr(data, expr, result, &resultType) ) {
+            qDebug() << "Could not lower top level expression: " << expr->toString();
+            return false;
+        }
+    }
+
+    data->function->returnType = resultType;
+    emit(data, encodeABx(Opcode::Return, result, 0));
+
+    return true;
+}
+
+bool lowerProgram(ExpressionList expressions, BytecodeProgram * program) {
+    program->functions.clear();
+    program->functionSlots.fill(-1, SymbolTable::global().size());
+    program->entry = -1;
+
+    LoweringData data;
+    data.program = program;
+    data.variableRegisters.fill(-1, SymbolTable::global().size());
+
+    ProgramParts parts;
+
+    if ( !splitProgram(expressions, &parts) ) {
+        return false;
+    }
+
+    // Signatures first so that functions can call each other
+    // independent of their order
+    for ( FunctionExpression * function : parts.functions ) {
+        BytecodeFunction lowered;
+        lowered.symbol = function->symbol();
+        lowered.parameterCount = function->parameters().size();
+        lowered.registerCount = 0;
+
+        // Types are inferred, integers if nothing is known
+        lowered.returnType = function->returnType() == DataType::NoDataType ? DataType::Int32 : function->returnType();
+
+        for ( Expression * param : function->parameters() ) {
+            DataType type = static_cast<VariableExpression *>(param)->dataType();
+            lowered.parameterTypes.append(type == DataType::NoDataType ? DataType::Int32 : type);
+        }
+
+        program->functionSlots[function->symbol()] = program->functions.size();
+        program->functions.append(lowered);
+    }
+
+    for ( int slot = 0; slot < parts.functions.size(); ++slot ) {
+        data.function = &program->functions[slot];
+
+        if ( !lowerFunctionExpr(&data, parts.functions.at(slot)) ) {
+            return false;
+        }
+    }
+
+    BytecodeFunction entry;
+    entry.symbol = NoSymbol;
+    entry.parameterCount = 0;
+    entry.registerCount = 0;
+    entry.returnType = DataType::Int32;
+
+    program->entry = program->functions.size();
+    program->functions.append(entry);
+
+    data.function = &program->functions[program->entry];
+
+    return lowerEntryExpr(&data, parts.entryExpressions);
+}
+
+QString disassemble(const BytecodeFunction & function) {
+    QString listing;
+
+    for ( int i = 0; i < function.code.size(); ++i ) {
+        Instruction instruction = function.code.at(i);
+        Opcode op = opcodeOf(instruction);
+
+        QString operands;
+
+        switch ( op )
+        {
+        case Opcode::LoadInt:
+        case Opcode::Jump:
+        case Opcode::JumpIfFalse:
+            operands = QString::number(argA(instruction)) + " " + QString::number(argSBx(instruction));
+            break;
+
+        case Opcode::LoadConstant:
+        case Opcode::Call:
+        case Opcode::Return:
+            operands = QString::number(argA(instruction)) + " " + QString::number(argBx(instruction));
+            break;
+
+        default:
+            operands = QString::number(argA(instruction)) + " " + QString::number(argB(instruction)) +
+                       " " + QString::number(argC(instruction));
+            break;
+        }
+
+        listing += QString::number(i) + "\t" + opcodeName(op) + "\t" + operands + "\n";
+    }
+
+    return listing;
+}
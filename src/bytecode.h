@@ -0,0 +1,130 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <QtCore/QVector>
+#include <QtCore/qglobal.h>
+
+#include "expression.h"
+
+///////////////////////////////////////////
+///
+/// Every instruction is one 32 bit word. The opcode is in the low
+/// byte, the operands follow in one of two forms:
+///
+/// - ABC:  a, b, c are registers (8 bit each)
+/// - ABx:  a is a register, bx is an unsigned or biased signed 16 bit value
+///
+/// Registers are relative to the frame of the running function, the
+/// parameters of a function are its first registers. The type of every
+/// register is known when lowering, so registers hold raw values.
+///
+
+#define HOUND_OPCODES(X) \
+    X(LoadInt)          /* a = sbx */ \
+    X(LoadConstant)     /* a = constants[bx] */ \
+    X(Move)             /* a = b */ \
+    X(IntToFloat)       /* a = float(b) */ \
+    X(FloatToInt)       /* a = int(b) */ \
+    X(AddInt)           /* a = b + c */ \
+    X(SubInt) \
+    X(MulInt) \
+    X(DivInt) \
+    X(PowInt) \
+    X(LessInt) \
+    X(GreaterInt) \
+    X(AddFloat) \
+    X(SubFloat) \
+    X(MulFloat) \
+    X(DivFloat) \
+    X(PowFloat) \
+    X(LessFloat) \
+    X(GreaterFloat) \
+    X(And)              /* a = b && c, on integers */ \
+    X(Or) \
+    X(Xor) \
+    X(Jump)             /* pc += sbx */ \
+    X(JumpIfFalse)      /* if !a: pc += sbx */ \
+    X(Call)             /* a = functions[bx](a, a + 1, ...) */ \
+    X(Return)           /* return a */
+
+enum class Opcode : quint8 {
+#define HOUND_OPCODE_ENUM(name) name,
+    HOUND_OPCODES(HOUND_OPCODE_ENUM)
+#undef HOUND_OPCODE_ENUM
+    OpcodeCount
+};
+
+typedef quint32 Instruction;
+
+const int MaxRegisters = 256;
+const int SignedOffset = 0x7fff;
+
+inline Instruction encodeABC(Opcode op, int a, int b, int c) {
+    return quint32(op) | ( quint32(a) << 8 ) | ( quint32(b) << 16 ) | ( quint32(c) << 24 );
+}
+
+inline Instruction encodeABx(Opcode op, int a, int bx) {
+    return quint32(op) | ( quint32(a) << 8 ) | ( quint32(bx) << 16 );
+}
+
+inline Instruction encodeASBx(Opcode op, int a, int sbx) {
+    return encodeABx(op, a, sbx + SignedOffset);
+}
+
+inline Opcode opcodeOf(Instruction i) { return Opcode(i & 0xff); }
+inline int argA(Instruction i) { return ( i >> 8 ) & 0xff; }
+inline int argB(Instruction i) { return ( i >> 16 ) & 0xff; }
+inline int argC(Instruction i) { return i >> 24; }
+inline int argBx(Instruction i) { return i >> 16; }
+inline int argSBx(Instruction i) { return int( i >> 16 ) - SignedOffset; }
+
+const char * opcodeName(Opcode op);
+
+// Raw value of one register, the instruction decides which member is used
+union Register {
+    qint32 int32;
+    float float32;
+    qint64 bits;
+};
+
+struct BytecodeFunction {
+    Symbol symbol;
+    int parameterCount;
+    int registerCount;
+
+    // Result and parameter types
+    DataType returnType;
+    QVector<DataType> parameterTypes;
+
+    QVector<Instruction> code;
+    QVector<Register> constants;
+};
+
+///////////////////////////////////////////
+///
+/// Functions of a whole program. The slots are in the order of the
+/// definitions like the function table of the compiler, the top level
+/// expressions are an extra function behind them.
+///
+
+struct BytecodeProgram {
+    QVector<BytecodeFunction> functions;
+
+    // Indexed by symbol, -1 if the symbol isn't a function
+    QVector<int> functionSlots;
+
+    int entry = -1;
+
+    int slot(Symbol symbol) const {
+        return symbol < Symbol(functionSlots.size()) ? functionSlots.at(symbol) : -1;
+    }
+};
+
+// Lowers the top level expressions of a program, false on unsupported
+// code. The types have to be inferred before.
+bool lowerProgram(ExpressionList expressions, BytecodeProgram * program);
+
+// Readable listing of a function, for debugging
+QString disassemble(const BytecodeFunction & function);
+
+#endif // BYTECODE_H
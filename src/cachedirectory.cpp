@@ -0,0 +1,79 @@
+#include "cachedirectory.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+
+#if defined(Q_OS_UNIX)
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(Q_OS_UNIX)
+static bool isPrivate(const struct stat & status) {
+    return status.st_uid == geteuid() && !( status.st_mode & ( S_IWGRP | S_IWOTH ) );
+}
+
+static bool isPrivateDirectory(const QString & directory) {
+    struct stat status;
+
+    // A symlink could point anywhere
+    return lstat(QFile::encodeName(directory).constData(), &status) == 0 &&
+           S_ISDIR(status.st_mode) && isPrivate(status);
+}
+#endif
+
+bool createCacheDirectory(const QString & directory)
+{
+#if defined(Q_OS_UNIX)
+    QString path = QDir::cleanPath(QDir(directory).absolutePath());
+
+    // Only the cache directory itself is private, its parents are the
+    // usual ones like ~/.cache
+    if ( !QDir().mkpath(QFileInfo(path).absolutePath()) )
+        return false;
+
+    if ( mkdir(QFile::encodeName(path).constData(), S_IRWXU) != 0 && errno != EEXIST )
+        return false;
+
+    if ( !isPrivateDirectory(path) ) {
+        qDebug() << "Not using cache directory other users can change: " << directory;
+        return false;
+    }
+
+    return true;
+#else
+    return QDir().mkpath(directory);
+#endif
+}
+
+bool isPrivateCacheFile(const QFileDevice & file, const QString & directory)
+{
+#if defined(Q_OS_UNIX)
+    struct stat status;
+
+    // The opened file and not the name, which could be replaced meanwhile
+    if ( fstat(file.handle(), &status) != 0 || !S_ISREG(status.st_mode) || !isPrivate(status) ||
+         !isPrivateDirectory(QDir::cleanPath(QDir(directory).absolutePath())) ) {
+        qDebug() << "Ignoring cache file other users can change: " << file.fileName();
+        return false;
+    }
+
+    return true;
+#else
+    Q_UNUSED(file)
+    Q_UNUSED(directory)
+    return true;
+#endif
+}
+
+bool restrictCacheFile(QFileDevice & file)
+{
+#if defined(Q_OS_UNIX)
+    return fchmod(file.handle(), S_IRUSR | S_IWUSR) == 0;
+#else
+    return file.setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+#endif
+}
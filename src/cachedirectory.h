@@ -0,0 +1,23 @@
+#ifndef CACHEDIRECTORY_H
+#define CACHEDIRECTORY_H
+
+#include <QtCore/QFileDevice>
+#include <QtCore/QString>
+#include <QtCore/qglobal.h>
+
+// Caches hold code which is run or trusted without checking it again, so
+// only files nobody else can plant or change are used. The directory and
+// its files have to belong to the user of the process and must not be
+// writable by the group or others.
+
+// Creates the directory only the user can access, false if it exists
+// already and isn't private
+bool createCacheDirectory(const QString & directory);
+
+// Checks the opened file and the directory it is in
+bool isPrivateCacheFile(const QFileDevice & file, const QString & directory);
+
+// Makes a file which is being written private
+bool restrictCacheFile(QFileDevice & file);
+
+#endif // CACHEDIRECTORY_H
@@ -0,0 +1,165 @@
+#include "codecache.h"
+#include "cachedirectory.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QSaveFile>
+
+#include <string.h>
+
+// Has to change with every change of the layout below
+static const quint32 CodeCacheFormatVersion = 3;
+
+struct CodeCacheHeader {
+    char magic[4];
+    quint32 formatVersion;
+    quint32 keySize;
+    quint32 codeSize;
+    quint32 fixupCount;
+    quint32 callSiteCount;
+    quint32 lineCount;
+};
+
+// After the header: key, code, then every fixup and every call site as
+// offset, name size and name, then the code lines
+
+CodeCache::CodeCache(const QString & directory) :
+    m_directory(directory)
+{
+}
+
+QString CodeCache::fileName(const QByteArray & key) const
+{
+    return QDir(m_directory).filePath(QString::fromLatin1(key.toHex()) + ".houndjit");
+}
+
+static bool readFixups(const char ** position, const char * end, quint32 count,
+                       quint32 codeSize, quint32 fixupSize, QList<CodeFixup> * fixups)
+{
+    fixups->clear();
+
+    for ( quint32 i = 0; i < count; ++i ) {
+        CodeFixup fixup;
+        quint32 nameSize;
+
+        if ( end - *position < qint64(sizeof(quint32) * 2) )
+            return false;
+
+        memcpy(&fixup.offset, *position, sizeof(quint32));
+        memcpy(&nameSize, *position + sizeof(quint32), sizeof(quint32));
+        *position += sizeof(quint32) * 2;
+
+        if ( end - *position < qint64(nameSize) || quint64(fixup.offset) + fixupSize > codeSize )
+            return false;
+
+        fixup.functionName = QByteArray(*position, int(nameSize));
+        *position += nameSize;
+
+        fixups->append(fixup);
+    }
+
+    return true;
+}
+
+static void appendFixups(QByteArray * buffer, const QList<CodeFixup> & fixups)
+{
+    for ( const CodeFixup & fixup : fixups ) {
+        quint32 nameSize = quint32(fixup.functionName.size());
+
+        buffer->append(reinterpret_cast<const char *>(&fixup.offset), sizeof(quint32));
+        buffer->append(reinterpret_cast<const char *>(&nameSize), sizeof(quint32));
+        buffer->append(fixup.functionName);
+    }
+}
+
+bool CodeCache::load(const QByteArray & key, CachedFunction * function) const
+{
+    QFile file(fileName(key));
+
+    if ( !file.open(QIODevice::ReadOnly) )
+        return false;
+
+    if ( !isPrivateCacheFile(file, m_directory) )
+        return false;
+
+    QByteArray content = file.readAll();
+    const char * position = content.constData();
+    const char * end = position + content.size();
+
+    CodeCacheHeader header;
+
+    if ( end - position < qint64(sizeof(header)) )
+        return false;
+
+    memcpy(&header, position, sizeof(header));
+    position += sizeof(header);
+
+    if ( memcmp(header.magic, "HNDJ", 4) != 0 ||
+         header.formatVersion != CodeCacheFormatVersion ||
+         header.keySize != quint32(key.size()) ||
+         end - position < qint64(header.keySize) + header.codeSize ||
+         memcmp(position, key.constData(), header.keySize) != 0 ) {
+        return false;
+    }
+
+    position += header.keySize;
+
+    function->code = QByteArray(position, int(header.codeSize));
+    position += header.codeSize;
+
+    // Slot addresses are pointers, call displacements 32 bit
+    if ( !readFixups(&position, end, header.fixupCount, header.codeSize, sizeof(void *), &function->fixups) ||
+         !readFixups(&position, end, header.callSiteCount, header.codeSize, sizeof(qint32), &function->callSites) ) {
+        qDebug() << "Ignoring broken code cache file: " << file.fileName();
+        return false;
+    }
+
+    if ( quint64(end - position) != quint64(header.lineCount) * sizeof(CodeLine) ) {
+        qDebug() << "Ignoring broken code cache file: " << file.fileName();
+        return false;
+    }
+
+    function->lines.resize(int(header.lineCount));
+    memcpy(function->lines.data(), position, header.lineCount * sizeof(CodeLine));
+
+    return true;
+}
+
+bool CodeCache::store(const QByteArray & key, const CachedFunction & function) const
+{
+    if ( !createCacheDirectory(m_directory) )
+        return false;
+
+    CodeCacheHeader header;
+    memcpy(header.magic, "HNDJ", 4);
+    header.formatVersion = CodeCacheFormatVersion;
+    header.keySize = quint32(key.size());
+    header.codeSize = quint32(function.code.size());
+    header.fixupCount = quint32(function.fixups.size());
+    header.callSiteCount = quint32(function.callSites.size());
+    header.lineCount = quint32(function.lines.size());
+
+    QByteArray buffer;
+    buffer.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    buffer.append(key);
+    buffer.append(function.code);
+
+    appendFixups(&buffer, function.fixups);
+    appendFixups(&buffer, function.callSites);
+
+    buffer.append(reinterpret_cast<const char *>(function.lines.constData()),
+                  function.lines.size() * int(sizeof(CodeLine)));
+
+    QSaveFile file(fileName(key));
+
+    if ( !file.open(QIODevice::WriteOnly) )
+        return false;
+
+    if ( !restrictCacheFile(file) || file.write(buffer) != buffer.size() ) {
+        file.cancelWriting();
+        return false;
+    }
+
+    return file.commit();
+}
@@ -0,0 +1,55 @@
+#ifndef CODECACHE_H
+#define CODECACHE_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtCore/qglobal.h>
+
+#include "perfmap.h"
+
+// Pointer sized data in the code which has to get the address of the
+// table slot of a function when the code is installed
+struct CodeFixup {
+    quint32 offset;
+    QByteArray functionName;
+};
+
+struct CachedFunction {
+    QByteArray code;
+    QList<CodeFixup> fixups;
+
+    // Displacements of the direct calls of other functions, they are
+    // bound to the code of the function when the code is installed
+    QList<CodeFixup> callSites;
+
+    // Source lines of the code, relative to the line of the function so
+    // moving the function doesn't change its key
+    QVector<CodeLine> lines;
+};
+
+///////////////////////////////////////////
+///
+/// Machine code of compiled functions on disk (.houndjit). The code
+/// doesn't depend on where it is placed, everything process specific
+/// is a fixup. The key has to cover everything the code is made of.
+///
+
+class CodeCache
+{
+public:
+    explicit CodeCache(const QString & directory);
+
+    QString directory() const { return m_directory; }
+
+    bool load(const QByteArray & key, CachedFunction * function) const;
+    bool store(const QByteArray & key, const CachedFunction & function) const;
+
+private:
+    QString fileName(const QByteArray & key) const;
+
+    QString m_directory;
+};
+
+#endif // CODECACHE_H
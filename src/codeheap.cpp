@@ -0,0 +1,487 @@
+#include "codeheap.h"
+
+#include <asmjit/asmjit.h>
+
+#include <QtCore/QDebug>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(Q_OS_LINUX)
+#include <sys/syscall.h>
+#endif
+#endif
+
+using namespace asmjit;
+
+// Regions are big enough for huge pages, modules get blocks of them
+static const qint64 RegionSize = 2 * 1024 * 1024;
+static const qint64 BlockSize = 64 * 1024;
+static const int BlocksPerRegion = int(RegionSize / BlockSize);
+
+static const quintptr FunctionAlignment = 16;
+
+///////////////////////////////////////////
+
+static bool mapRegion(qint64 size, char ** executable, char ** writable, bool * dualMapped) {
+    *dualMapped = false;
+
+#if defined(Q_OS_WIN)
+    void * memory = VirtualAlloc(0, SIZE_T(size), MEM_RESERVE | MEM_COMMIT, PAGE_EXECUTE_READWRITE);
+
+    if ( !memory )
+        return false;
+
+    *executable = *writable = static_cast<char *>(memory);
+    return true;
+#else
+
+#if defined(Q_OS_LINUX) && defined(SYS_memfd_create)
+    // Two views of the same memory, one writable and one executable
+    int fd = int(syscall(SYS_memfd_create, "hound-code", 1 /* MFD_CLOEXEC */));
+
+    if ( fd >= 0 ) {
+        void * rw = MAP_FAILED;
+        void * rx = MAP_FAILED;
+
+        if ( ftruncate(fd, off_t(size)) == 0 ) {
+            rw = mmap(0, size_t(size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            rx = mmap(0, size_t(size), PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+        }
+
+        close(fd);
+
+        if ( rw != MAP_FAILED && rx != MAP_FAILED ) {
+#if defined(MADV_HUGEPAGE)
+            madvise(rx, size_t(size), MADV_HUGEPAGE);
+#endif
+            *writable = static_cast<char *>(rw);
+            *executable = static_cast<char *>(rx);
+            *dualMapped = true;
+            return true;
+        }
+
+        if ( rw != MAP_FAILED )
+            munmap(rw, size_t(size));
+        if ( rx != MAP_FAILED )
+            munmap(rx, size_t(size));
+    }
+#endif
+
+    void * memory = mmap(0, size_t(size), PROT_READ | PROT_WRITE | PROT_EXEC,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if ( memory == MAP_FAILED )
+        return false;
+
+#if defined(MADV_HUGEPAGE)
+    madvise(memory, size_t(size), MADV_HUGEPAGE);
+#endif
+
+    *executable = *writable = static_cast<char *>(memory);
+    return true;
+#endif
+}
+
+static void unmapRegion(char * executable, char * writable, qint64 size) {
+#if defined(Q_OS_WIN)
+    Q_UNUSED(writable)
+    Q_UNUSED(size)
+    VirtualFree(executable, 0, MEM_RELEASE);
+#else
+    munmap(executable, size_t(size));
+
+    if ( writable != executable )
+        munmap(writable, size_t(size));
+#endif
+}
+
+///////////////////////////////////////////
+///
+/// Places the code of assemblers into the module
+///
+
+class ModuleRuntime : public HostRuntime
+{
+public:
+    explicit ModuleRuntime(CodeModule * module) :
+        m_module(module)
+    {
+    }
+
+    virtual Error add(void ** dst, Assembler * assembler) {
+        size_t codeSize = assembler->getCodeSize();
+
+        if ( codeSize == 0 ) {
+            *dst = 0;
+            return kErrorNoCodeGenerated;
+        }
+
+        void * writable;
+        void * executable = m_module->m_heap->allocate(m_module, codeSize, &writable);
+
+        if ( !executable ) {
+            *dst = 0;
+            return kErrorNoHeapMemory;
+        }
+
+        // Written through the writable view, but for the executable address
+        size_t relocSize = assembler->relocCode(writable, Ptr(executable));
+        flush(executable, relocSize);
+
+        *dst = executable;
+        return kErrorOk;
+    }
+
+    // Single functions are never freed, only whole modules
+    virtual Error release(void * p) {
+        Q_UNUSED(p)
+        return kErrorOk;
+    }
+
+private:
+    CodeModule * m_module;
+};
+
+///////////////////////////////////////////
+
+CodeModule::CodeModule(CodeHeap * heap) :
+    m_heap(heap),
+    m_runtime(new ModuleRuntime(this)),
+    m_current(0),
+    m_end(0),
+    m_usedBytes(0),
+    m_functionCount(0)
+{
+}
+
+CodeModule::~CodeModule()
+{
+    delete m_runtime;
+}
+
+///////////////////////////////////////////
+
+quint32 CodeDescription::line(quintptr address) const
+{
+    quint32 line = 0;
+
+    for ( const CodeLine & codeLine : lines ) {
+        if ( start + codeLine.offset > address )
+            break;
+
+        line = codeLine.line;
+    }
+
+    return line;
+}
+
+///////////////////////////////////////////
+
+CodeHeap::CodeHeap() :
+    m_writeXorExecute(true),
+    m_codeMapEnabled(false)
+{
+}
+
+CodeHeap::~CodeHeap()
+{
+    while ( !m_modules.isEmpty() ) {
+        releaseModule(m_modules.first());
+    }
+
+    for ( int i = 0; i < m_regions.size(); ++i ) {
+        releaseRegion(i);
+    }
+}
+
+CodeModule * CodeHeap::createModule()
+{
+    QMutexLocker locker(&m_mutex);
+
+    CodeModule * module = new CodeModule(this);
+    m_modules.append(module);
+
+    return module;
+}
+
+void CodeHeap::releaseModule(CodeModule * module)
+{
+    if ( !module )
+        return;
+
+    QMutexLocker locker(&m_mutex);
+
+    for ( const CodeModule::Span & span : module->m_spans ) {
+        Region & region = m_regions[span.region];
+
+        // The addresses may hold other code soon
+        quintptr spanStart = quintptr(region.executable + span.firstBlock * BlockSize);
+        quintptr spanEnd = region.dedicated ? quintptr(region.executable + region.size)
+                                            : spanStart + quintptr(span.blockCount * BlockSize);
+
+        for ( int i = m_codeMap.size() - 1; i >= 0; --i ) {
+            if ( m_codeMap.at(i).start >= spanStart && m_codeMap.at(i).start < spanEnd )
+                m_codeMap.removeAt(i);
+        }
+
+        if ( region.dedicated ) {
+            releaseRegion(span.region);
+            continue;
+        }
+
+        for ( int i = span.firstBlock; i < span.firstBlock + span.blockCount; ++i ) {
+            region.usedBlocks &= ~( quint64(1) << i );
+        }
+    }
+
+    // Empty regions are kept for the next module, but only one of them
+    bool keptEmptyRegion = false;
+
+    for ( int i = 0; i < m_regions.size(); ++i ) {
+        Region & region = m_regions[i];
+
+        if ( region.executable && !region.dedicated && region.usedBlocks == 0 ) {
+            if ( keptEmptyRegion )
+                releaseRegion(i);
+
+            keptEmptyRegion = true;
+        }
+    }
+
+    m_modules.removeOne(module);
+    delete module;
+}
+
+void * CodeHeap::writableAddress(void * executable) const
+{
+    QMutexLocker locker(&m_mutex);
+
+    char * address = static_cast<char *>(executable);
+
+    for ( const Region & region : m_regions ) {
+        if ( region.executable && address >= region.executable && address < region.executable + region.size ) {
+            return region.writable + ( address - region.executable );
+        }
+    }
+
+    return 0;
+}
+
+void CodeHeap::setPerfOutput(int outputs)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_perfMap = outputs ? QSharedPointer<PerfMap>(new PerfMap(outputs)) : QSharedPointer<PerfMap>();
+}
+
+void CodeHeap::describeCode(const void * code, quint64 size, const QString & name,
+                            const QString & fileName, const QVector<CodeLine> & lines)
+{
+    if ( !code )
+        return;
+
+    QMutexLocker locker(&m_mutex);
+    QSharedPointer<PerfMap> perfMap = m_perfMap;
+
+    // The perf map has a lock of its own
+    if ( perfMap ) {
+        locker.unlock();
+        perfMap->addCode(code, size, name, fileName, lines);
+        locker.relock();
+    }
+
+    if ( m_codeMapEnabled ) {
+        CodeDescription description;
+        description.start = quintptr(code);
+        description.size = size;
+        description.name = name;
+        description.fileName = fileName;
+        description.lines = lines;
+
+        m_codeMap.append(description);
+    }
+}
+
+void CodeHeap::setCodeMapEnabled(bool enabled)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_codeMapEnabled = enabled;
+
+    if ( !enabled )
+        m_codeMap.clear();
+}
+
+bool CodeHeap::findCode(quintptr address, CodeDescription * description) const
+{
+    QMutexLocker locker(&m_mutex);
+
+    for ( const CodeDescription & code : m_codeMap ) {
+        if ( address >= code.start && address < code.start + code.size ) {
+            *description = code;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+CodeHeap::Statistics CodeHeap::statistics() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    Statistics statistics;
+    statistics.reservedBytes = 0;
+    statistics.usedBytes = 0;
+    statistics.freeBytes = 0;
+    statistics.regionCount = 0;
+    statistics.moduleCount = m_modules.size();
+    statistics.functionCount = 0;
+    statistics.writeXorExecute = m_writeXorExecute;
+
+    for ( const Region & region : m_regions ) {
+        if ( !region.executable )
+            continue;
+
+        statistics.reservedBytes += region.size;
+        statistics.regionCount++;
+
+        for ( int i = 0; !region.dedicated && i < region.blockCount; ++i ) {
+            if ( !( region.usedBlocks & ( quint64(1) << i ) ) )
+                statistics.freeBytes += BlockSize;
+        }
+    }
+
+    for ( const CodeModule * module : m_modules ) {
+        statistics.usedBytes += module->m_usedBytes;
+        statistics.functionCount += module->m_functionCount;
+    }
+
+    return statistics;
+}
+
+void * CodeHeap::allocate(CodeModule * module, size_t size, void ** writable)
+{
+    QMutexLocker locker(&m_mutex);
+
+    quintptr start = ( module->m_current + FunctionAlignment - 1 ) & ~( FunctionAlignment - 1 );
+
+    // Functions of a module follow each other until the span is full
+    if ( module->m_current == 0 || start + size > module->m_end ) {
+        CodeModule::Span span;
+
+        if ( !allocateSpan(int( ( qint64(size) + BlockSize - 1 ) / BlockSize ), &span) ) {
+            qDebug() << "Out of executable memory";
+            return 0;
+        }
+
+        module->m_spans.append(span);
+
+        const Region & region = m_regions.at(span.region);
+        start = quintptr(region.executable + span.firstBlock * BlockSize);
+
+        module->m_end = start + quintptr(span.blockCount * BlockSize);
+    }
+
+    module->m_current = start + size;
+    module->m_usedBytes += qint64(size);
+    module->m_functionCount++;
+
+    for ( const Region & region : m_regions ) {
+        if ( region.executable && start >= quintptr(region.executable) &&
+             start < quintptr(region.executable + region.size) ) {
+            *writable = region.writable + ( start - quintptr(region.executable) );
+            break;
+        }
+    }
+
+    return reinterpret_cast<void *>(start);
+}
+
+bool CodeHeap::allocateSpan(int blockCount, CodeModule::Span * span)
+{
+    if ( blockCount > BlocksPerRegion ) {
+        int index = createRegion(qint64(blockCount) * BlockSize, true);
+
+        if ( index < 0 )
+            return false;
+
+        span->region = index;
+        span->firstBlock = 0;
+        span->blockCount = blockCount;
+        return true;
+    }
+
+    quint64 mask = ( blockCount == 64 ) ? ~quint64(0) : ( ( quint64(1) << blockCount ) - 1 );
+
+    for ( int pass = 0; pass < 2; ++pass ) {
+
+        for ( int index = 0; index < m_regions.size(); ++index ) {
+            Region & region = m_regions[index];
+
+            if ( !region.executable || region.dedicated )
+                continue;
+
+            for ( int first = 0; first + blockCount <= region.blockCount; ++first ) {
+                if ( ( region.usedBlocks & ( mask << first ) ) == 0 ) {
+                    region.usedBlocks |= mask << first;
+
+                    span->region = index;
+                    span->firstBlock = first;
+                    span->blockCount = blockCount;
+                    return true;
+                }
+            }
+        }
+
+        // Nothing free, try again with a new region
+        if ( pass == 0 && createRegion(RegionSize, false) < 0 )
+            return false;
+    }
+
+    return false;
+}
+
+int CodeHeap::createRegion(qint64 size, bool dedicated)
+{
+    Region region;
+    bool dualMapped;
+
+    if ( !mapRegion(size, &region.executable, &region.writable, &dualMapped) )
+        return -1;
+
+    m_writeXorExecute = m_writeXorExecute && dualMapped;
+
+    region.size = size;
+    region.usedBlocks = 0;
+    region.blockCount = dedicated ? 0 : BlocksPerRegion;
+    region.dedicated = dedicated;
+
+    // Slots of released regions are used again
+    for ( int i = 0; i < m_regions.size(); ++i ) {
+        if ( !m_regions.at(i).executable ) {
+            m_regions[i] = region;
+            return i;
+        }
+    }
+
+    m_regions.append(region);
+
+    return m_regions.size() - 1;
+}
+
+void CodeHeap::releaseRegion(int index)
+{
+    Region & region = m_regions[index];
+
+    if ( !region.executable )
+        return;
+
+    unmapRegion(region.executable, region.writable, region.size);
+
+    region.executable = 0;
+    region.writable = 0;
+}
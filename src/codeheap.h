@@ -0,0 +1,163 @@
+#ifndef CODEHEAP_H
+#define CODEHEAP_H
+
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtCore/qglobal.h>
+
+#include "perfmap.h"
+
+namespace asmjit {
+class Runtime;
+}
+
+class CodeHeap;
+
+// Compiled code as it was described to profilers
+struct CodeDescription {
+    quintptr start;
+    quint64 size;
+    QString name;
+    QString fileName;
+    QVector<CodeLine> lines;
+
+    // Source line of an address in the code, 0 if unknown
+    quint32 line(quintptr address) const;
+};
+
+///////////////////////////////////////////
+///
+/// Code of one compiled module. Everything added through its runtime
+/// is placed one after the other into the blocks of the module and
+/// stays there until the whole module is released.
+///
+
+class CodeModule
+{
+public:
+    // For compilers and assemblers
+    asmjit::Runtime * runtime() const { return m_runtime; }
+
+    qint64 usedBytes() const { return m_usedBytes; }
+    int functionCount() const { return m_functionCount; }
+
+private:
+    friend class CodeHeap;
+    friend class ModuleRuntime;
+
+    explicit CodeModule(CodeHeap * heap);
+    ~CodeModule();
+    Q_DISABLE_COPY(CodeModule)
+
+    struct Span {
+        int region;
+        int firstBlock;
+        int blockCount;
+    };
+
+    CodeHeap * m_heap;
+    asmjit::Runtime * m_runtime;
+
+    QList<Span> m_spans;
+
+    // Bump allocation in the last span
+    quintptr m_current;
+    quintptr m_end;
+
+    qint64 m_usedBytes;
+    int m_functionCount;
+};
+
+
+///////////////////////////////////////////
+///
+/// Executable memory of the whole process. The memory is reserved in
+/// big regions which are handed out in blocks to the modules.
+///
+/// Where the system allows it every region is mapped twice, once
+/// writable and once executable, so no page is ever writable and
+/// executable at the same time. Otherwise the regions are mapped
+/// read, write and execute.
+///
+
+class CodeHeap
+{
+public:
+    CodeHeap();
+    ~CodeHeap();
+
+    CodeModule * createModule();
+
+    // All code of the module becomes invalid
+    void releaseModule(CodeModule * module);
+
+    // Address under which the code can be changed
+    void * writableAddress(void * executable) const;
+
+    // Outputs of PerfMap, code described after this is visible to perf
+    void setPerfOutput(int outputs);
+
+    // Names the code for profilers, does nothing without a perf output
+    // or the code map
+    void describeCode(const void * code, quint64 size, const QString & name,
+                      const QString & fileName = QString(),
+                      const QVector<CodeLine> & lines = QVector<CodeLine>());
+
+    // Keeps the descriptions of the code until it is released, for
+    // profilers which look up addresses later
+    void setCodeMapEnabled(bool enabled);
+    bool findCode(quintptr address, CodeDescription * description) const;
+
+    struct Statistics {
+        qint64 reservedBytes;
+        qint64 usedBytes;
+        qint64 freeBytes;
+        int regionCount;
+        int moduleCount;
+        int functionCount;
+        bool writeXorExecute;
+    };
+
+    Statistics statistics() const;
+
+private:
+    friend class ModuleRuntime;
+    Q_DISABLE_COPY(CodeHeap)
+
+    struct Region {
+        char * executable;
+        char * writable;
+        qint64 size;
+
+        // Bit per block, set if it belongs to a module
+        quint64 usedBlocks;
+        int blockCount;
+
+        // Holds a single function which is bigger than a region
+        bool dedicated;
+    };
+
+    // Returns the executable address and sets the writable one
+    void * allocate(CodeModule * module, size_t size, void ** writable);
+
+    bool allocateSpan(int blockCount, CodeModule::Span * span);
+    int createRegion(qint64 size, bool dedicated);
+    void releaseRegion(int index);
+
+    mutable QMutex m_mutex;
+    QVector<Region> m_regions;
+    QList<CodeModule *> m_modules;
+    bool m_writeXorExecute;
+
+    // Compiler threads write to it outside of the mutex, it stays alive
+    // as long as one of them uses it
+    QSharedPointer<PerfMap> m_perfMap;
+
+    bool m_codeMapEnabled;
+    QList<CodeDescription> m_codeMap;
+};
+
+#endif // CODEHEAP_H
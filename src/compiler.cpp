@@ -1,77 +1,1782 @@
 #include "compiler.h"
+#include "codeheap.h"
+#include "compilestats.h"
+#include "ir.h"
+#include "irpasses.h"
+#include "profiler.h"
+#include "typeinference.h"
+#include "version.h"
+#include "virtualmachine.h"
+
+#include <QtCore/QAtomicPointer>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QSet>
+#include <QtCore/QThreadStorage>
 
 #include <asmjit/asmjit.h>
+#include <cmath>
+#include <limits.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 
 using namespace asmjit;
 
-VmCompiler::VmCompiler(QObject *parent) : QObject(parent)
+// Displacement of a direct call in the code of a function
+struct CallFixup {
+    Symbol function;
+    quint32 offset;
+};
+
+struct CompilingData {
+    // Function which is compiled at the moment
+    Symbol functionSymbol;
+    X86FuncNode * function;
+
+    // Registers of the IR values and labels of the IR blocks, floats
+    // are in floatValues, all others in values
+    QVector<X86GpVar> values;
+    QVector<X86XmmVar> floatValues;
+    QVector<Label> blockLabels;
+
+    // Uses of every IR value and whether it needs a register
+    QVector<int> useCounts;
+    QVector<bool> needsRegister;
+
+    // All functions of the program, indexed by their slot
+    QVector<FunctionExpression *> functions;
+    const QVector<int> * functionSlots;
+    void ** functionTable;
+
+    // Data of the current function which holds the address of the
+    // table slot of a called function, these are the cache fixups
+    QHash<Symbol, Label> slotLabels;
+
+    // Functions whose code is part of the cache key already
+    QSet<Symbol> keyFunctions;
+
+    // Calls of other functions, which go to a trampoline of the callee
+    // until they are bound. Labels are behind the call instructions.
+    QHash<Symbol, Label> trampolineLabels;
+    QList<QPair<Symbol, Label> > callLabels;
+
+    // Call displacements of the finished code
+    QList<CallFixup> callFixups;
+
+    // Other functions the compiled function calls
+    QList<Symbol> callees;
+
+    // Labels where the code of a source line starts
+    QList<QPair<quint32, Label> > lineLabels;
+
+    // Data behind the code which holds the address of the host table,
+    // it is a cache fixup like the slot addresses
+    const HostTable * hostTable;
+    Label hostTableLabel;
+    bool usesHostTable;
+
+    // Failed divisions jump to it, it is emitted behind the body of the
+    // function if they do
+    Label errorLabel;
+    bool hasErrorExit;
+
+    CodeCache * codeCache;
+    CodeHeap * codeHeap;
+
+    // Functions report their calls to it if it is set
+    Profiler * profiler;
+};
+
+int getSlot(const QVector<int> & slotTable, Symbol symbol) {
+    return symbol < Symbol(slotTable.size()) ? slotTable.at(symbol) : -1;
+}
+
+typedef int (*EntryFunction)();
+
+// Changes of the generated code invalidate cached functions
+static const quint32 CodeGeneratorVersion = 10;
+
+// Name of the fixup for the address of the host table, it can't be the
+// name of a function
+static const char * const HostTableFixup = "<host>";
+
+// Stores of call displacements are only atomic within a cache line
+static const quintptr CacheLineSize = 64;
+
+// Native code may call through a slot while another thread installs
+// code into it. QAtomicPointer has the layout of a plain pointer.
+void * loadSlot(void * const * slot) {
+    return reinterpret_cast<const QAtomicPointer<void> *>(slot)->loadAcquire();
+}
+
+void storeSlot(void ** slot, void * code) {
+    reinterpret_cast<QAtomicPointer<void> *>(slot)->storeRelease(code);
+}
+
+struct ThreadCompiler {
+    Runtime * runtime;
+    X86Compiler * compiler;
+
+    ~ThreadCompiler() { delete compiler; }
+};
+
+static QThreadStorage<ThreadCompiler *> threadCompilers;
+
+// Every thread keeps its own compiler, so its memory is reused
+// between functions
+X86Compiler & threadCompiler(Runtime * runtime) {
+    ThreadCompiler * local = threadCompilers.localData();
+
+    if ( !local ) {
+        local = new ThreadCompiler;
+        local->runtime = 0;
+        local->compiler = 0;
+        threadCompilers.setLocalData(local);
+    }
+
+    if ( local->runtime != runtime ) {
+        delete local->compiler;
+        local->compiler = new X86Compiler(runtime);
+        local->runtime = runtime;
+    }
+    else {
+        local->compiler->reset();
+    }
+
+    return *local->compiler;
+}
+
+// Same as the interpreter, so both round the same way
+static float powFloat(float base, float exponent) {
+    return std::pow(base, exponent);
+}
+
+VmCompiler::VmCompiler(VirtualMachine * machine, QObject *parent) : QObject(parent),
+    m_machine(machine),
+    m_module(0),
+    m_symbolCount(0),
+    m_interpreterEntry(0),
+    m_interpreterContext(0),
+    m_failed(false),
+    m_profiler(0),
+    m_entry(0)
+{
+    m_hostTable.powFloat = &powFloat;
+    setDivisionErrorEntry(0, 0);
+}
+
+VmCompiler::~VmCompiler()
+{
+    release();
+}
+
+void VmCompiler::setCodeCacheDirectory(const QString & directory)
 {
+    if ( directory.isEmpty() )
+        m_codeCache.reset();
+    else
+        m_codeCache.reset(new CodeCache(directory));
+}
+
+IrProgram getIrProgram(CompilingData * data) {
+    IrProgram program;
+    program.functions = data->functions;
+    program.functionSlots = data->functionSlots;
+
+    return program;
+}
+
+// Small callees are inlined first so the passes see through them, tail
+// calls are found best in the optimized function
+void optimizeFunctionIr(CompilingData * data, IrFunction * function) {
+    inlineCalls(getIrProgram(data), function);
+    optimizeIr(function);
+
+    if ( eliminateTailCalls(function) )
+        optimizeIr(function);
+}
+
+uint32_t getVarType(DataType type) {
+    return type == DataType::Float ? uint32_t(kVarTypeFp32) : uint32_t(kVarTypeInt32);
+}
+
+bool isSupportedType(DataType type) {
+    return type == DataType::Int32 || type == DataType::Float;
+}
+
+FuncBuilderX getFunctionPrototype(const QVector<DataType> & parameterTypes, DataType returnType) {
+    FuncBuilderX prototype;
+    prototype.setRet(getVarType(returnType));
+
+    for ( DataType type : parameterTypes ) {
+        prototype.addArg(getVarType(type));
+    }
+
+    return prototype;
+}
+
+FuncBuilderX getFunctionPrototype(FunctionExpression * function) {
+    QVector<DataType> parameterTypes;
+
+    for ( Expression * param : function->parameters() ) {
+        parameterTypes.append(getParameterType(param));
+    }
+
+    return getFunctionPrototype(parameterTypes, getReturnType(function));
+}
+
+// Calls between compiled functions pass all arguments in registers, on
+// Windows too, and leave out the shadow space. The host only calls them
+// through native entries.
+static const uint32_t HoundCallConv = sizeof(void *) == 8 ? uint32_t(kX86FuncConvU64) : uint32_t(kFuncConvHost);
+
+// Function only called by compiled code, it gets no frame pointer and
+// pushes the callee saved registers it uses
+X86FuncNode * addHoundFunc(X86Compiler & c, const FuncBuilderX & prototype) {
+    X86FuncNode * function = c.addFunc(HoundCallConv, prototype);
+    function->setHint(kFuncHintNaked, true);
+    function->setHint(kX86FuncHintPushPop, true);
+
+    return function;
+}
+
+// Right operands of these operations may be immediates
+bool takesImmediate(IrOp op) {
+    return op == IrOp::Add || op == IrOp::Sub || op == IrOp::Mul || op == IrOp::Less || op == IrOp::Greater;
+}
+
+bool isFloat(const IrFunction & function, ValueId id) {
+    return function.values.at(id).type == DataType::Float;
+}
+
+// Integer constants can be immediates, floats always need a register
+bool isIntConstant(const IrFunction & function, ValueId id) {
+    return function.values.at(id).op == IrOp::Constant && !isFloat(function, id);
+}
+
+// Counts the uses of every value and marks the values which need a
+// register, constants which are only used as immediates don't
+void countUses(CompilingData * data, const IrFunction & function) {
+    data->useCounts.fill(0, function.values.size());
+    data->needsRegister.fill(false, function.values.size());
+
+    for ( const IrBlock & block : function.blocks ) {
+        if ( block.isDead )
+            continue;
+
+        for ( ValueId id : block.values ) {
+            const IrValue & value = function.values.at(id);
+
+            for ( int i = 0; i < value.operands.size(); ++i ) {
+                ValueId operand = value.operands.at(i);
+                data->useCounts[operand]++;
+
+                bool immediate = i == 1 && takesImmediate(value.op);
+
+                // Phis move constants directly into their register
+                if ( !isIntConstant(function, operand) || ( !immediate && value.op != IrOp::Phi ) )
+                    data->needsRegister[operand] = true;
+            }
+        }
+
+        if ( block.value != NoValue ) {
+            data->useCounts[block.value]++;
+            data->needsRegister[block.value] = true;
+        }
+    }
+}
+
+// Comparisons which only decide the branch at the end of their block
+// are fused with the jump
+bool isFusedCondition(CompilingData * data, const IrFunction & function, BlockId b, ValueId id) {
+    const IrBlock & block = function.blocks.at(b);
+    const IrValue & value = function.values.at(id);
+
+    return block.terminator == IrTerminator::Branch && block.value == id &&
+           data->useCounts.at(id) == 1 && ( value.op == IrOp::Less || value.op == IrOp::Greater );
+}
+
+// Constants without register are used as immediates
+bool hasImmediateRight(CompilingData * data, const IrFunction & function, const IrValue & value) {
+    ValueId right = value.operands.at(1);
+    return isIntConstant(function, right) && !data->needsRegister.at(right);
+}
+
+// Jumps to the label if the comparison is true, or if it is false
+void emitCompareJump(X86Compiler & c, CompilingData * data, const IrFunction & function,
+                     const IrValue & value, const Label & label, bool jumpIfTrue) {
+    ValueId left = value.operands.at(0);
+    ValueId right = value.operands.at(1);
+    bool isLess = value.op == IrOp::Less;
+
+    if ( isFloat(function, left) ) {
+        // Unordered compares are false, so both cases use above. Less
+        // compares the operands the other way round.
+        if ( isLess )
+            c.ucomiss(data->floatValues.at(right), data->floatValues.at(left));
+        else
+            c.ucomiss(data->floatValues.at(left), data->floatValues.at(right));
+
+        if ( jumpIfTrue ) c.ja(label); else c.jbe(label);
+        return;
+    }
+
+    if ( hasImmediateRight(data, function, value) )
+        c.cmp(data->values.at(left), imm(function.values.at(right).intValue));
+    else
+        c.cmp(data->values.at(left), data->values.at(right));
+
+    if ( isLess ) {
+        if ( jumpIfTrue ) c.jl(label); else c.jge(label);
+    }
+    else {
+        if ( jumpIfTrue ) c.jg(label); else c.jle(label);
+    }
+}
+
+void emitArithmetic(X86Compiler & c, CompilingData * data, const IrFunction & function,
+                    const IrValue & value, const X86GpVar & result) {
+    ValueId right = value.operands.at(1);
+
+    c.mov(result, data->values.at(value.operands.at(0)));
+
+    if ( hasImmediateRight(data, function, value) ) {
+        Imm immediate = imm(function.values.at(right).intValue);
+
+        switch ( value.op )
+        {
+        case IrOp::Add: c.add(result, immediate); break;
+        case IrOp::Sub: c.sub(result, immediate); break;
+        default:        c.imul(result, immediate); break;
+        }
+    }
+    else {
+        const X86GpVar & var = data->values.at(right);
+
+        switch ( value.op )
+        {
+        case IrOp::Add: c.add(result, var); break;
+        case IrOp::Sub: c.sub(result, var); break;
+        default:        c.imul(result, var); break;
+        }
+    }
+}
+
+// Address of the host table, loaded relative to the code
+X86GpVar loadHostTable(X86Compiler & c, CompilingData * data) {
+    if ( !data->usesHostTable ) {
+        data->hostTableLabel = c.newLabel();
+        data->usesHostTable = true;
+    }
+
+    X86GpVar table = c.newGpVar(kVarTypeIntPtr);
+    c.mov(table, x86::ptr(data->hostTableLabel));
+
+    return table;
+}
+
+bool compileFloatValue(X86Compiler & c, CompilingData * data, const IrFunction & function, ValueId id) {
+    const IrValue & value = function.values.at(id);
+    const X86XmmVar & result = data->floatValues.at(id);
+
+    switch ( value.op )
+    {
+    case IrOp::Parameter:
+        c.setArg(value.index, result);
+        break;
+
+    case IrOp::Constant: {
+        // Loaded through a general purpose register, there is no
+        // immediate form
+        X86GpVar bits = c.newGpVar(kVarTypeInt32);
+        c.mov(bits, imm(value.intValue));
+        c.movd(result, bits);
+        break;
+    }
+
+    case IrOp::Copy:
+        c.movss(result, data->floatValues.at(value.operands.at(0)));
+        break;
+
+    case IrOp::IntToFloat:
+        c.cvtsi2ss(result, data->values.at(value.operands.at(0)));
+        break;
+
+    case IrOp::Add:
+    case IrOp::Sub:
+    case IrOp::Mul:
+    case IrOp::Div: {
+        const X86XmmVar & right = data->floatValues.at(value.operands.at(1));
+
+        c.movss(result, data->floatValues.at(value.operands.at(0)));
+
+        switch ( value.op )
+        {
+        case IrOp::Add: c.addss(result, right); break;
+        case IrOp::Sub: c.subss(result, right); break;
+        case IrOp::Mul: c.mulss(result, right); break;
+        default:        c.divss(result, right); break;
+        }
+        break;
+    }
+
+    case IrOp::Pow: {
+        X86GpVar table = loadHostTable(c, data);
+        X86GpVar target = c.newGpVar(kVarTypeIntPtr);
+        c.mov(target, x86::ptr(table, int(offsetof(HostTable, powFloat))));
+
+        X86CallNode * call = c.call(target, kFuncConvHost, FuncBuilder2<float, float, float>());
+        call->setArg(0, data->floatValues.at(value.operands.at(0)));
+        call->setArg(1, data->floatValues.at(value.operands.at(1)));
+        call->setRet(0, result);
+        break;
+    }
+
+    case IrOp::Phi:
+        // Set by the predecessors
+        break;
+
+    default:
+        qDebug() << "Unsupported IR operation on floats: " << int(value.op);
+        return false;
+    }
+
+    return true;
+}
+
+static void profilerEnter(Profiler * profiler, int slot) {
+    profiler->enter(slot);
+}
+
+static void profilerExit(Profiler * profiler, int slot) {
+    Q_UNUSED(slot)
+    profiler->exit();
+}
+
+bool isProfiled(CompilingData * data) {
+    return data->profiler && data->functionSymbol != NoSymbol;
+}
+
+// Host call of a profiler hook with the slot of the compiled function
+void emitProfilerCall(X86Compiler & c, CompilingData * data, void (*hook)(Profiler *, int)) {
+    X86GpVar target = c.newGpVar(kVarTypeIntPtr);
+    X86GpVar profiler = c.newGpVar(kVarTypeIntPtr);
+    X86GpVar slot = c.newGpVar(kVarTypeInt32);
+
+    c.mov(target, imm_ptr(reinterpret_cast<void *>(hook)));
+    c.mov(profiler, imm_ptr(data->profiler));
+    c.mov(slot, imm(getSlot(*data->functionSlots, data->functionSymbol)));
+
+    X86CallNode * call = c.call(target, kFuncConvHost, FuncBuilder2<void, void *, int>());
+    call->setArg(0, profiler);
+    call->setArg(1, slot);
+}
+
+// Reports the failed division and returns 0 of the result type
+void emitErrorExit(X86Compiler & c, CompilingData * data, const IrFunction & function) {
+    c.bind(data->errorLabel);
+
+    X86GpVar table = loadHostTable(c, data);
+    X86GpVar target = c.newGpVar(kVarTypeIntPtr);
+    X86GpVar context = c.newGpVar(kVarTypeIntPtr);
+
+    c.mov(target, x86::ptr(table, int(offsetof(HostTable, divisionErrorEntry))));
+    c.mov(context, x86::ptr(table, int(offsetof(HostTable, divisionErrorContext))));
+
+    X86CallNode * call = c.call(target, kFuncConvHost, FuncBuilder1<void, void *>());
+    call->setArg(0, context);
+
+    if ( isProfiled(data) )
+        emitProfilerCall(c, data, &profilerExit);
+
+    X86GpVar zero = c.newGpVar(kVarTypeInt32);
+    c.mov(zero, imm(0));
+
+    if ( function.returnType == DataType::Float ) {
+        X86XmmVar floatZero = c.newXmmVar(kX86VarTypeXmmSs);
+        c.movd(floatZero, zero);
+        c.ret(floatZero);
+    }
+    else {
+        c.ret(zero);
+    }
+}
+
+bool compileCallValue(X86Compiler & c, CompilingData * data, const IrFunction & function, const IrValue & value) {
+    FunctionExpression * callee = data->functions.at(getSlot(*data->functionSlots, value.function));
+    FuncBuilderX prototype = getFunctionPrototype(callee);
+
+    X86CallNode * call;
+
+    // Recursive calls jump directly to the start of the function
+    if ( value.function == data->functionSymbol ) {
+        call = c.call(data->function->getEntryLabel(), HoundCallConv, prototype);
+    }
+    else {
+        // The trampoline loads the slot address relative to the code, so
+        // the code stays the same wherever the table is
+        if ( !data->trampolineLabels.contains(value.function) ) {
+            data->trampolineLabels.insert(value.function, c.newLabel());
+            data->slotLabels.insert(value.function, c.newLabel());
+        }
+
+        call = c.call(data->trampolineLabels.value(value.function), HoundCallConv, prototype);
+    }
+
+    for ( int i = 0; i < value.operands.size(); ++i ) {
+        ValueId operand = value.operands.at(i);
+
+        if ( isFloat(function, operand) )
+            call->setArg(i, data->floatValues.at(operand));
+        else
+            call->setArg(i, data->values.at(operand));
+    }
+
+    ValueId id = &value - function.values.constData();
+
+    if ( value.type == DataType::Float )
+        call->setRet(0, data->floatValues.at(id));
+    else
+        call->setRet(0, data->values.at(id));
+
+    if ( value.function != data->functionSymbol ) {
+        Label end = c.newLabel();
+        c.bind(end);
+
+        data->callLabels.append(qMakePair(value.function, end));
+    }
+
+    return true;
+}
+
+bool compileValue(X86Compiler & c, CompilingData * data, const IrFunction & function, ValueId id) {
+    const IrValue & value = function.values.at(id);
+
+    if ( !isSupportedType(value.type) ) {
+        qDebug() << "Unsupported data type: " << getDataTypeName(value.type);
+        return false;
+    }
+
+    if ( value.op == IrOp::Call ) {
+        return compileCallValue(c, data, function, value);
+    }
+
+    if ( value.type == DataType::Float ) {
+        return compileFloatValue(c, data, function, id);
+    }
+
+    const X86GpVar & result = data->values.at(id);
+
+    switch ( value.op )
+    {
+    case IrOp::Parameter:
+        c.setArg(value.index, result);
+        break;
+
+    case IrOp::Constant:
+        if ( data->needsRegister.at(id) )
+            c.mov(result, imm(value.intValue));
+        break;
+
+    case IrOp::Copy:
+        c.mov(result, data->values.at(value.operands.at(0)));
+        break;
+
+    case IrOp::FloatToInt:
+        c.cvttss2si(result, data->floatValues.at(value.operands.at(0)));
+        break;
+
+    case IrOp::Add:
+    case IrOp::Sub:
+    case IrOp::Mul:
+        emitArithmetic(c, data, function, value, result);
+        break;
+
+    case IrOp::Div: {
+        const X86GpVar & divisor = data->values.at(value.operands.at(1));
+        X86GpVar remainder = c.newGpVar(kVarTypeInt32);
+
+        c.mov(result, data->values.at(value.operands.at(0)));
+
+        // Dividing by 0 and INT_MIN by -1 fail like in the interpreter
+        // instead of raising SIGFPE
+        if ( mayFail(&function, value) ) {
+            Label divide = c.newLabel();
+
+            if ( !data->hasErrorExit ) {
+                data->errorLabel = c.newLabel();
+                data->hasErrorExit = true;
+            }
+
+            c.test(divisor, divisor);
+            c.jz(data->errorLabel);
+            c.cmp(divisor, imm(-1));
+            c.jne(divide);
+            c.cmp(result, imm(INT_MIN));
+            c.je(data->errorLabel);
+            c.bind(divide);
+        }
+
+        c.cdq(remainder, result);
+        c.idiv(remainder, result, divisor);
+        break;
+    }
+
+    case IrOp::Pow: {
+        // Square and multiply like powInt, on copies since the operands
+        // may be used again
+        X86GpVar exponent = c.newGpVar(kVarTypeInt32);
+        X86GpVar factor = c.newGpVar(kVarTypeInt32);
+        Label loop = c.newLabel();
+        Label square = c.newLabel();
+        Label done = c.newLabel();
+
+        c.mov(exponent, data->values.at(value.operands.at(1)));
+        c.mov(factor, data->values.at(value.operands.at(0)));
+        c.mov(result, imm(1));
+        c.bind(loop);
+        c.cmp(exponent, imm(0));
+        c.jle(done);
+        c.test(exponent, imm(1));
+        c.jz(square);
+        c.imul(result, factor);
+        c.bind(square);
+        c.imul(factor, factor);
+        c.sar(exponent, imm(1));
+        c.jmp(loop);
+        c.bind(done);
+        break;
+    }
+
+    case IrOp::Less:
+    case IrOp::Greater: {
+        Label done = c.newLabel();
+
+        c.mov(result, imm(1));
+        emitCompareJump(c, data, function, value, done, true);
+        c.mov(result, imm(0));
+        c.bind(done);
+        break;
+    }
+
+    case IrOp::And: {
+        const X86GpVar & left = data->values.at(value.operands.at(0));
+        const X86GpVar & right = data->values.at(value.operands.at(1));
+        Label done = c.newLabel();
+
+        c.mov(result, imm(0));
+        c.test(left, left);
+        c.jz(done);
+        c.test(right, right);
+        c.jz(done);
+        c.mov(result, imm(1));
+        c.bind(done);
+        break;
+    }
+
+    case IrOp::Or: {
+        const X86GpVar & left = data->values.at(value.operands.at(0));
+        const X86GpVar & right = data->values.at(value.operands.at(1));
+        Label done = c.newLabel();
+
+        c.mov(result, imm(1));
+        c.test(left, left);
+        c.jnz(done);
+        c.test(right, right);
+        c.jnz(done);
+        c.mov(result, imm(0));
+        c.bind(done);
+        break;
+    }
+
+    case IrOp::Xor: {
+        const X86GpVar & left = data->values.at(value.operands.at(0));
+        const X86GpVar & right = data->values.at(value.operands.at(1));
+        Label leftFalse = c.newLabel();
+        Label rightFalse = c.newLabel();
+
+        c.mov(result, imm(0));
+        c.test(left, left);
+        c.jz(leftFalse);
+        c.xor_(result, imm(1));
+        c.bind(leftFalse);
+        c.test(right, right);
+        c.jz(rightFalse);
+        c.xor_(result, imm(1));
+        c.bind(rightFalse);
+        break;
+    }
+
+    case IrOp::Phi:
+        // Set by the predecessors
+        break;
+
+    default:
+        qDebug() << "Unsupported IR operation: " << int(value.op);
+        return false;
+    }
+
+    return true;
+}
+
+// Phis take their operand of the predecessor at its end. All sources
+// are read before any phi is written, phis may use each other.
+bool compilePhiMoves(X86Compiler & c, CompilingData * data, const IrFunction & function, BlockId from, BlockId to) {
+    const IrBlock & target = function.blocks.at(to);
+    int index = target.predecessors.indexOf(from);
+
+    QList<ValueId> phis;
+
+    for ( ValueId id : target.values ) {
+        if ( function.values.at(id).op == IrOp::Phi )
+            phis.append(id);
+    }
+
+    if ( phis.isEmpty() )
+        return true;
+
+    if ( function.blocks.at(from).terminator != IrTerminator::Jump ) {
+        qDebug() << "Phi behind a branch";
+        return false;
+    }
+
+    bool direct = phis.size() == 1;
+    QList<X86GpVar> sources;
+    QList<X86XmmVar> floatSources;
+
+    for ( ValueId id : phis ) {
+        ValueId operand = function.values.at(id).operands.at(index);
+
+        if ( isFloat(function, id) ) {
+            X86XmmVar source = direct ? data->floatValues.at(id) : c.newXmmVar(kX86VarTypeXmmSs);
+            c.movss(source, data->floatValues.at(operand));
+            floatSources.append(source);
+            sources.append(X86GpVar());
+        }
+        else {
+            X86GpVar source = direct ? data->values.at(id) : c.newGpVar(kVarTypeInt32);
+
+            if ( isIntConstant(function, operand) )
+                c.mov(source, imm(function.values.at(operand).intValue));
+            else
+                c.mov(source, data->values.at(operand));
+
+            sources.append(source);
+            floatSources.append(X86XmmVar());
+        }
+    }
+
+    for ( int i = 0; !direct && i < phis.size(); ++i ) {
+        if ( isFloat(function, phis.at(i)) )
+            c.movss(data->floatValues.at(phis.at(i)), floatSources.at(i));
+        else
+            c.mov(data->values.at(phis.at(i)), sources.at(i));
+    }
+
+    return true;
+}
+
+bool compileTerminator(X86Compiler & c, CompilingData * data, const IrFunction & function, BlockId b, BlockId next) {
+    const IrBlock & block = function.blocks.at(b);
+
+    switch ( block.terminator )
+    {
+    case IrTerminator::Return:
+        if ( isProfiled(data) )
+            emitProfilerCall(c, data, &profilerExit);
+
+        if ( isFloat(function, block.value) )
+            c.ret(data->floatValues.at(block.value));
+        else
+            c.ret(data->values.at(block.value));
+        return true;
+
+    case IrTerminator::Jump:
+        if ( !compilePhiMoves(c, data, function, b, block.successors[0]) ) {
+            return false;
+        }
+
+        if ( block.successors[0] != next )
+            c.jmp(data->blockLabels.at(block.successors[0]));
+        return true;
+
+    case IrTerminator::Branch:
+        break;
+
+    default:
+        qDebug() << "Block without terminator";
+        return false;
+    }
+
+    // Only the target which doesn't follow needs a jump
+    bool jumpIfTrue = block.successors[0] != next;
+    BlockId target = jumpIfTrue ? block.successors[0] : block.successors[1];
+    const Label & label = data->blockLabels.at(target);
+
+    if ( isFusedCondition(data, function, b, block.value) ) {
+        emitCompareJump(c, data, function, function.values.at(block.value), label, jumpIfTrue);
+    }
+    else {
+        const X86GpVar & value = data->values.at(block.value);
+        c.test(value, value);
+
+        if ( jumpIfTrue ) c.jnz(label); else c.jz(label);
+    }
+
+    if ( jumpIfTrue && block.successors[1] != next )
+        c.jmp(data->blockLabels.at(block.successors[1]));
+
+    return true;
+}
+
+// Body of a function whose frame is set up already
+bool compileIr(X86Compiler & c, CompilingData * data, const IrFunction & function) {
+    countUses(data, function);
+
+    data->values.fill(X86GpVar(), function.values.size());
+    data->floatValues.fill(X86XmmVar(), function.values.size());
+    data->blockLabels.clear();
+
+    // Floats live in SSE registers, everything else in general purpose ones
+    for ( ValueId id = 0; id < function.values.size(); ++id ) {
+        if ( function.values.at(id).op == IrOp::Nop )
+            continue;
+
+        if ( isFloat(function, id) )
+            data->floatValues[id] = c.newXmmVar(kX86VarTypeXmmSs);
+        else
+            data->values[id] = c.newGpVar(kVarTypeInt32);
+    }
+
+    QList<BlockId> order;
+    quint32 line = 0;
+
+    // The call is reported once the parameters are in their registers
+    bool entered = !isProfiled(data);
+
+    data->lineLabels.clear();
+    data->usesHostTable = false;
+    data->hasErrorExit = false;
+
+    for ( BlockId b = 0; b < function.blocks.size(); ++b ) {
+        data->blockLabels.append(c.newLabel());
+
+        if ( !function.blocks.at(b).isDead )
+            order.append(b);
+    }
+
+    for ( int i = 0; i < order.size(); ++i ) {
+        BlockId b = order.at(i);
+        BlockId next = i + 1 < order.size() ? order.at(i + 1) : NoBlock;
+
+        c.bind(data->blockLabels.at(b));
+
+        for ( ValueId id : function.blocks.at(b).values ) {
+            if ( !entered && function.values.at(id).op != IrOp::Parameter ) {
+                emitProfilerCall(c, data, &profilerEnter);
+                entered = true;
+            }
+
+            if ( isFusedCondition(data, function, b, id) )
+                continue;
+
+            quint32 valueLine = function.values.at(id).line;
+
+            if ( valueLine && valueLine != line ) {
+                Label label = c.newLabel();
+                c.bind(label);
+                data->lineLabels.append(qMakePair(valueLine, label));
+                line = valueLine;
+            }
+
+            if ( !compileValue(c, data, function, id) ) {
+                return false;
+            }
+        }
+
+        if ( !entered ) {
+            emitProfilerCall(c, data, &profilerEnter);
+            entered = true;
+        }
+
+        if ( !compileTerminator(c, data, function, b, next) ) {
+            return false;
+        }
+    }
+
+    if ( data->hasErrorExit )
+        emitErrorExit(c, data, function);
+
+    return true;
+}
+
+void addKeyValue(QCryptographicHash & hash, quint32 value) {
+    hash.addData(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void addKeySymbol(QCryptographicHash & hash, Symbol symbol) {
+    QByteArray text = SymbolTable::global().text(symbol);
+
+    addKeyValue(hash, quint32(text.size()));
+    hash.addData(text);
+}
+
+void addKeyExpr(QCryptographicHash & hash, CompilingData * data, Expression * expr) {
+    if ( !expr ) {
+        addKeyValue(hash, 0xffffffff);
+        return;
+    }
+
+    addKeyValue(hash, quint32(expr->type()));
+
+    switch ( expr->type() )
+    {
+    case ExpressionType::Variable:
+        addKeySymbol(hash, static_cast<VariableExpression *>(expr)->symbol());
+        addKeyValue(hash, quint32(static_cast<VariableExpression *>(expr)->dataType()));
+        break;
+
+    case ExpressionType::RawData: {
+        RawDataExpression * raw = static_cast<RawDataExpression *>(expr);
+
+        addKeyValue(hash, quint32(raw->dataType()));
+        hash.addData(raw->data().toString().toUtf8());
+        break;
+    }
+
+    case ExpressionType::BinaryExpr: {
+        BinaryExpression * binary = static_cast<BinaryExpression *>(expr);
+
+        addKeyValue(hash, quint32(binary->theOperator()));
+        addKeyExpr(hash, data, binary->leftExpression());
+        addKeyExpr(hash, data, binary->rightExpression());
+        break;
+    }
+
+    case ExpressionType::CodeBlock: {
+        ExpressionList expressions = static_cast<CodeBlockExpression *>(expr)->expressions();
+
+        addKeyValue(hash, quint32(expressions.size()));
+
+        for ( Expression * codeExpr : expressions ) {
+            addKeyExpr(hash, data, codeExpr);
+        }
+        break;
+    }
+
+    case ExpressionType::If:
+        addKeyValue(hash, quint32(static_cast<IfExpression *>(expr)->dataType()));
+        addKeyExpr(hash, data, static_cast<IfExpression *>(expr)->condition());
+        addKeyExpr(hash, data, static_cast<IfExpression *>(expr)->block());
+        break;
+
+    case ExpressionType::Else:
+        addKeyExpr(hash, data, static_cast<ElseExpression *>(expr)->block());
+        break;
+
+    case ExpressionType::FunctionInvokation: {
+        FunctionInvokationExpression * invokation = static_cast<FunctionInvokationExpression *>(expr);
+        int slot = getSlot(*data->functionSlots, invokation->functionSymbol());
+
+        addKeySymbol(hash, invokation->functionSymbol());
+
+        if ( slot < 0 ) {
+            addKeyValue(hash, 0xffffffff);
+        }
+        else {
+            FunctionExpression * callee = data->functions.at(slot);
+
+            addKeyValue(hash, quint32(callee->parameters().size()));
+            addKeyValue(hash, quint32(getReturnType(callee)));
+
+            for ( Expression * param : callee->parameters() ) {
+                addKeyValue(hash, quint32(getParameterType(param)));
+            }
+
+            // Called functions may be inlined, so their code matters too
+            if ( !data->keyFunctions.contains(callee->symbol()) ) {
+                data->keyFunctions.insert(callee->symbol());
+                addKeyExpr(hash, data, callee->code());
+            }
+        }
+
+        addKeyValue(hash, quint32(invokation->parameters().size()));
+
+        for ( Expression * param : invokation->parameters() ) {
+            addKeyExpr(hash, data, param);
+        }
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+// Everything the machine code of the function depends on
+QByteArray getFunctionKey(CompilingData * data, FunctionExpression * expr) {
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+
+    hash.addData(HOUND_VERSION);
+    addKeyValue(hash, CodeGeneratorVersion);
+    addKeyValue(hash, quint32(sizeof(void *)));
+
+    data->keyFunctions.clear();
+    data->keyFunctions.insert(expr->symbol());
+
+    addKeySymbol(hash, expr->symbol());
+    addKeyValue(hash, quint32(getReturnType(expr)));
+    addKeyValue(hash, quint32(expr->parameters().size()));
+
+    for ( Expression * param : expr->parameters() ) {
+        addKeyExpr(hash, data, param);
+    }
+
+    addKeyExpr(hash, data, expr->code());
+
+    return hash.result();
+}
+
+void * installCachedFunction(Runtime * runtime, CompilingData * data, CachedFunction & cached) {
+
+    for ( const CodeFixup & fixup : cached.fixups ) {
+        if ( fixup.functionName == HostTableFixup ) {
+            const void * tableAddress = data->hostTable;
+            memcpy(cached.code.data() + fixup.offset, &tableAddress, sizeof(tableAddress));
+            continue;
+        }
+
+        Symbol symbol = SymbolTable::global().lookup(QLatin1String(fixup.functionName.constData(), fixup.functionName.size()));
+        int slot = getSlot(*data->functionSlots, symbol);
+
+        if ( slot < 0 ) {
+            return 0;
+        }
+
+        void * slotAddress = &data->functionTable[slot];
+        memcpy(cached.code.data() + fixup.offset, &slotAddress, sizeof(slotAddress));
+
+        data->callees.append(symbol);
+    }
+
+    for ( const CodeFixup & fixup : cached.callSites ) {
+        CallFixup call;
+        call.function = SymbolTable::global().lookup(QLatin1String(fixup.functionName.constData(), fixup.functionName.size()));
+        call.offset = fixup.offset;
+
+        if ( getSlot(*data->functionSlots, call.function) < 0 ) {
+            return 0;
+        }
+
+        data->callFixups.append(call);
+    }
+
+    // Copying the code through an assembler places it into executable memory
+    X86Assembler a(runtime);
+    a.embed(cached.code.constData(), uint32_t(cached.code.size()));
+
+    void * code;
+
+    if ( runtime->add(&code, &a) != kErrorOk ) {
+        return 0;
+    }
+
+    return code;
+}
+
+// Source lines of the assembled code, lines are relative to the base
+QVector<CodeLine> getCodeLines(CompilingData * data, const X86Assembler & a, quint32 baseLine) {
+    QVector<CodeLine> lines;
+
+    for ( const QPair<quint32, Label> & label : data->lineLabels ) {
+        CodeLine line;
+        line.offset = quint32(a.getLabelOffset(label.second));
+        line.line = label.first - baseLine;
+
+        // Labels of code which became empty share the offset
+        if ( !lines.isEmpty() && lines.last().offset == line.offset )
+            lines.last() = line;
+        else
+            lines.append(line);
+    }
+
+    return lines;
+}
+
+void describeFunctionCode(CompilingData * data, FunctionExpression * expr, const void * code,
+                          quint64 size, QVector<CodeLine> lines) {
+    for ( CodeLine & line : lines ) {
+        line.line += expr->line();
+    }
+
+    data->codeHeap->describeCode(code, size, expr->name(), SymbolTable::global().name(expr->fileSymbol()), lines);
+}
+
+// Generated code which isn't a function of the program, like bridges
+void * addGeneratedCode(X86Compiler & c, Runtime * runtime, CodeHeap * heap, const QString & name,
+                        CompileTimer * timer = 0) {
+    X86Assembler a(runtime);
+
+    if ( timer )
+        timer->start(CompilePhase::RegisterAllocation);
+
+    if ( c.serialize(&a) != kErrorOk ) {
+        return 0;
+    }
+
+    if ( timer )
+        timer->start(CompilePhase::CodeEmission);
+
+    void * code;
+
+    if ( runtime->add(&code, &a) != kErrorOk ) {
+        return 0;
+    }
+
+    heap->describeCode(code, a.getCodeSize(), name);
+
+    if ( timer ) {
+        timer->stop();
+        timer->count(CompileCounter::EmittedBytes, qint64(a.getCodeSize()));
+    }
+
+    return code;
+}
+
+// Calls which aren't bound jump through the table slot. Nothing is
+// passed in the accumulator, so it is free here.
+void emitTrampolines(X86Compiler & c, CompilingData * data) {
+    for ( QHash<Symbol, Label>::const_iterator it = data->trampolineLabels.constBegin();
+          it != data->trampolineLabels.constEnd(); ++it ) {
+        c.align(kAlignCode, 16);
+        c.bind(it.value());
+        c.mov(x86::zax, x86::ptr(data->slotLabels.value(it.key())));
+        c.jmp(x86::ptr(x86::zax));
+    }
+}
+
+// Direct calls the code really contains. A call whose arguments the
+// register allocator moved behind it isn't bound and keeps using its
+// trampoline.
+void collectCallFixups(CompilingData * data, const X86Assembler & a, const char * code) {
+    data->callFixups.clear();
+
+    for ( const QPair<Symbol, Label> & call : data->callLabels ) {
+        intptr_t end = a.getLabelOffset(call.second);
+        intptr_t trampoline = a.getLabelOffset(data->trampolineLabels.value(call.first));
+        qint32 displacement;
+
+        if ( end < 5 || quint8(code[end - 5]) != 0xe8 )
+            continue;
+
+        memcpy(&displacement, code + end - 4, sizeof(displacement));
+
+        if ( end + displacement != trampoline )
+            continue;
+
+        CallFixup fixup;
+        fixup.function = call.first;
+        fixup.offset = quint32(end - 4);
+
+        data->callFixups.append(fixup);
+    }
+}
+
+// Table slot addresses behind the code of the function
+void emitSlotAddresses(X86Compiler & c, CompilingData * data) {
+    for ( QHash<Symbol, Label>::const_iterator it = data->slotLabels.constBegin();
+          it != data->slotLabels.constEnd(); ++it ) {
+        void * slotAddress = &data->functionTable[getSlot(*data->functionSlots, it.key())];
+
+        c.align(kAlignData, sizeof(void *));
+        c.bind(it.value());
+        c.embed(&slotAddress, sizeof(slotAddress));
+    }
+
+    if ( data->usesHostTable ) {
+        const void * tableAddress = data->hostTable;
+
+        c.align(kAlignData, sizeof(void *));
+        c.bind(data->hostTableLabel);
+        c.embed(&tableAddress, sizeof(tableAddress));
+    }
+}
+
+// Module of the function in the compile statistics, named like the parser
+// names it. Nothing is looked up while they are disabled.
+QString getStatisticsModule(FunctionExpression * expr) {
+    if ( !CompileStatistics::global().isEnabled() )
+        return QString();
+
+    QString file = SymbolTable::global().name(expr->fileSymbol());
+    return file.isEmpty() ? QString("<source>") : file;
+}
+
+void * compileFunctionExpr(Runtime * runtime, CompilingData * data, FunctionExpression * expr) {
+    CompileTimer timer(getStatisticsModule(expr));
+    QByteArray key;
+
+    // Unchanged functions skip the compiler and register allocation
+    if ( data->codeCache ) {
+        timer.start(CompilePhase::CodeEmission);
+        key = getFunctionKey(data, expr);
+
+        CachedFunction cached;
+        data->callees.clear();
+        data->callFixups.clear();
+
+        if ( data->codeCache->load(key, &cached) ) {
+            void * code = installCachedFunction(runtime, data, cached);
+
+            if ( code ) {
+                describeFunctionCode(data, expr, code, quint64(cached.code.size()), cached.lines);
+
+                timer.count(CompileCounter::CachedFunctions);
+                timer.count(CompileCounter::EmittedBytes, cached.code.size());
+                return code;
+            }
+        }
+    }
+
+    IrFunction function;
+
+    timer.start(CompilePhase::IrBuilding);
+
+    if ( !buildFunctionIr(getIrProgram(data), expr, &function) ) {
+        return 0;
+    }
+
+    timer.start(CompilePhase::IrOptimization);
+    optimizeFunctionIr(data, &function);
+
+    timer.start(CompilePhase::InstructionSelection);
+    timer.count(CompileCounter::IrInstructions, function.instructionCount());
+
+    X86Compiler & c = threadCompiler(runtime);
+
+    data->functionSymbol = expr->symbol();
+    data->function = addHoundFunc(c, getFunctionPrototype(function.parameterTypes, function.returnType));
+    data->slotLabels.clear();
+    data->trampolineLabels.clear();
+    data->callLabels.clear();
+    data->callees.clear();
+
+    if ( !compileIr(c, data, function) ) {
+        qDebug() << "Could not compile function: " << expr->name();
+        return 0;
+    }
+
+    c.endFunc();
+
+    emitTrampolines(c, data);
+    emitSlotAddresses(c, data);
+
+    X86Assembler a(runtime);
+
+    timer.start(CompilePhase::RegisterAllocation);
+
+    if ( c.serialize(&a) != kErrorOk ) {
+        qDebug() << "Could not assemble function: " << expr->name();
+        return 0;
+    }
+
+    // Slots of the variables the registers didn't suffice for
+    timer.count(CompileCounter::SpilledBytes, data->function->getMemStackSize());
+    timer.start(CompilePhase::CodeEmission);
+
+    void * code;
+
+    if ( runtime->add(&code, &a) != kErrorOk ) {
+        qDebug() << "Could not add function: " << expr->name();
+        return 0;
+    }
+
+    data->callees = data->slotLabels.keys();
+    collectCallFixups(data, a, static_cast<const char *>(code));
+
+    QVector<CodeLine> lines = getCodeLines(data, a, expr->line());
+    describeFunctionCode(data, expr, code, a.getCodeSize(), lines);
+
+    if ( data->codeCache ) {
+        CachedFunction cached;
+        cached.code = QByteArray(static_cast<const char *>(code), int(a.getCodeSize()));
+        cached.lines = lines;
+
+        for ( QHash<Symbol, Label>::const_iterator it = data->slotLabels.constBegin();
+              it != data->slotLabels.constEnd(); ++it ) {
+            CodeFixup fixup;
+            fixup.offset = quint32(a.getLabelOffset(it.value()));
+            fixup.functionName = SymbolTable::global().text(it.key());
+
+            cached.fixups.append(fixup);
+        }
+
+        if ( data->usesHostTable ) {
+            CodeFixup fixup;
+            fixup.offset = quint32(a.getLabelOffset(data->hostTableLabel));
+            fixup.functionName = HostTableFixup;
+
+            cached.fixups.append(fixup);
+        }
+
+        for ( const CallFixup & call : data->callFixups ) {
+            CodeFixup fixup;
+            fixup.offset = call.offset;
+            fixup.functionName = SymbolTable::global().text(call.function);
+
+            cached.callSites.append(fixup);
+        }
+
+        if ( !data->codeCache->store(key, cached) ) {
+            qDebug() << "Could not cache function: " << expr->name();
+        }
+    }
+
+    timer.count(CompileCounter::CompiledFunctions);
+    timer.count(CompileCounter::EmittedBytes, qint64(a.getCodeSize()));
+
+    return code;
+}
+
+void * compileEntryExpr(Runtime * runtime, CompilingData * data, const QList<Expression *> & expressions) {
+    CompileTimer timer(CompileStatistics::global().isEnabled() ? QString("<top level>") : QString());
+    IrFunction function;
+
+    timer.start(CompilePhase::IrBuilding);
+
+    if ( !buildEntryIr(getIrProgram(data), expressions, &function) ) {
+        return 0;
+    }
+
+    timer.start(CompilePhase::IrOptimization);
+    optimizeFunctionIr(data, &function);
+
+    timer.start(CompilePhase::InstructionSelection);
+    timer.count(CompileCounter::IrInstructions, function.instructionCount());
+
+    X86Compiler & c = threadCompiler(runtime);
+
+    data->functionSymbol = NoSymbol;
+    data->slotLabels.clear();
+    data->trampolineLabels.clear();
+    data->callLabels.clear();
+    data->function = c.addFunc(kFuncConvHost, getFunctionPrototype(function.parameterTypes, function.returnType));
+
+    if ( !compileIr(c, data, function) ) {
+        qDebug() << "Could not compile top level expressions";
+        return 0;
+    }
+
+    c.endFunc();
+
+    emitTrampolines(c, data);
+    emitSlotAddresses(c, data);
+
+    void * code = addGeneratedCode(c, runtime, data->codeHeap, "<top level>", &timer);
+
+    if ( code ) {
+        timer.count(CompileCounter::CompiledFunctions);
+        timer.count(CompileCounter::SpilledBytes, data->function->getMemStackSize());
+    }
+
+    return code;
+}
+
+void initCompilingData(CompilingData * data, const QVector<FunctionExpression *> & functions,
+                       const QVector<int> * functionSlots, void ** functionTable, CodeCache * codeCache,
+                       const HostTable * hostTable, CodeHeap * codeHeap, Profiler * profiler) {
+    data->functions = functions;
+    data->functionSlots = functionSlots;
+    data->functionTable = functionTable;
+    data->hostTable = hostTable;
+    data->codeHeap = codeHeap;
+    data->profiler = profiler;
+
+    // Profiled code holds the address of the profiler, it isn't cached
+    data->codeCache = profiler ? 0 : codeCache;
+}
+
+bool VmCompiler::compile(ExpressionList expressions) {
+    // Functions are compiled for the types their callers pass
+    if ( !inferTypes(expressions) ) {
+        qDebug() << "Types of the program can't be inferred";
+        return false;
+    }
+
+    if ( !prepare(expressions) ) {
+        return false;
+    }
+
+    for ( int slot = 0; slot < m_functions.size(); ++slot ) {
+        if ( !compileFunction(slot) ) {
+            release();
+            return false;
+        }
+    }
+
+    CompilingData data;
+    initCompilingData(&data, m_functions, &m_functionSlots, m_functionTable.data(), m_codeCache.data(),
+                      &m_hostTable, m_machine->codeHeap(), m_profiler);
+
+    m_entry = compileEntryExpr(m_module->runtime(), &data, m_entryExpressions);
+
+    if ( !m_entry ) {
+        release();
+        return false;
+    }
+
+    return true;
+}
+
+bool VmCompiler::prepare(ExpressionList expressions) {
+    release();
+
+    m_module = m_machine->codeHeap()->createModule();
+
+    // Symbols created after this point can't be used by the program
+    m_symbolCount = SymbolTable::global().size();
+    m_functionSlots.fill(-1, m_symbolCount);
+
+    // Collect functions first so that they can call each other
+    // independent of their order
+    ProgramParts parts;
+
+    if ( !splitProgram(expressions, &parts) ) {
+        release();
+        return false;
+    }
+
+    m_functions = parts.functions;
+    m_entryExpressions = parts.entryExpressions;
+
+    for ( int slot = 0; slot < m_functions.size(); ++slot ) {
+        m_functionSlots[m_functions.at(slot)->symbol()] = slot;
+    }
+
+    // The table must not move anymore since its slots are part of the code
+    m_functionTable.fill(0, m_functions.size());
+    m_callSites.resize(m_functions.size());
+
+    return true;
+}
+
+void * VmCompiler::compileFunction(Symbol symbol) {
+    int slot = getSlot(m_functionSlots, symbol);
+
+    if ( slot < 0 ) {
+        qDebug() << "Unknown function: " << SymbolTable::global().name(symbol);
+        return 0;
+    }
+
+    return compileFunction(slot);
+}
+
+void * VmCompiler::compileFunction(int slot) {
+    CompilingData data;
+    initCompilingData(&data, m_functions, &m_functionSlots, m_functionTable.data(), m_codeCache.data(),
+                      &m_hostTable, m_machine->codeHeap(), m_profiler);
+
+    void * code = compileFunctionExpr(m_module->runtime(), &data, m_functions.at(slot));
+
+    if ( !code ) {
+        return 0;
+    }
+
+    // Called functions which aren't compiled yet continue in the interpreter
+    if ( m_interpreterEntry ) {
+        for ( Symbol callee : data.callees ) {
+            int calleeSlot = getSlot(m_functionSlots, callee);
+
+            if ( !loadSlot(&m_functionTable.at(calleeSlot)) && !compileBridge(calleeSlot) ) {
+                return 0;
+            }
+        }
+    }
+
+    // Direct calls go to the current code of their callee and follow it
+    // whenever the callee gets new code
+    {
+        QMutexLocker locker(&m_callSiteMutex);
+
+        for ( const CallFixup & call : data.callFixups ) {
+            addCallSite(getSlot(m_functionSlots, call.function), static_cast<char *>(code) + call.offset);
+        }
+    }
+
+    bindSlot(slot, code);
+
+    return code;
+}
+
+bool VmCompiler::bindSlot(int slot, void * code, bool isBridge) {
+    QMutexLocker locker(&m_callSiteMutex);
+
+    // The compiled code may have been bound while the bridge was compiled
+    if ( isBridge && loadSlot(&m_functionTable.at(slot)) ) {
+        return false;
+    }
+
+    storeSlot(&m_functionTable[slot], code);
+
+    for ( const CallSite & site : m_callSites.at(slot) ) {
+        patchCallSite(site, code);
+    }
+
+    return true;
+}
+
+void VmCompiler::addCallSite(int slot, char * displacement) {
+    // Calls whose displacement can't be changed at once keep using their
+    // trampoline
+    if ( quintptr(displacement) % CacheLineSize > CacheLineSize - sizeof(qint32) ) {
+        return;
+    }
+
+    qint32 trampoline;
+    memcpy(&trampoline, displacement, sizeof(trampoline));
+
+    CallSite site;
+    site.displacement = displacement;
+    site.trampoline = displacement + sizeof(qint32) + trampoline;
+
+    m_callSites[slot].append(site);
+
+    if ( void * target = loadSlot(&m_functionTable.at(slot)) ) {
+        patchCallSite(site, target);
+    }
+}
+
+void VmCompiler::patchCallSite(const CallSite & site, void * target) {
+    char * next = site.displacement + sizeof(qint32);
+    qint64 distance = static_cast<char *>(target) - next;
+
+    // Code out of reach is called through the trampoline
+    if ( distance != qint64(qint32(distance)) ) {
+        distance = site.trampoline - next;
+    }
+
+    // A single store, threads running the call see either the old or
+    // the new target
+    void * writable = m_machine->codeHeap()->writableAddress(site.displacement);
+
+    if ( writable ) {
+        *static_cast<volatile qint32 *>(writable) = qint32(distance);
+    }
+}
+
+NativeEntry VmCompiler::compileNativeEntry(Symbol symbol) {
+    int slot = getSlot(m_functionSlots, symbol);
+
+    if ( slot < 0 ) {
+        qDebug() << "Unknown function: " << SymbolTable::global().name(symbol);
+        return 0;
+    }
+
+    void * code = compileFunction(slot);
+
+    if ( !code ) {
+        return 0;
+    }
+
+    FunctionExpression * function = m_functions.at(slot);
+    ExpressionList parameters = function->parameters();
+
+    X86Compiler & c = threadCompiler(m_module->runtime());
+    c.addFunc(kFuncConvHost, FuncBuilder1<int, const void *>());
+
+    X86GpVar registers = c.newGpVar(kVarTypeIntPtr);
+    c.setArg(0, registers);
+
+    // Every argument is read with the type the function expects
+    QList<X86Var> arguments;
+
+    for ( int i = 0; i < parameters.size(); ++i ) {
+        int offset = i * int(sizeof(Register));
+
+        if ( getParameterType(parameters.at(i)) == DataType::Float ) {
+            X86XmmVar argument = c.newXmmVar(kX86VarTypeXmmSs);
+            c.movss(argument, x86::ptr(registers, offset));
+            arguments.append(argument);
+        }
+        else {
+            X86GpVar argument = c.newGpVar(kVarTypeInt32);
+            c.mov(argument, x86::dword_ptr(registers, offset));
+            arguments.append(argument);
+        }
+    }
+
+    X86GpVar target = c.newGpVar(kVarTypeIntPtr);
+    c.mov(target, imm_ptr(code));
+
+    X86CallNode * call = c.call(target, HoundCallConv, getFunctionPrototype(function));
+
+    for ( int i = 0; i < arguments.size(); ++i ) {
+        call->setArg(i, arguments.at(i));
+    }
+
+    X86GpVar result = c.newGpVar(kVarTypeInt32);
+
+    if ( getReturnType(function) == DataType::Float ) {
+        X86XmmVar floatResult = c.newXmmVar(kX86VarTypeXmmSs);
+        call->setRet(0, floatResult);
+        c.movd(result, floatResult);
+    }
+    else {
+        call->setRet(0, result);
+    }
+
+    c.ret(result);
+    c.endFunc();
+
+    NativeEntry entry = reinterpret_cast<NativeEntry>(addGeneratedCode(c, m_module->runtime(), m_machine->codeHeap(),
+                                                                       "entry:" + function->name()));
+
+    if ( !entry ) {
+        qDebug() << "Could not create native entry for function: " << function->name();
+    }
+
+    return entry;
+}
+
+void VmCompiler::setInterpreterEntry(InterpreterEntry entry, void * context) {
+    m_interpreterEntry = entry;
+    m_interpreterContext = context;
 }
 
-void VmCompiler::compile(QList<QSharedPointer<Expression> > expressions) {
-    JitRuntime runtime;
-    X86Compiler c(&runtime);
+void VmCompiler::setDivisionErrorEntry(DivisionErrorEntry entry, void * context) {
+    if ( entry ) {
+        m_hostTable.divisionErrorEntry = entry;
+        m_hostTable.divisionErrorContext = context;
+    }
+    else {
+        m_hostTable.divisionErrorEntry = &VmCompiler::reportDivisionError;
+        m_hostTable.divisionErrorContext = this;
+    }
+}
+
+void VmCompiler::reportDivisionError(void * context) {
+    VmCompiler * compiler = static_cast<VmCompiler *>(context);
+
+    // The code continues until it returns, only the first one is reported
+    if ( !compiler->m_failed )
+        qDebug() << "Integer division error";
 
-    // Function returning 'int' accepting pointer and two indexes.
-    c.addFunc(kFuncConvHost, FuncBuilder3<int, IntPtrType *, IntPtrType *, IntPtrType *>());
+    compiler->m_failed = true;
+}
+
+// Native function with the signature of the Hound function which passes
+// its arguments to the interpreter
+void * VmCompiler::compileBridge(int slot) {
+    QMutexLocker locker(&m_bridgeMutex);
 
-    X86GpVar p(c, kVarTypeIntPtr, "p");
-    X86GpVar aIndex(c, kVarTypeIntPtr, "aIndex");
-    X86GpVar bIndex(c, kVarTypeIntPtr, "bIndex");
+    // Another thread may have been faster
+    if ( void * code = loadSlot(&m_functionTable.at(slot)) ) {
+        return code;
+    }
 
-    c.setArg(0, p);
-    c.setArg(1, aIndex);
-    c.setArg(2, bIndex);
+    FunctionExpression * function = m_functions.at(slot);
+    ExpressionList parameters = function->parameters();
 
-    X86GpVar a(c, kVarTypeInt32, "a");
-    X86GpVar b(c, kVarTypeInt32, "b");
+    X86Compiler & c = threadCompiler(m_module->runtime());
+    addHoundFunc(c, getFunctionPrototype(function));
 
-    // Read 'a' by using a memory operand having base register, index register
-    // and scale. Translates to 'mov a, dword ptr [p + aIndex << 2]'.
-    c.mov(a, x86::ptr(p, aIndex, 2));
+    // Floats are passed as their bits, like in interpreter registers
+    X86Mem arguments = c.newStack(qMax(parameters.size(), 1) * sizeof(qint32), sizeof(qint32));
 
-    // Read 'b' by using a memory operand having base register only. Variables
-    // 'p' and 'bIndex' are both modified.
+    for ( int i = 0; i < parameters.size(); ++i ) {
+        if ( getParameterType(parameters.at(i)) == DataType::Float ) {
+            X86XmmVar param = c.newXmmVar(kX86VarTypeXmmSs);
+            c.setArg(i, param);
+            c.movss(arguments.adjusted(i * sizeof(qint32)), param);
+        }
+        else {
+            X86GpVar param = c.newGpVar(kVarTypeInt32);
+            c.setArg(i, param);
+            c.mov(arguments.adjusted(i * sizeof(qint32)), param);
+        }
+    }
 
-    // Shift bIndex by 2 (exactly the same as multiplying by 4).
-    // And add scaled 'bIndex' to 'p' resulting in 'p = p + bIndex * 4'.
-    c.shl(bIndex, 2);
-    c.add(p, bIndex);
+    X86GpVar argumentsAddress = c.newGpVar(kVarTypeIntPtr);
+    X86GpVar context = c.newGpVar(kVarTypeIntPtr);
+    X86GpVar symbol = c.newGpVar(kVarTypeUInt32);
+    X86GpVar target = c.newGpVar(kVarTypeIntPtr);
+    X86GpVar result = c.newGpVar(kVarTypeInt32);
 
-    // Read 'b'.
-    c.mov(b, x86::ptr(p));
+    c.lea(argumentsAddress, arguments);
+    c.mov(context, imm_ptr(m_interpreterContext));
+    c.mov(symbol, imm(function->symbol()));
+    c.mov(target, imm_ptr(reinterpret_cast<void *>(m_interpreterEntry)));
 
-    X86GpVar ptr_puts(c, kVarTypeIntPtr, "printf");
-    c.mov(ptr_puts, imm_ptr(printf));
-    // call puts("abc")
-    const char s[] = "%s | %s\n";
-    const char s2[] = "foo me bar";
-    const char s3[] = " kkk";
-    X86CallNode * node = c.call(ptr_puts, kFuncConvHost, FuncBuilder3<void, const char*, const char*, const char*>());
-    node->setArg(0, imm_ptr(s));
-    node->setArg(1, imm_ptr(s2));
-    node->setArg(2, imm_ptr(s3));
+    X86CallNode * call = c.call(target, kFuncConvHost, FuncBuilder3<int, void *, quint32, const qint32 *>());
+    call->setArg(0, context);
+    call->setArg(1, symbol);
+    call->setArg(2, argumentsAddress);
+    call->setRet(0, result);
 
-    // a = a + b;
-    c.add(a, b);
+    if ( getReturnType(function) == DataType::Float ) {
+        X86XmmVar floatResult = c.newXmmVar(kX86VarTypeXmmSs);
+        c.movd(floatResult, result);
+        c.ret(floatResult);
+    }
+    else {
+        c.ret(result);
+    }
 
-    c.ret(a);
     c.endFunc();
 
-    // The prototype of the generated function changed also here.
-    typedef int (*FuncType)(const int*, intptr_t, intptr_t);
-    FuncType func = asmjit_cast<FuncType>(c.make());
+    void * code = addGeneratedCode(c, m_module->runtime(), m_machine->codeHeap(), "bridge:" + function->name());
+
+    if ( !code ) {
+        qDebug() << "Could not create bridge for function: " << function->name();
+        return 0;
+    }
+
+    // The bridge stays unused in the module until it is released
+    if ( !bindSlot(slot, code, true) ) {
+        return loadSlot(&m_functionTable.at(slot));
+    }
+
+    return code;
+}
+
+int VmCompiler::execute() {
+    if ( !m_entry ) {
+        qDebug() << "Nothing compiled to execute";
+        return 0;
+    }
 
-    // Array passed to 'func'
-    const int array[] = { 1, 2, 3, 5, 8, 13 };
+    EntryFunction entry = asmjit_cast<EntryFunction>(m_entry);
 
-    int x = func(array, 1, 2);
-    int y = func(array, 3, 5);
+    m_failed = false;
+    int result = entry();
 
-    printf("x=%d\n", x); // Outputs "x=5".
-    printf("y=%d\n", y); // Outputs "y=18".
+    return m_failed ? 0 : result;
+}
 
-    runtime.release((void*)func);
+void * VmCompiler::function(const QString & name) const {
+    return function(SymbolTable::global().lookup(name));
 }
 
+void * VmCompiler::function(Symbol symbol) const {
+    int slot = getSlot(m_functionSlots, symbol);
+
+    if ( slot < 0 ) {
+        return 0;
+    }
+
+    return loadSlot(&m_functionTable.at(slot));
+}
+
+void VmCompiler::release() {
+    // Frees the code of all functions at once
+    m_machine->codeHeap()->releaseModule(m_module);
+    m_module = 0;
+
+    m_functionSlots.clear();
+    m_functionTable.clear();
+    m_callSites.clear();
+    m_functions.clear();
+    m_entryExpressions.clear();
+    m_entry = 0;
+}
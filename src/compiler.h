@@ -1,17 +1,138 @@
 #ifndef COMPILER_H
 #define COMPILER_H
 
+#include <QtCore/QMutex>
 #include <QtCore/QObject>
+#include <QtCore/QScopedPointer>
+#include <QtCore/QVector>
 #include <QtCore/qglobal.h>
 
+#include "codecache.h"
 #include "expression.h"
 
+class CodeModule;
+class Profiler;
+class VirtualMachine;
+
+// Called by native code for functions which aren't compiled, floats
+// are passed and returned as their bits
+typedef int (*InterpreterEntry)(void * context, Symbol function, const qint32 * arguments);
+
+// Called by native code when an integer division fails, the function
+// returns 0 behind it and its callers continue as usual
+typedef void (*DivisionErrorEntry)(void * context);
+
+// Host functions of native code. The code holds the address of the table
+// and not of the functions, so cached code is valid in every process.
+struct HostTable {
+    DivisionErrorEntry divisionErrorEntry;
+    void * divisionErrorContext;
+    float (*powFloat)(float base, float exponent);
+};
+
+// Calls native code with the arguments in interpreter registers, the
+// result comes back as the bits of a register. This is the only way for
+// the host into a compiled function.
+typedef qint32 (*NativeEntry)(const void * registers);
+
 class VmCompiler : public QObject
 {
     Q_OBJECT
 public:
-    explicit VmCompiler(QObject *parent = 0);
-    void compile(QList<QSharedPointer<Expression> > expressions);
+    // Code is placed into the code heap of the machine
+    explicit VmCompiler(VirtualMachine * machine, QObject *parent = 0);
+    ~VmCompiler();
+
+    // Compiled functions are cached there, no caching if empty
+    void setCodeCacheDirectory(const QString & directory);
+
+    // The expressions are only used while compiling
+    bool compile(ExpressionList expressions);
+
+    // Collects the functions without compiling them, the expressions
+    // have to stay alive as long as functions are compiled. Their types
+    // have to be inferred before.
+    bool prepare(ExpressionList expressions);
+
+    // Compiles one function of the prepared program into its table slot.
+    // Different functions can be compiled on different threads at once.
+    void * compileFunction(Symbol symbol);
+
+    // Compiles the function and an entry the interpreter can call it through
+    NativeEntry compileNativeEntry(Symbol symbol);
+
+    // Called functions without code get a bridge into the interpreter
+    void setInterpreterEntry(InterpreterEntry entry, void * context);
+
+    // Failed divisions are reported there, without an entry they are
+    // printed and execute returns 0
+    void setDivisionErrorEntry(DivisionErrorEntry entry, void * context);
+
+    // Functions compiled after this report their calls and returns to
+    // the profiler, 0 for code without profiling
+    void setProfiler(Profiler * profiler) { m_profiler = profiler; }
+
+    // Runs the top level expressions and returns the value of the last one
+    int execute();
+
+    // Native code of a compiled function, it uses the calling convention
+    // of compiled code and not the one of the host
+    void * function(const QString & name) const;
+    void * function(Symbol symbol) const;
+
+private:
+    void release();
+
+    void * compileFunction(int slot);
+    void * compileBridge(int slot);
+
+    static void reportDivisionError(void * context);
+
+    // Direct call of a function from compiled code
+    struct CallSite {
+        char * displacement;
+        char * trampoline;
+    };
+
+    // Installs code into the slot and points all direct calls of the
+    // function at it. Bridges are only installed into empty slots, false
+    // if the function got code in the meantime.
+    bool bindSlot(int slot, void * code, bool isBridge = false);
+
+    // Both need the call site mutex
+    void addCallSite(int slot, char * displacement);
+    void patchCallSite(const CallSite & site, void * target);
+
+    VirtualMachine * m_machine;
+
+    // Code of the last compile, released as a whole
+    CodeModule * m_module;
+    QScopedPointer<CodeCache> m_codeCache;
+
+    // Every function owns one slot, calls between functions go through it.
+    // Indexed by symbol, -1 if the symbol isn't a function.
+    QVector<int> m_functionSlots;
+    QVector<void *> m_functionTable;
+
+    // Direct calls of every function by slot, they are bound to the code
+    // in its table slot
+    QVector<QList<CallSite> > m_callSites;
+    QMutex m_callSiteMutex;
+
+    QVector<FunctionExpression *> m_functions;
+    QList<Expression *> m_entryExpressions;
+    int m_symbolCount;
+
+    InterpreterEntry m_interpreterEntry;
+    void * m_interpreterContext;
+    QMutex m_bridgeMutex;
+
+    HostTable m_hostTable;
+    bool m_failed;
+
+    Profiler * m_profiler;
+
+    void * m_entry;
 };
 
 #endif // COMPILER_H
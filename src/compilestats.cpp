@@ -0,0 +1,239 @@
+#include "compilestats.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QMutexLocker>
+
+#include <algorithm>
+#include <string.h>
+
+static const char * const ReportVariable = "HOUND_COMPILE_STATS";
+
+ModuleCompileStats::ModuleCompileStats()
+{
+    memset(phaseNanoseconds, 0, sizeof(phaseNanoseconds));
+    memset(counters, 0, sizeof(counters));
+}
+
+qint64 ModuleCompileStats::totalNanoseconds() const
+{
+    qint64 total = 0;
+
+    for ( qint64 nanoseconds : phaseNanoseconds ) {
+        total += nanoseconds;
+    }
+
+    return total;
+}
+
+void ModuleCompileStats::add(const ModuleCompileStats & stats)
+{
+    for ( int i = 0; i < int(CompilePhase::PhaseCount); ++i ) {
+        phaseNanoseconds[i] += stats.phaseNanoseconds[i];
+    }
+
+    for ( int i = 0; i < int(CompileCounter::CounterCount); ++i ) {
+        counters[i] += stats.counters[i];
+    }
+}
+
+QJsonObject toJson(const ModuleCompileStats & stats) {
+    QJsonObject phases;
+
+    for ( int i = 0; i < int(CompilePhase::PhaseCount); ++i ) {
+        phases.insert(CompileStatistics::phaseName(CompilePhase(i)), stats.phaseNanoseconds[i]);
+    }
+
+    QJsonObject counters;
+
+    for ( int i = 0; i < int(CompileCounter::CounterCount); ++i ) {
+        counters.insert(CompileStatistics::counterName(CompileCounter(i)), stats.counters[i]);
+    }
+
+    QJsonObject module;
+    module.insert("module", stats.module);
+    module.insert("totalNs", stats.totalNanoseconds());
+    module.insert("phasesNs", phases);
+    module.insert("counters", counters);
+
+    return module;
+}
+
+///////////////////////////////////////////
+
+CompileStatistics & CompileStatistics::global()
+{
+    static CompileStatistics statistics;
+    return statistics;
+}
+
+CompileStatistics::CompileStatistics() :
+    m_enabled(0)
+{
+    m_reportFile = QString::fromLocal8Bit(qgetenv(ReportVariable));
+
+    if ( !m_reportFile.isEmpty() )
+        setEnabled(true);
+}
+
+CompileStatistics::~CompileStatistics()
+{
+    if ( m_reportFile.isEmpty() )
+        return;
+
+    QFile file(m_reportFile);
+    QByteArray json = toJson();
+
+    if ( !file.open(QIODevice::WriteOnly) || file.write(json) != json.size() )
+        qDebug() << "Could not write compile statistics " << m_reportFile;
+}
+
+void CompileStatistics::add(const ModuleCompileStats & stats)
+{
+    QMutexLocker locker(&m_mutex);
+
+    ModuleCompileStats & module = m_modules[stats.module];
+    module.module = stats.module;
+    module.add(stats);
+}
+
+void CompileStatistics::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_modules.clear();
+}
+
+QList<ModuleCompileStats> CompileStatistics::modules() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    QList<QString> names = m_modules.keys();
+    std::sort(names.begin(), names.end());
+
+    QList<ModuleCompileStats> modules;
+
+    for ( const QString & name : names ) {
+        modules.append(m_modules.value(name));
+    }
+
+    return modules;
+}
+
+ModuleCompileStats CompileStatistics::module(const QString & module) const
+{
+    QMutexLocker locker(&m_mutex);
+
+    ModuleCompileStats stats = m_modules.value(module);
+    stats.module = module;
+
+    return stats;
+}
+
+QByteArray CompileStatistics::toJson() const
+{
+    ModuleCompileStats total;
+    total.module = "<all>";
+
+    QJsonArray modules;
+
+    for ( const ModuleCompileStats & stats : this->modules() ) {
+        modules.append(::toJson(stats));
+        total.add(stats);
+    }
+
+    QJsonObject report;
+    report.insert("modules", modules);
+    report.insert("total", ::toJson(total));
+
+    return QJsonDocument(report).toJson();
+}
+
+const char * CompileStatistics::phaseName(CompilePhase phase)
+{
+    switch ( phase )
+    {
+    case CompilePhase::Lexing:
+        return "lexing";
+    case CompilePhase::Parsing:
+        return "parsing";
+    case CompilePhase::IrBuilding:
+        return "irBuilding";
+    case CompilePhase::IrOptimization:
+        return "irOptimization";
+    case CompilePhase::InstructionSelection:
+        return "instructionSelection";
+    case CompilePhase::RegisterAllocation:
+        return "registerAllocation";
+    case CompilePhase::CodeEmission:
+        return "codeEmission";
+    default:
+        return "";
+    }
+}
+
+const char * CompileStatistics::counterName(CompileCounter counter)
+{
+    switch ( counter )
+    {
+    case CompileCounter::Tokens:
+        return "tokens";
+    case CompileCounter::ParsedNodes:
+        return "parsedNodes";
+    case CompileCounter::CompiledFunctions:
+        return "compiledFunctions";
+    case CompileCounter::CachedFunctions:
+        return "cachedFunctions";
+    case CompileCounter::IrInstructions:
+        return "irInstructions";
+    case CompileCounter::SpilledBytes:
+        return "spilledBytes";
+    case CompileCounter::EmittedBytes:
+        return "emittedBytes";
+    default:
+        return "";
+    }
+}
+
+///////////////////////////////////////////
+
+CompileTimer::CompileTimer(const QString & module) :
+    m_active(CompileStatistics::global().isEnabled()),
+    m_phase(CompilePhase::PhaseCount),
+    m_running(false)
+{
+    if ( m_active )
+        m_stats.module = module;
+}
+
+CompileTimer::~CompileTimer()
+{
+    if ( !m_active )
+        return;
+
+    stop();
+    CompileStatistics::global().add(m_stats);
+}
+
+void CompileTimer::start(CompilePhase phase)
+{
+    if ( !m_active )
+        return;
+
+    stop();
+
+    m_phase = phase;
+    m_running = true;
+    m_timer.start();
+}
+
+void CompileTimer::stop()
+{
+    if ( !m_running )
+        return;
+
+    addTime(m_phase, m_timer.nsecsElapsed());
+    m_running = false;
+}
@@ -0,0 +1,142 @@
+#ifndef COMPILESTATS_H
+#define COMPILESTATS_H
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/qglobal.h>
+
+enum class CompilePhase {
+    // Reading the file and scanning tokens
+    Lexing,
+    // Building the syntax tree, without the time of the lexer
+    Parsing,
+    // Lowering the syntax tree of a function into IR
+    IrBuilding,
+    IrOptimization,
+    // Emitting the IR as asmjit compiler nodes
+    InstructionSelection,
+    // asmjit allocates the registers and encodes the instructions in one
+    // go, so the encoding is part of this phase
+    RegisterAllocation,
+    // Copying and relocating the code into executable memory, or loading
+    // it from the code cache
+    CodeEmission,
+
+    PhaseCount
+};
+
+enum class CompileCounter {
+    Tokens,
+    ParsedNodes,
+    CompiledFunctions,
+    CachedFunctions,
+    IrInstructions,
+    // Stack frame bytes the register allocator needed for spills
+    SpilledBytes,
+    EmittedBytes,
+
+    CounterCount
+};
+
+struct ModuleCompileStats {
+    ModuleCompileStats();
+
+    QString module;
+
+    qint64 phaseNanoseconds[int(CompilePhase::PhaseCount)];
+    qint64 counters[int(CompileCounter::CounterCount)];
+
+    qint64 nanoseconds(CompilePhase phase) const { return phaseNanoseconds[int(phase)]; }
+    qint64 count(CompileCounter counter) const { return counters[int(counter)]; }
+    qint64 totalNanoseconds() const;
+
+    void add(const ModuleCompileStats & stats);
+};
+
+///////////////////////////////////////////
+///
+/// Time and work of every phase of the front end and the compiler, per
+/// module of the program. Setting HOUND_COMPILE_STATS to a file name
+/// enables it from the start and writes the JSON report there at exit.
+///
+
+class CompileStatistics
+{
+public:
+    // Shared by the parsers and the compilers of all threads
+    static CompileStatistics & global();
+
+    // Nothing is recorded while it is disabled
+    bool isEnabled() const { return m_enabled.load() != 0; }
+    void setEnabled(bool enabled) { m_enabled.store(enabled ? 1 : 0); }
+
+    void add(const ModuleCompileStats & stats);
+    void clear();
+
+    // Sorted by module name
+    QList<ModuleCompileStats> modules() const;
+    ModuleCompileStats module(const QString & module) const;
+
+    // Every module and the sum of all of them
+    QByteArray toJson() const;
+
+    static const char * phaseName(CompilePhase phase);
+    static const char * counterName(CompileCounter counter);
+
+private:
+    Q_DISABLE_COPY(CompileStatistics)
+
+    CompileStatistics();
+    ~CompileStatistics();
+
+    QAtomicInt m_enabled;
+    QString m_reportFile;
+
+    mutable QMutex m_mutex;
+    QHash<QString, ModuleCompileStats> m_modules;
+};
+
+///////////////////////////////////////////
+///
+/// Times one phase after the other while a module or function is
+/// compiled. Everything is added to the statistics at once when it goes
+/// out of scope, it does nothing if they are disabled.
+///
+
+class CompileTimer
+{
+public:
+    explicit CompileTimer(const QString & module);
+    ~CompileTimer();
+
+    bool isActive() const { return m_active; }
+
+    // Ends the current phase
+    void start(CompilePhase phase);
+    void stop();
+
+    // Time which was measured another way
+    void addTime(CompilePhase phase, qint64 nanoseconds) {
+        m_stats.phaseNanoseconds[int(phase)] += nanoseconds;
+    }
+
+    void count(CompileCounter counter, qint64 count = 1) {
+        m_stats.counters[int(counter)] += count;
+    }
+
+private:
+    Q_DISABLE_COPY(CompileTimer)
+
+    bool m_active;
+    ModuleCompileStats m_stats;
+
+    CompilePhase m_phase;
+    bool m_running;
+    QElapsedTimer m_timer;
+};
+
+#endif // COMPILESTATS_H
@@ -1,5 +1,10 @@
 #include "expression.h"
 
+#include <cstdlib>
+#include <cstring>
+
+#include <QtCore/QSet>
+
 QString getDataTypeName(DataType type) {
     QString name;
 
@@ -11,15 +16,133 @@ QString getDataTypeName(DataType type) {
     case DataType::StringType:
         name = "String";
         break;
+    case DataType::Int8:
+        name = "Int8";
+        break;
+    case DataType::Int16:
+        name = "Int16";
+        break;
     case DataType::Int32:
         name = "Int32";
         break;
+    case DataType::Int64:
+        name = "Int64";
+        break;
     case DataType::Float:
         name = "Float";
         break;
+    case DataType::Double:
+        name = "Double";
+        break;
     default:
         break;
     }
 
     return name;
 }
+
+
+// Blocks start small since a streamed tree often holds one expression,
+// every new block is twice as big up to the maximum. Requests bigger
+// than the next block get their own.
+static const size_t ArenaFirstBlockSize = 1024;
+static const size_t ArenaMaximumBlockSize = 64 * 1024;
+static const size_t ArenaAlignment = 16;
+
+ExpressionArena::ExpressionArena() :
+    m_current(0),
+    m_end(0),
+    m_blockSize(ArenaFirstBlockSize),
+    m_allocatedBytes(0)
+{
+}
+
+ExpressionArena::~ExpressionArena()
+{
+    for ( int i = m_expressions.size() - 1; i >= 0; --i ) {
+        m_expressions.at(i)->~Expression();
+    }
+
+    for ( char * block : m_blocks ) {
+        ::free(block);
+    }
+}
+
+ExpressionList ExpressionArena::createList(Expression * const * expressions, int size)
+{
+    if ( size == 0 )
+        return ExpressionList();
+
+    Expression ** list = static_cast<Expression **>( allocate(sizeof(Expression *) * size) );
+    ::memcpy(list, expressions, sizeof(Expression *) * size);
+
+    return ExpressionList(list, size);
+}
+
+void * ExpressionArena::allocate(size_t size)
+{
+    size = ( size + ArenaAlignment - 1 ) & ~( ArenaAlignment - 1 );
+
+    if ( size_t(m_end - m_current) < size ) {
+        size_t blockSize = qMax(size, m_blockSize);
+        char * block = static_cast<char *>( ::malloc(blockSize) );
+
+        if ( !block )
+            throw std::bad_alloc();
+
+        m_blocks.append(block);
+        m_allocatedBytes += blockSize;
+
+        // A big request shouldn't throw away the rest of the current block
+        if ( blockSize > m_blockSize )
+            return block;
+
+        m_current = block;
+        m_end = block + blockSize;
+        m_blockSize = qMin(m_blockSize * 2, ArenaMaximumBlockSize);
+    }
+
+    void * memory = m_current;
+    m_current += size;
+
+    return memory;
+}
+
+bool splitProgram(ExpressionList expressions, ProgramParts * parts) {
+    QSet<Symbol> symbols;
+
+    parts->functions.clear();
+    parts->entryExpressions.clear();
+
+    for ( Expression * expr : expressions ) {
+
+        if ( expr->isFunction() ) {
+            FunctionExpression * function = static_cast<FunctionExpression *>(expr);
+
+            if ( function->isAnonymous() ) {
+                qDebug() << "Anonymous functions are not supported";
+                return false;
+            }
+
+            if ( symbols.contains(function->symbol()) ) {
+                qDebug() << "Function is defined twice: " << function->name();
+                return false;
+            }
+
+            symbols.insert(function->symbol());
+            parts->functions.append(function);
+        }
+        else if ( !expr->isUnknown() && !expr->isComment() && !expr->isPackage() && !expr->isImport() ) {
+            parts->entryExpressions.append(expr);
+        }
+    }
+
+    return true;
+}
+
+ElseExpression * takeElse(ExpressionList expressions, int * index) {
+    if ( *index + 1 >= expressions.size() || !expressions.at(*index + 1)->isElse() )
+        return 0;
+
+    return static_cast<ElseExpression *>( expressions.at(++*index) );
+}
@@ -1,14 +1,19 @@
 #ifndef EXPRESSION
 #define EXPRESSION
 
-#include <QtCore/QChar>
+#include <QtCore/QByteArray>
 #include <QtCore/QDebug>
-#include <QtCore/QFile>
 #include <QtCore/QHash>
-#include <QtCore/QTextStream>
+#include <QtCore/QLatin1String>
+#include <QtCore/QList>
 #include <QtCore/QSharedPointer>
+#include <QtCore/QVariant>
+#include <QtCore/QVector>
+
+#include <new>
 
 #include "operators.h"
+#include "symbols.h"
 
 /////////////////////////////////////////////////////
 
@@ -58,37 +63,98 @@ enum DataType {
     StringType,
 };
 
+class Expression;
+class ExpressionArena;
+
+///////////////////////////////////////////
+///
+/// Non-owning view on child expressions. The pointers live in the
+/// same arena as the expressions themselves.
+///
+
+class ExpressionList
+{
+    Expression * const * m_data;
+    int m_size;
+public:
+    ExpressionList() : m_data(0), m_size(0) {}
+    ExpressionList(Expression * const * data, int size) : m_data(data), m_size(size) {}
+
+    int size() const { return m_size; }
+    bool isEmpty() const { return m_size == 0; }
+
+    Expression * at(int i) const { return m_data[i]; }
+    Expression * operator[](int i) const { return m_data[i]; }
+
+    Expression * const * begin() const { return m_data; }
+    Expression * const * end() const { return m_data + m_size; }
+};
+
 struct ParsingData {
-    // Char data
-    QChar lastChar;
-    QChar lastUnknownChar;
+    // Owner of all expressions created while parsing
+    ExpressionArena * arena;
 
-    QString identifier;
+    // Char data
+    char lastUnknownChar;
 
-    // Reserved keywords
-    QHash<QString, LanguageOperator> operators;
-    QHash<LanguageOperator, uint> operatorPriorities;
-    QHash<QString, ExpressionType> keywords;
+    // Last token, points into the source buffer
+    QLatin1String identifier;
 
     // Indetention
     uint indentStep : 4;
     uint previousIndent;
     uint currentIndent;
 
-    // Stream
-    QTextStream * stream;
+    // Operator read after an operand, not yet taken by a binary expression
+    LanguageOperator pendingOperator;
 };
 
 
 QString getDataTypeName(DataType type);
 
+// Float to Int32 like cvttss2si of the compiled code, NaN and values out
+// of range become INT_MIN instead of being undefined
+inline qint32 truncateFloat(float value) {
+    if ( !( value >= -2147483648.0f && value < 2147483648.0f ) )
+        return qint32(0x80000000);
+
+    return qint32(value);
+}
+
+// Integers wrap around like the ones of the compiled code
+inline qint32 wrapInt(quint32 value) {
+    return qint32(value);
+}
+
+// Square and multiply, the result wraps around like the one of repeated
+// multiplications. Negative exponents give 1.
+inline qint32 powInt(qint32 base, qint32 exponent) {
+    quint32 result = 1;
+    quint32 factor = quint32(base);
+
+    while ( exponent > 0 ) {
+        if ( exponent & 1 )
+            result *= factor;
+
+        factor *= factor;
+        exponent >>= 1;
+    }
+
+    return wrapInt(result);
+}
+
 
 
 class Expression
 {
+    quint32 m_line = 0;
 public:
     virtual ~Expression() {}
 
+    // Source line where the expression starts, 0 if unknown
+    quint32 line() const { return m_line; }
+    void setLine(quint32 line) { m_line = line; }
+
     virtual ExpressionType type() const { return ExpressionType::UnknownExpression; }
     virtual QString toString() const { return "Unknown"; }
 
@@ -102,6 +168,9 @@ public:
     bool isRawValue()  { return is(ExpressionType::RawData); }
     bool isCodeBlock()  { return is(ExpressionType::CodeBlock); }
     bool isIf()  { return is(ExpressionType::If); }
+    bool isElse()  { return is(ExpressionType::Else); }
+    bool isVariable()  { return is(ExpressionType::Variable); }
+    bool isBinary()  { return is(ExpressionType::BinaryExpr); }
 };
 
 
@@ -117,12 +186,13 @@ public:
 
 class VariableExpression : public Expression
 {
-    QString m_name;
-    DataType m_type;
+    Symbol m_symbol = NoSymbol;
+    DataType m_type = NoDataType;
 public:
     // Name
-    QString name() const { return m_name; }
-    void setName(const QString & name) { m_name = name; }
+    Symbol symbol() const { return m_symbol; }
+    void setSymbol(Symbol symbol) { m_symbol = symbol; }
+    QString name() const { return SymbolTable::global().name(m_symbol); }
 
     // Type
     void setDataType(DataType type) { m_type = type; }
@@ -139,11 +209,12 @@ public:
 
 class PackageExpression : public Expression
 {
-    QString m_path;
+    Symbol m_path = NoSymbol;
 public:
     // Path
-    QString path() const { return m_path; }
-    void setPath(const QString & path) { m_path = path; }
+    Symbol pathSymbol() const { return m_path; }
+    void setPath(Symbol path) { m_path = path; }
+    QString path() const { return SymbolTable::global().name(m_path); }
 
     virtual ~PackageExpression() {}
 
@@ -154,11 +225,12 @@ public:
 
 class ImportExpression : public Expression
 {
-    QString m_path;
+    Symbol m_path = NoSymbol;
 public:
     // Path
-    QString path() const { return m_path; }
-    void setPath(const QString & path) { m_path = path; }
+    Symbol pathSymbol() const { return m_path; }
+    void setPath(Symbol path) { m_path = path; }
+    QString path() const { return SymbolTable::global().name(m_path); }
 
     virtual ~ImportExpression() {}
 
@@ -169,29 +241,37 @@ public:
 
 class FunctionExpression : public Expression
 {
-    QString m_name;
+    Symbol m_symbol = NoSymbol;
     bool m_isAnonymous = false;
-    QSharedPointer<Expression> m_codeBlock;
-    QList< QSharedPointer<Expression> > m_parameters;
+    Expression * m_codeBlock = 0;
+    ExpressionList m_parameters;
+    DataType m_returnType = NoDataType;
+    Symbol m_file = NoSymbol;
 public:
     // Name
-    QString name() const { return m_name; }
-    void setName(const QString & name) { m_name = name; }
+    Symbol symbol() const { return m_symbol; }
+    void setSymbol(Symbol symbol) { m_symbol = symbol; }
+    QString name() const { return SymbolTable::global().name(m_symbol); }
 
     // Parameters
-    void addParameter(QSharedPointer<Expression> expr) {
-        m_parameters.append(expr);
-    }
-
-    QList< QSharedPointer<Expression> > parameters() const { return m_parameters; }
+    void setParameters(ExpressionList parameters) { m_parameters = parameters; }
+    ExpressionList parameters() const { return m_parameters; }
 
     // Is anonymous
     bool isAnonymous() const { return m_isAnonymous; }
     void setAnonymous(bool ano) { m_isAnonymous = ano; }
 
     // Code
-    QSharedPointer<Expression> code() const { return m_codeBlock; }
-    void setCode(QSharedPointer<Expression> code) { m_codeBlock = code; }
+    Expression * code() const { return m_codeBlock; }
+    void setCode(Expression * code) { m_codeBlock = code; }
+
+    // Type of the result, set by the type inference
+    DataType returnType() const { return m_returnType; }
+    void setReturnType(DataType type) { m_returnType = type; }
+
+    // Source file, set by the project
+    Symbol fileSymbol() const { return m_file; }
+    void setFile(Symbol file) { m_file = file; }
 
     virtual ~FunctionExpression() {}
 
@@ -202,7 +282,7 @@ public:
         else {
             if ( m_parameters.size() > 0 ) {
                 QString parameters;
-                for( QSharedPointer<Expression> param : m_parameters ) {
+                for( Expression * param : m_parameters ) {
                     parameters +=  param->toString() + ", ";
                 }
 
@@ -217,18 +297,16 @@ public:
 
 class FunctionInvokationExpression : public Expression
 {
-    QString m_functionName;
-    QList< QSharedPointer<Expression> > m_parameters;
+    Symbol m_function = NoSymbol;
+    ExpressionList m_parameters;
 public:
     // Name
-    QString functionName() const { return m_functionName; }
-    void setFunctionName(const QString & name) { m_functionName = name; }
+    Symbol functionSymbol() const { return m_function; }
+    void setFunctionSymbol(Symbol function) { m_function = function; }
+    QString functionName() const { return SymbolTable::global().name(m_function); }
 
-    void addParameter(QSharedPointer<Expression> expr) {
-        m_parameters.append(expr);
-    }
-
-    QList< QSharedPointer<Expression> > parameters() const { return m_parameters; }
+    void setParameters(ExpressionList parameters) { m_parameters = parameters; }
+    ExpressionList parameters() const { return m_parameters; }
 
     virtual ~FunctionInvokationExpression() {}
 
@@ -239,14 +317,14 @@ public:
 
 class CodeBlockExpression : public Expression
 {
-    QList< QSharedPointer<Expression> > m_expressions;
+    ExpressionList m_expressions;
 public:
 
-    void addExpression(QSharedPointer<Expression> expr) {
-        m_expressions.append(expr);
+    void setExpressions(ExpressionList expressions) {
+        m_expressions = expressions;
     }
 
-    QList< QSharedPointer<Expression> > expressions() const {
+    ExpressionList expressions() const {
         return m_expressions;
     }
 
@@ -283,25 +361,27 @@ public:
 
 class BinaryExpression : public Expression
 {
-    QSharedPointer<Expression> m_leftExpr;
-    QSharedPointer<Expression> m_rightExpr;
+    Expression * m_leftExpr = 0;
+    Expression * m_rightExpr = 0;
     LanguageOperator m_operator;
+    DataType m_operandType = NoDataType;
+    DataType m_type = NoDataType;
 public:
     virtual ~BinaryExpression() {}
 
-    void setLeftExpression(QSharedPointer<Expression> left) {
+    void setLeftExpression(Expression * left) {
         m_leftExpr = left;
     }
 
-    QSharedPointer<Expression> leftExpression() {
+    Expression * leftExpression() {
         return m_leftExpr;
     }
 
-    void setRightExpression(QSharedPointer<Expression> right) {
+    void setRightExpression(Expression * right) {
         m_rightExpr = right;
     }
 
-    QSharedPointer<Expression> rightExpression() {
+    Expression * rightExpression() {
         return m_rightExpr;
     }
 
@@ -313,6 +393,24 @@ public:
         return m_operator;
     }
 
+    // Type both operands are converted to, set by the type inference
+    void setOperandType(DataType type) {
+        m_operandType = type;
+    }
+
+    DataType operandType() const {
+        return m_operandType;
+    }
+
+    // Type of the result, set by the type inference
+    void setDataType(DataType type) {
+        m_type = type;
+    }
+
+    DataType dataType() const {
+        return m_type;
+    }
+
     virtual ExpressionType type() const { return ExpressionType::BinaryExpr; }
     virtual QString toString() const { return "Binary"; }
 };
@@ -320,27 +418,37 @@ public:
 
 class IfExpression : public Expression
 {
-    QSharedPointer<BinaryExpression> m_condition;
-    QSharedPointer<Expression> m_block;
+    BinaryExpression * m_condition = 0;
+    Expression * m_block = 0;
+    DataType m_type = NoDataType;
 public:
     virtual ~IfExpression() {}
 
-    void setCondition(QSharedPointer<BinaryExpression> con) {
+    void setCondition(BinaryExpression * con) {
         m_condition = con;
     }
 
-    QSharedPointer<BinaryExpression> condition() {
+    BinaryExpression * condition() {
         return m_condition;
     }
 
-    void setBlock(QSharedPointer<Expression> bl) {
+    void setBlock(Expression * bl) {
         m_block = bl;
     }
 
-    QSharedPointer<Expression> block() {
+    Expression * block() {
         return m_block;
     }
 
+    // Type of the value of if and else together, set by the type inference
+    void setDataType(DataType type) {
+        m_type = type;
+    }
+
+    DataType dataType() const {
+        return m_type;
+    }
+
     virtual ExpressionType type() const { return ExpressionType::If; }
     virtual QString toString() const { return "If"; }
 };
@@ -348,15 +456,15 @@ public:
 
 class ElseExpression : public Expression
 {
-    QSharedPointer<Expression> m_block;
+    Expression * m_block = 0;
 public:
     virtual ~ElseExpression() {}
 
-    void setBlock(QSharedPointer<Expression> bl) {
+    void setBlock(Expression * bl) {
         m_block = bl;
     }
 
-    QSharedPointer<Expression> block() {
+    Expression * block() {
         return m_block;
     }
 
@@ -365,4 +473,85 @@ public:
 };
 
 
+///////////////////////////////////////////
+///
+/// Owns every expression of one parse run. Expressions are placed into
+/// growing blocks one after the other and all of them are destroyed and
+/// freed together with the arena.
+///
+
+class ExpressionArena
+{
+public:
+    ExpressionArena();
+    ~ExpressionArena();
+
+    template<typename T>
+    T * create() {
+        T * expr = new (allocate(sizeof(T))) T();
+        m_expressions.append(expr);
+        return expr;
+    }
+
+    // Copies the pointers into the arena
+    ExpressionList createList(Expression * const * expressions, int size);
+
+    int expressionCount() const { return m_expressions.size(); }
+    qint64 allocatedBytes() const { return m_allocatedBytes; }
+
+private:
+    Q_DISABLE_COPY(ExpressionArena)
+
+    void * allocate(size_t size);
+
+    QVector<char *> m_blocks;
+    char * m_current;
+    char * m_end;
+    size_t m_blockSize;
+    qint64 m_allocatedBytes;
+
+    // Needed to run the destructors, the memory is freed block wise
+    QVector<Expression *> m_expressions;
+};
+
+
+///////////////////////////////////////////
+///
+/// Result of Parser::parse, keeps the arena alive as long as
+/// somebody uses its expressions.
+///
+
+class SyntaxTree
+{
+    ExpressionArena m_arena;
+    ExpressionList m_expressions;
+public:
+    ExpressionArena * arena() { return &m_arena; }
+
+    // Top level expressions
+    ExpressionList expressions() const { return m_expressions; }
+    void setExpressions(ExpressionList expressions) { m_expressions = expressions; }
+};
+
+
+///////////////////////////////////////////
+///
+/// Top level of a program the way the type inference and the compilers
+/// see it: the named functions and the expressions which run as the
+/// entry. Comments, packages and imports belong to neither.
+///
+
+struct ProgramParts {
+    QVector<FunctionExpression *> functions;
+    QList<Expression *> entryExpressions;
+};
+
+// Fails on anonymous functions and on functions which are defined twice
+bool splitProgram(ExpressionList expressions, ProgramParts * parts);
+
+// Else which belongs to the if at index, 0 if there is none. Moves index
+// to the else so that the caller skips it.
+ElseExpression * takeElse(ExpressionList expressions, int * index);
+
+
 #endif // EXPRESSION
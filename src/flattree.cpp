@@ -0,0 +1,274 @@
+#include "flattree.h"
+
+#include <QtCore/QVarLengthArray>
+
+FlatTree::FlatTree()
+{
+}
+
+FlatTree FlatTree::fromExpressions(ExpressionList expressions)
+{
+    FlatTree tree;
+
+    for ( Expression * expr : expressions ) {
+        tree.m_roots.append(tree.translate(expr));
+    }
+
+    return tree;
+}
+
+NodeIndex FlatTree::addNode(const FlatNode & node, const NodeIndex * operands, int operandCount)
+{
+    FlatNode added = node;
+    added.firstOperand = quint32(m_operands.size());
+    added.operandCount = quint32(operandCount);
+
+    for ( int i = 0; i < operandCount; ++i ) {
+        m_operands.append(operands[i]);
+    }
+
+    m_nodes.append(added);
+
+    return NodeIndex(m_nodes.size() - 1);
+}
+
+NodeIndex FlatTree::translate(Expression * expr)
+{
+    FlatNode node;
+    node.type = quint8(expr->type());
+    node.dataType = quint8(DataType::NoDataType);
+    node.op = quint8(LanguageOperator::UnknownOperator);
+    node.flags = 0;
+    node.symbol = NoSymbol;
+    node.value = 0;
+    node.line = expr->line();
+
+    // Operands are translated first so that they end up before the node
+    QVarLengthArray<NodeIndex, 8> operands;
+
+    switch ( expr->type() )
+    {
+    case ExpressionType::Variable: {
+        VariableExpression * variable = static_cast<VariableExpression *>(expr);
+        node.symbol = variable->symbol();
+        node.dataType = quint8(variable->dataType());
+        break;
+    }
+
+    case ExpressionType::Package:
+        node.symbol = static_cast<PackageExpression *>(expr)->pathSymbol();
+        break;
+
+    case ExpressionType::Import:
+        node.symbol = static_cast<ImportExpression *>(expr)->pathSymbol();
+        break;
+
+    case ExpressionType::FunctionInvokation: {
+        FunctionInvokationExpression * invokation = static_cast<FunctionInvokationExpression *>(expr);
+        node.symbol = invokation->functionSymbol();
+
+        for ( Expression * param : invokation->parameters() ) {
+            operands.append(translate(param));
+        }
+        break;
+    }
+
+    case ExpressionType::RawData: {
+        RawDataExpression * raw = static_cast<RawDataExpression *>(expr);
+        node.dataType = quint8(raw->dataType());
+
+        if ( raw->dataType() == DataType::Int32 ) {
+            node.value = quint32(raw->data().toInt());
+        }
+        else if ( raw->dataType() == DataType::Float ) {
+            node.value = quint32(m_floats.size());
+            m_floats.append(raw->data().toFloat());
+        }
+        else {
+            node.value = quint32(m_strings.size());
+            m_strings.append(raw->data().toString());
+        }
+        break;
+    }
+
+    case ExpressionType::FunctionExpressionType: {
+        FunctionExpression * function = static_cast<FunctionExpression *>(expr);
+        node.symbol = function->symbol();
+
+        if ( function->isAnonymous() )
+            node.flags |= FlatNode::AnonymousFlag;
+
+        operands.append(function->code() ? translate(function->code()) : NoNode);
+
+        for ( Expression * param : function->parameters() ) {
+            operands.append(translate(param));
+        }
+        break;
+    }
+
+    case ExpressionType::CodeBlock:
+        for ( Expression * codeExpr : static_cast<CodeBlockExpression *>(expr)->expressions() ) {
+            operands.append(translate(codeExpr));
+        }
+        break;
+
+    case ExpressionType::If: {
+        IfExpression * ifExpr = static_cast<IfExpression *>(expr);
+        operands.append(ifExpr->condition() ? translate(ifExpr->condition()) : NoNode);
+        operands.append(ifExpr->block() ? translate(ifExpr->block()) : NoNode);
+        break;
+    }
+
+    case ExpressionType::Else: {
+        ElseExpression * elseExpr = static_cast<ElseExpression *>(expr);
+        operands.append(elseExpr->block() ? translate(elseExpr->block()) : NoNode);
+        break;
+    }
+
+    case ExpressionType::BinaryExpr: {
+        BinaryExpression * binary = static_cast<BinaryExpression *>(expr);
+        node.op = quint8(binary->theOperator());
+        operands.append(translate(binary->leftExpression()));
+        operands.append(translate(binary->rightExpression()));
+        break;
+    }
+
+    default:
+        break;
+    }
+
+    return addNode(node, operands.constData(), operands.size());
+}
+
+QSharedPointer<SyntaxTree> FlatTree::toSyntaxTree() const
+{
+    QSharedPointer<SyntaxTree> tree = QSharedPointer<SyntaxTree>::create();
+    ExpressionArena * arena = tree->arena();
+
+    // Operands are created before their parents
+    QVector<Expression *> expressions(m_nodes.size(), 0);
+    QVarLengthArray<Expression *, 8> operands;
+
+    for ( int i = 0; i < m_nodes.size(); ++i ) {
+        const FlatNode & node = m_nodes.at(i);
+
+        operands.clear();
+
+        for ( quint32 k = 0; k < node.operandCount; ++k ) {
+            NodeIndex operandIndex = operand(node, int(k));
+            operands.append(operandIndex == NoNode ? 0 : expressions.at(operandIndex));
+        }
+
+        Expression * expr;
+
+        switch ( node.type )
+        {
+        case ExpressionType::Comment:
+            expr = arena->create<CommentExpression>();
+            break;
+
+        case ExpressionType::Variable: {
+            VariableExpression * variable = arena->create<VariableExpression>();
+            variable->setSymbol(node.symbol);
+            variable->setDataType(DataType(node.dataType));
+            expr = variable;
+            break;
+        }
+
+        case ExpressionType::Package: {
+            PackageExpression * package = arena->create<PackageExpression>();
+            package->setPath(node.symbol);
+            expr = package;
+            break;
+        }
+
+        case ExpressionType::Import: {
+            ImportExpression * import = arena->create<ImportExpression>();
+            import->setPath(node.symbol);
+            expr = import;
+            break;
+        }
+
+        case ExpressionType::FunctionInvokation: {
+            FunctionInvokationExpression * invokation = arena->create<FunctionInvokationExpression>();
+            invokation->setFunctionSymbol(node.symbol);
+            invokation->setParameters(arena->createList(operands.constData(), operands.size()));
+            expr = invokation;
+            break;
+        }
+
+        case ExpressionType::RawData: {
+            RawDataExpression * raw = arena->create<RawDataExpression>();
+            raw->setDataType(DataType(node.dataType));
+
+            if ( node.dataType == DataType::Int32 )
+                raw->setData(integer(node));
+            else if ( node.dataType == DataType::Float )
+                raw->setData(floatingPoint(node));
+            else
+                raw->setData(string(node));
+
+            expr = raw;
+            break;
+        }
+
+        case ExpressionType::FunctionExpressionType: {
+            FunctionExpression * function = arena->create<FunctionExpression>();
+            function->setSymbol(node.symbol);
+            function->setAnonymous(node.flags & FlatNode::AnonymousFlag);
+            function->setCode(operands.at(0));
+            function->setParameters(arena->createList(operands.constData() + 1, operands.size() - 1));
+            expr = function;
+            break;
+        }
+
+        case ExpressionType::CodeBlock: {
+            CodeBlockExpression * block = arena->create<CodeBlockExpression>();
+            block->setExpressions(arena->createList(operands.constData(), operands.size()));
+            expr = block;
+            break;
+        }
+
+        case ExpressionType::If: {
+            IfExpression * ifExpr = arena->create<IfExpression>();
+            ifExpr->setCondition(static_cast<BinaryExpression *>( operands.at(0) ));
+            ifExpr->setBlock(operands.at(1));
+            expr = ifExpr;
+            break;
+        }
+
+        case ExpressionType::Else: {
+            ElseExpression * elseExpr = arena->create<ElseExpression>();
+            elseExpr->setBlock(operands.at(0));
+            expr = elseExpr;
+            break;
+        }
+
+        case ExpressionType::BinaryExpr: {
+            BinaryExpression * binary = arena->create<BinaryExpression>();
+            binary->setOperator(LanguageOperator(node.op));
+            binary->setLeftExpression(operands.at(0));
+            binary->setRightExpression(operands.at(1));
+            expr = binary;
+            break;
+        }
+
+        default:
+            expr = arena->create<Expression>();
+            break;
+        }
+
+        expr->setLine(node.line);
+        expressions[i] = expr;
+    }
+
+    QVarLengthArray<Expression *, 64> roots;
+
+    for ( NodeIndex root : m_roots ) {
+        roots.append(expressions.at(root));
+    }
+
+    tree->setExpressions(arena->createList(roots.constData(), roots.size()));
+
+    return tree;
+}
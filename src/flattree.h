@@ -0,0 +1,105 @@
+#ifndef FLATTREE_H
+#define FLATTREE_H
+
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtCore/qglobal.h>
+
+#include "expression.h"
+
+typedef quint32 NodeIndex;
+
+const NodeIndex NoNode = 0xffffffff;
+
+///////////////////////////////////////////
+///
+/// One expression of a flat tree. Children are never referenced
+/// directly, they are a range in the operand table of the tree:
+///
+/// - Binary: left, right
+/// - If: condition, block
+/// - Else: block
+/// - Function: code, parameters...
+/// - Function invokation: arguments...
+/// - Code block: expressions...
+///
+
+struct FlatNode {
+    quint8 type;        // ExpressionType
+    quint8 dataType;    // DataType of variables and raw data
+    quint8 op;          // LanguageOperator of binary expressions
+    quint8 flags;
+
+    // Name of variables, functions and invokations, path of
+    // packages and imports
+    Symbol symbol;
+
+    // Int32 raw data is stored directly, floats and strings are
+    // indices into the literal tables
+    quint32 value;
+
+    quint32 firstOperand;
+    quint32 operandCount;
+
+    // Source line, 0 if unknown
+    quint32 line;
+
+    enum Flags {
+        AnonymousFlag = 0x1
+    };
+
+    ExpressionType expressionType() const { return ExpressionType(type); }
+    bool is(ExpressionType checkType) const { return type == checkType; }
+};
+
+
+///////////////////////////////////////////
+///
+/// The expressions of a program in one contiguous array. Children are
+/// always stored before their parents, the module cache relies on it
+/// when it checks a loaded tree.
+///
+
+class FlatTree
+{
+public:
+    FlatTree();
+
+    // Translates the expressions of a syntax tree
+    static FlatTree fromExpressions(ExpressionList expressions);
+
+    // Creates the expressions again, e.g. for a tree from the cache
+    QSharedPointer<SyntaxTree> toSyntaxTree() const;
+
+    int size() const { return m_nodes.size(); }
+    const FlatNode & node(NodeIndex index) const { return m_nodes.at(index); }
+
+    // Top level expressions in source order
+    const QVector<NodeIndex> & roots() const { return m_roots; }
+
+    NodeIndex operand(const FlatNode & node, int i) const {
+        return m_operands.at(node.firstOperand + i);
+    }
+
+    // Literals
+    qint32 integer(const FlatNode & node) const { return qint32(node.value); }
+    float floatingPoint(const FlatNode & node) const { return m_floats.at(node.value); }
+    QString string(const FlatNode & node) const { return m_strings.at(node.value); }
+
+private:
+    friend class ModuleCache;
+
+    NodeIndex translate(Expression * expr);
+    NodeIndex addNode(const FlatNode & node, const NodeIndex * operands, int operandCount);
+
+    QVector<FlatNode> m_nodes;
+    QVector<NodeIndex> m_operands;
+    QVector<NodeIndex> m_roots;
+
+    // Literal tables
+    QVector<float> m_floats;
+    QVector<QString> m_strings;
+};
+
+
+#endif // FLATTREE_H
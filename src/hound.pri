@@ -0,0 +1,70 @@
+#-------------------------------------------------
+#
+# Sources of the compiler and the virtual machine, shared by the
+# executable and the benchmarks
+#
+#-------------------------------------------------
+
+CONFIG += c++11
+
+VERSION = 0.1.0
+
+DEFINES += QT_NO_KEYWORDS
+DEFINES += HOUND_VERSION=\\\"$$VERSION\\\"
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+SOURCES += \
+    $$PWD/expression.cpp \
+    $$PWD/parser.cpp \
+    $$PWD/compiler.cpp \
+    $$PWD/virtualmachine.cpp \
+    $$PWD/lexer.cpp \
+    $$PWD/operators.cpp \
+    $$PWD/symbols.cpp \
+    $$PWD/trace.cpp \
+    $$PWD/flattree.cpp \
+    $$PWD/project.cpp \
+    $$PWD/modulecache.cpp \
+    $$PWD/cachedirectory.cpp \
+    $$PWD/codecache.cpp \
+    $$PWD/codeheap.cpp \
+    $$PWD/compilestats.cpp \
+    $$PWD/perfmap.cpp \
+    $$PWD/profiler.cpp \
+    $$PWD/bytecode.cpp \
+    $$PWD/ir.cpp \
+    $$PWD/irpasses.cpp \
+    $$PWD/typeinference.cpp
+
+win32:CONFIG(release, debug|release): LIBS += -L$$PWD/../../asmjit/release/ -lasmjit
+else:win32:CONFIG(debug, debug|release): LIBS += -L$$PWD/../../asmjit/debug/ -lasmjit
+else:unix: LIBS += -L$$PWD/../../asmjit/ -lasmjit
+
+INCLUDEPATH += $$PWD/../../asmjit/src
+DEPENDPATH += $$PWD/../../asmjit
+
+HEADERS += \
+    $$PWD/expression.h \
+    $$PWD/parser.h \
+    $$PWD/compiler.h \
+    $$PWD/virtualmachine.h \
+    $$PWD/operators.h \
+    $$PWD/lexer.h \
+    $$PWD/symbols.h \
+    $$PWD/trace.h \
+    $$PWD/flattree.h \
+    $$PWD/project.h \
+    $$PWD/modulecache.h \
+    $$PWD/cachedirectory.h \
+    $$PWD/codecache.h \
+    $$PWD/codeheap.h \
+    $$PWD/compilestats.h \
+    $$PWD/perfmap.h \
+    $$PWD/profiler.h \
+    $$PWD/bytecode.h \
+    $$PWD/ir.h \
+    $$PWD/irpasses.h \
+    $$PWD/typeinference.h \
+    $$PWD/version.h
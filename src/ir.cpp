@@ -0,0 +1,495 @@
+#include "ir.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QHash>
+
+struct IrBuildingData {
+    const IrProgram * program;
+    IrFunction * function;
+
+    // Block new values are added to
+    BlockId current;
+
+    // Parameters of the function by their symbol
+    QHash<Symbol, ValueId> parameters;
+
+    // Line of the expression which is built
+    quint32 line;
+};
+
+int IrFunction::instructionCount() const {
+    int count = 0;
+
+    for ( const IrBlock & block : blocks ) {
+        if ( block.isDead )
+            continue;
+
+        count += block.values.size();
+
+        if ( block.terminator != IrTerminator::None )
+            count++;
+    }
+
+    return count;
+}
+
+DataType getParameterType(Expression * param) {
+    DataType type = static_cast<VariableExpression *>(param)->dataType();
+    return type == DataType::NoDataType ? DataType::Int32 : type;
+}
+
+DataType getReturnType(FunctionExpression * function) {
+    DataType type = function->returnType();
+    return type == DataType::NoDataType ? DataType::Int32 : type;
+}
+
+ValueId addValue(IrBuildingData * data, IrOp op, DataType type, ValueId left = NoValue, ValueId right = NoValue) {
+    IrValue value;
+    value.op = op;
+    value.type = type;
+    value.intValue = 0;
+    value.function = NoSymbol;
+    value.block = data->current;
+    value.line = data->line;
+
+    if ( left != NoValue )
+        value.operands.append(left);
+    if ( right != NoValue )
+        value.operands.append(right);
+
+    data->function->values.append(value);
+
+    ValueId id = data->function->values.size() - 1;
+    data->function->blocks[data->current].values.append(id);
+
+    return id;
+}
+
+ValueId addIntConstant(IrBuildingData * data, qint32 intValue) {
+    ValueId id = addValue(data, IrOp::Constant, DataType::Int32);
+    data->function->values[id].intValue = intValue;
+    return id;
+}
+
+ValueId addFloatConstant(IrBuildingData * data, float floatValue) {
+    ValueId id = addValue(data, IrOp::Constant, DataType::Float);
+    data->function->values[id].floatValue = floatValue;
+    return id;
+}
+
+ValueId addConversion(IrBuildingData * data, ValueId value, DataType to) {
+    DataType from = data->function->values.at(value).type;
+
+    if ( from == DataType::Int32 && to == DataType::Float )
+        return addValue(data, IrOp::IntToFloat, to, value);
+    if ( from == DataType::Float && to == DataType::Int32 )
+        return addValue(data, IrOp::FloatToInt, to, value);
+
+    return value;
+}
+
+BlockId addBlock(IrBuildingData * data) {
+    IrBlock block;
+    block.terminator = IrTerminator::None;
+    block.value = NoValue;
+    block.successors[0] = NoBlock;
+    block.successors[1] = NoBlock;
+    block.isDead = false;
+
+    data->function->blocks.append(block);
+
+    return data->function->blocks.size() - 1;
+}
+
+void terminate(IrBuildingData * data, IrTerminator terminator, ValueId value,
+               BlockId first = NoBlock, BlockId second = NoBlock) {
+    IrBlock & block = data->function->blocks[data->current];
+    block.terminator = terminator;
+    block.value = value;
+    block.successors[0] = first;
+    block.successors[1] = second;
+
+    if ( first != NoBlock )
+        data->function->blocks[first].predecessors.append(data->current);
+    if ( second != NoBlock )
+        data->function->blocks[second].predecessors.append(data->current);
+}
+
+ValueId buildExpr(IrBuildingData * data, Expression * expr);
+
+ValueId buildRawDataExpr(IrBuildingData * data, RawDataExpression * expr) {
+    switch ( expr->dataType() )
+    {
+    case DataType::Int32:
+        return addIntConstant(data, expr->data().toInt());
+
+    case DataType::Float:
+        return addFloatConstant(data, expr->data().toFloat());
+
+    default:
+        break;
+    }
+
+    qDebug() << "Unsupported data type: " << getDataTypeName( expr->dataType() );
+
+    return NoValue;
+}
+
+ValueId buildVariableExpr(IrBuildingData * data, VariableExpression * expr) {
+    ValueId value = data->parameters.value(expr->symbol(), NoValue);
+
+    if ( value == NoValue ) {
+        qDebug() << "Unknown variable: " << expr->name();
+    }
+
+    return value;
+}
+
+ValueId buildBinaryExpr(IrBuildingData * data, BinaryExpression * expr) {
+    ValueId left = buildExpr(data, expr->leftExpression());
+    ValueId right = buildExpr(data, expr->rightExpression());
+
+    if ( left == NoValue || right == NoValue ) {
+        return NoValue;
+    }
+
+    LanguageOperator op = expr->theOperator();
+    IrOp irOp;
+
+    switch ( op )
+    {
+    case LanguageOperator::PlusOperator:     irOp = IrOp::Add; break;
+    case LanguageOperator::MinusOperator:    irOp = IrOp::Sub; break;
+    case LanguageOperator::MultiplyOperator: irOp = IrOp::Mul; break;
+    case LanguageOperator::DivideOperator:   irOp = IrOp::Div; break;
+    case LanguageOperator::PowerOfOperator:  irOp = IrOp::Pow; break;
+    case LanguageOperator::LessOperator:     irOp = IrOp::Less; break;
+    case LanguageOperator::GreaterOperator:  irOp = IrOp::Greater; break;
+    case LanguageOperator::AndOperator:      irOp = IrOp::And; break;
+    case LanguageOperator::OrOperator:       irOp = IrOp::Or; break;
+    case LanguageOperator::XorOperator:      irOp = IrOp::Xor; break;
+
+    default:
+        qDebug() << "Unsupported operator: " << op;
+        return NoValue;
+    }
+
+    // The type inference decides what the operands are computed as
+    DataType operandType = expr->operandType();
+
+    if ( operandType == DataType::NoDataType || expr->dataType() == DataType::NoDataType ) {
+        qDebug() << "Types of the operator aren't inferred";
+        return NoValue;
+    }
+
+    left = addConversion(data, left, operandType);
+    right = addConversion(data, right, operandType);
+
+    return addValue(data, irOp, expr->dataType(), left, right);
+}
+
+ValueId buildIfExpr(IrBuildingData * data, IfExpression * ifExpr, ElseExpression * elseExpr) {
+    ValueId condition = buildExpr(data, ifExpr->condition());
+
+    if ( condition == NoValue ) {
+        return NoValue;
+    }
+
+    if ( data->function->values.at(condition).type != DataType::Int32 ) {
+        qDebug() << "Condition has to be an integer";
+        return NoValue;
+    }
+
+    BlockId thenBlock = addBlock(data);
+    BlockId elseBlock = addBlock(data);
+    BlockId mergeBlock = addBlock(data);
+
+    terminate(data, IrTerminator::Branch, condition, thenBlock, elseBlock);
+
+    data->current = thenBlock;
+    ValueId thenValue = buildExpr(data, ifExpr->block());
+
+    if ( thenValue == NoValue ) {
+        return NoValue;
+    }
+
+    // Both values are converted to the inferred type of the if
+    DataType type = ifExpr->dataType();
+
+    if ( type == DataType::NoDataType )
+        type = data->function->values.at(thenValue).type;
+
+    thenValue = addConversion(data, thenValue, type);
+    terminate(data, IrTerminator::Jump, NoValue, mergeBlock);
+
+    // Without else the value of the if is 0
+    data->current = elseBlock;
+    ValueId elseValue;
+
+    if ( !elseExpr )
+        elseValue = type == DataType::Float ? addFloatConstant(data, 0.0f) : addIntConstant(data, 0);
+    else
+        elseValue = buildExpr(data, elseExpr->block());
+
+    if ( elseValue == NoValue ) {
+        return NoValue;
+    }
+
+    elseValue = addConversion(data, elseValue, type);
+
+    if ( data->function->values.at(elseValue).type != type ) {
+        qDebug() << "If and else have different types";
+        return NoValue;
+    }
+
+    terminate(data, IrTerminator::Jump, NoValue, mergeBlock);
+
+    data->current = mergeBlock;
+
+    return addValue(data, IrOp::Phi, type, thenValue, elseValue);
+}
+
+ValueId buildCodeBlockExpr(IrBuildingData * data, CodeBlockExpression * expr) {
+    ExpressionList expressions = expr->expressions();
+    ValueId result = NoValue;
+
+    // The value of a block is the value of its last expression
+    for ( int i = 0; i < expressions.size(); ++i ) {
+        Expression * codeExpr = expressions.at(i);
+
+        if ( codeExpr->isComment() ) {
+            continue;
+        }
+
+        if ( codeExpr->isIf() ) {
+            IfExpression * ifExpr = static_cast<IfExpression *>(codeExpr);
+            result = buildIfExpr(data, ifExpr, takeElse(expressions, &i));
+        }
+        else if ( codeExpr->isElse() ) {
+            qDebug() << "Else without if";
+            return NoValue;
+        }
+        else {
+            result = buildExpr(data, codeExpr);
+        }
+
+        if ( result == NoValue ) {
+            return NoValue;
+        }
+    }
+
+    if ( result == NoValue ) {
+        result = addIntConstant(data, 0);
+    }
+
+    return result;
+}
+
+ValueId buildFunctionInvokationExpr(IrBuildingData * data, FunctionInvokationExpression * expr) {
+    FunctionExpression * callee = data->program->function(expr->functionSymbol());
+
+    if ( !callee ) {
+        qDebug() << "Unknown function: " << expr->functionName();
+        return NoValue;
+    }
+
+    ExpressionList parameters = expr->parameters();
+
+    if ( parameters.size() != callee->parameters().size() ) {
+        qDebug() << "Wrong number of parameters for function: " << expr->functionName();
+        return NoValue;
+    }
+
+    QVector<ValueId> arguments;
+
+    for ( int i = 0; i < parameters.size(); ++i ) {
+        ValueId argument = buildExpr(data, parameters.at(i));
+
+        if ( argument == NoValue ) {
+            return NoValue;
+        }
+
+        arguments.append(addConversion(data, argument, getParameterType(callee->parameters().at(i))));
+    }
+
+    ValueId call = addValue(data, IrOp::Call, getReturnType(callee));
+
+    IrValue & value = data->function->values[call];
+    value.function = expr->functionSymbol();
+    value.operands = arguments;
+
+    return call;
+}
+
+ValueId buildExpr(IrBuildingData * data, Expression * expr) {
+
+    if ( !expr ) {
+        qDebug() << "Missing expression";
+        return NoValue;
+    }
+
+    // Values get the line of the innermost expression which knows it
+    quint32 outerLine = data->line;
+
+    if ( expr->line() )
+        data->line = expr->line();
+
+    ValueId result;
+
+    switch ( expr->type() )
+    {
+    case ExpressionType::RawData:
+        result = buildRawDataExpr(data, static_cast<RawDataExpression *>(expr));
+        break;
+
+    case ExpressionType::Variable:
+        result = buildVariableExpr(data, static_cast<VariableExpression *>(expr));
+        break;
+
+    case ExpressionType::BinaryExpr:
+        result = buildBinaryExpr(data, static_cast<BinaryExpression *>(expr));
+        break;
+
+    case ExpressionType::CodeBlock:
+        result = buildCodeBlockExpr(data, static_cast<CodeBlockExpression *>(expr));
+        break;
+
+    case ExpressionType::FunctionInvokation:
+        result = buildFunctionInvokationExpr(data, static_cast<FunctionInvokationExpression *>(expr));
+        break;
+
+    case ExpressionType::If:
+        result = buildIfExpr(data, static_cast<IfExpression *>(expr), 0);
+        break;
+
+    default:
+        qDebug() << "Unsupported expression: " << expr->toString();
+        result = NoValue;
+        break;
+    }
+
+    data->line = outerLine;
+
+    return result;
+}
+
+void initFunction(IrBuildingData * data, const IrProgram & program, IrFunction * function) {
+    function->values.clear();
+    function->blocks.clear();
+    function->parameterTypes.clear();
+
+    data->program = &program;
+    data->function = function;
+    data->line = 0;
+    data->current = addBlock(data);
+}
+
+bool buildFunctionIr(const IrProgram & program, FunctionExpression * expr, IrFunction * function) {
+    IrBuildingData data;
+    initFunction(&data, program, function);
+
+    function->symbol = expr->symbol();
+    function->returnType = getReturnType(expr);
+    data.line = expr->line();
+
+    ExpressionList parameters = expr->parameters();
+
+    for ( int i = 0; i < parameters.size(); ++i ) {
+        DataType type = getParameterType(parameters.at(i));
+        ValueId param = addValue(&data, IrOp::Parameter, type);
+        function->values[param].index = i;
+
+        function->parameterTypes.append(type);
+        data.parameters.insert(static_cast<VariableExpression *>( parameters.at(i) )->symbol(), param);
+    }
+
+    ValueId result = buildExpr(&data, expr->code());
+
+    if ( result == NoValue ) {
+        qDebug() << "Could not build function: " << expr->name();
+        return false;
+    }
+
+    terminate(&data, IrTerminator::Return, addConversion(&data, result, function->returnType));
+
+    return true;
+}
+
+bool buildEntryIr(const IrProgram & program, const QList<Expression *> & expressions, IrFunction * function) {
+    IrBuildingData data;
+    initFunction(&data, program, function);
+
+    function->symbol = NoSymbol;
+    function->returnType = DataType::Int32;
+
+    ValueId result = addIntConstant(&data, 0);
+
+    for ( Expression * expr : expressions ) {
+        result = buildExpr(&data, expr);
+
+        if ( result == NoValue ) {
+            qDebug() << "Could not build top level expression: " << expr->toString();
+            return false;
+        }
+    }
+
+    terminate(&data, IrTerminator::Return, addConversion(&data, result, function->returnType));
+
+    return true;
+}
+
+static const char * const irOpNames[] = {
+    "nop", "parameter", "constant", "copy", "inttofloat", "floattoint",
+    "add", "sub", "mul", "div", "pow", "less", "greater", "and", "or", "xor",
+    "call", "phi"
+};
+
+QString printIr(const IrFunction & function) {
+    QString listing;
+
+    for ( int b = 0; b < function.blocks.size(); ++b ) {
+        const IrBlock & block = function.blocks.at(b);
+
+        if ( block.isDead )
+            continue;
+
+        listing += "b" + QString::number(b) + ":\n";
+
+        for ( ValueId id : block.values ) {
+            const IrValue & value = function.values.at(id);
+
+            listing += "  v" + QString::number(id) + " = " + irOpNames[int(value.op)] + "." + getDataTypeName(value.type);
+
+            if ( value.op == IrOp::Constant )
+                listing += " " + ( value.type == DataType::Float ? QString::number(value.floatValue) : QString::number(value.intValue) );
+            else if ( value.op == IrOp::Parameter )
+                listing += " " + QString::number(value.index);
+            else if ( value.op == IrOp::Call )
+                listing += " " + SymbolTable::global().name(value.function);
+
+            for ( ValueId operand : value.operands ) {
+                listing += " v" + QString::number(operand);
+            }
+
+            listing += "\n";
+        }
+
+        switch ( block.terminator )
+        {
+        case IrTerminator::Jump:
+            listing += "  jump b" + QString::number(block.successors[0]) + "\n";
+            break;
+        case IrTerminator::Branch:
+            listing += "  branch v" + QString::number(block.value) + " b" + QString::number(block.successors[0]) +
+                       " b" + QString::number(block.successors[1]) + "\n";
+            break;
+        case IrTerminator::Return:
+            listing += "  return v" + QString::number(block.value) + "\n";
+            break;
+        default:
+            break;
+        }
+    }
+
+    return listing;
+}
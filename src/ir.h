@@ -0,0 +1,127 @@
+#ifndef IR_H
+#define IR_H
+
+#include <QtCore/QList>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtCore/qglobal.h>
+
+#include "expression.h"
+
+// Index of a value in IrFunction::values
+typedef int ValueId;
+
+// Index of a block in IrFunction::blocks
+typedef int BlockId;
+
+const ValueId NoValue = -1;
+const BlockId NoBlock = -1;
+
+enum class IrOp : quint8 {
+    Nop,            // Removed by a pass
+
+    Parameter,      // index
+    Constant,       // intValue or floatValue
+    Copy,           // operand 0
+
+    IntToFloat,
+    FloatToInt,
+
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Pow,
+    Less,
+    Greater,
+    And,
+    Or,
+    Xor,
+
+    Call,           // function, arguments are the operands
+    Phi             // one operand per predecessor, in their order
+};
+
+struct IrValue {
+    IrOp op;
+    DataType type;
+
+    QVector<ValueId> operands;
+
+    union {
+        qint32 intValue;
+        float floatValue;
+        int index;
+    };
+
+    Symbol function;
+
+    BlockId block;
+
+    // Source line, 0 if unknown. Inlined values have the line of the call.
+    quint32 line;
+};
+
+enum class IrTerminator : quint8 {
+    None,
+    Jump,           // successor 0
+    Branch,         // value != 0 ? successor 0 : successor 1
+    Return          // value
+};
+
+struct IrBlock {
+    // Phis come first
+    QVector<ValueId> values;
+    QVector<BlockId> predecessors;
+
+    IrTerminator terminator;
+    ValueId value;
+    BlockId successors[2];
+
+    // Removed by a pass
+    bool isDead;
+};
+
+///////////////////////////////////////////
+///
+/// Typed SSA form of one function. Block 0 is the entry, every value is
+/// defined once and variables are never assigned, so the merges are the
+/// phis behind if and else, of inlined returns and of tail call loops.
+///
+
+struct IrFunction {
+    Symbol symbol;
+
+    QVector<DataType> parameterTypes;
+    DataType returnType;
+
+    QVector<IrValue> values;
+    QVector<IrBlock> blocks;
+
+    int instructionCount() const;
+};
+
+// What calls need to know about the functions of a program
+struct IrProgram {
+    QVector<FunctionExpression *> functions;
+
+    // Indexed by symbol, -1 if the symbol isn't a function
+    const QVector<int> * functionSlots;
+
+    FunctionExpression * function(Symbol symbol) const {
+        int slot = symbol < Symbol(functionSlots->size()) ? functionSlots->at(symbol) : -1;
+        return slot < 0 ? 0 : functions.at(slot);
+    }
+};
+
+// Inferred types, Int32 if nothing is known
+DataType getParameterType(Expression * param);
+DataType getReturnType(FunctionExpression * function);
+
+bool buildFunctionIr(const IrProgram & program, FunctionExpression * expr, IrFunction * function);
+bool buildEntryIr(const IrProgram & program, const QList<Expression *> & expressions, IrFunction * function);
+
+// Readable listing of a function, for debugging
+QString printIr(const IrFunction & function);
+
+#endif // IR_H
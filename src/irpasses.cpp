@@ -0,0 +1,965 @@
+#include "irpasses.h"
+
+#include <QtCore/QHash>
+
+#include <cmath>
+
+// Upper bound of rounds of optimizeIr, every round runs all passes
+static const int MaxOptimizationRounds = 8;
+
+// Callees up to this size after their own optimization are inlined, up
+// to this many levels deep and until the caller grew by the limit
+static const int MaxInlineSize = 30;
+static const int MaxInlineDepth = 3;
+static const int MaxInlineGrowth = 200;
+
+bool isLive(const IrValue & value) {
+    return value.op != IrOp::Nop;
+}
+
+void removeValue(IrFunction * function, ValueId id) {
+    IrValue & value = function->values[id];
+
+    function->blocks[value.block].values.removeOne(id);
+
+    value.op = IrOp::Nop;
+    value.operands.clear();
+}
+
+void replaceUses(IrFunction * function, ValueId from, ValueId to) {
+    for ( IrValue & value : function->values ) {
+        for ( ValueId & operand : value.operands ) {
+            if ( operand == from )
+                operand = to;
+        }
+    }
+
+    for ( IrBlock & block : function->blocks ) {
+        if ( block.value == from )
+            block.value = to;
+    }
+}
+
+void makeConstant(IrValue & value, DataType type) {
+    value.op = IrOp::Constant;
+    value.type = type;
+    value.operands.clear();
+}
+
+void makeCopy(IrValue & value, ValueId source) {
+    value.op = IrOp::Copy;
+    value.operands.clear();
+    value.operands.append(source);
+}
+
+bool isIntConstant(const IrFunction * function, ValueId id, qint32 intValue) {
+    const IrValue & value = function->values.at(id);
+    return value.op == IrOp::Constant && value.type == DataType::Int32 && value.intValue == intValue;
+}
+
+bool foldIntOp(IrValue & value, qint32 left, qint32 right) {
+    switch ( value.op )
+    {
+    case IrOp::Add:     value.intValue = wrapInt(quint32(left) + quint32(right)); break;
+    case IrOp::Sub:     value.intValue = wrapInt(quint32(left) - quint32(right)); break;
+    case IrOp::Mul:     value.intValue = wrapInt(quint32(left) * quint32(right)); break;
+    case IrOp::Pow:     value.intValue = powInt(left, right); break;
+    case IrOp::Less:    value.intValue = left < right; break;
+    case IrOp::Greater: value.intValue = left > right; break;
+    case IrOp::And:     value.intValue = left && right; break;
+    case IrOp::Or:      value.intValue = left || right; break;
+    case IrOp::Xor:     value.intValue = ( left != 0 ) != ( right != 0 ); break;
+
+    case IrOp::Div:
+        // Errors stay for the time the code runs
+        if ( right == 0 || ( right == -1 && left == qint32(0x80000000) ) )
+            return false;
+
+        value.intValue = left / right;
+        break;
+
+    default:
+        return false;
+    }
+
+    makeConstant(value, DataType::Int32);
+
+    return true;
+}
+
+bool foldFloatOp(IrValue & value, float left, float right) {
+    switch ( value.op )
+    {
+    case IrOp::Add:     value.floatValue = left + right; break;
+    case IrOp::Sub:     value.floatValue = left - right; break;
+    case IrOp::Mul:     value.floatValue = left * right; break;
+    case IrOp::Div:     value.floatValue = left / right; break;
+    case IrOp::Pow:     value.floatValue = std::pow(left, right); break;
+
+    case IrOp::Less:
+        value.intValue = left < right;
+        makeConstant(value, DataType::Int32);
+        return true;
+
+    case IrOp::Greater:
+        value.intValue = left > right;
+        makeConstant(value, DataType::Int32);
+        return true;
+
+    default:
+        return false;
+    }
+
+    makeConstant(value, DataType::Float);
+
+    return true;
+}
+
+// x + 0, x * 1 and friends, only for integers since floats have -0
+bool simplifyIntOp(IrFunction * function, IrValue & value) {
+    if ( value.type != DataType::Int32 || value.operands.size() != 2 )
+        return false;
+
+    ValueId left = value.operands.at(0);
+    ValueId right = value.operands.at(1);
+
+    switch ( value.op )
+    {
+    case IrOp::Add:
+        if ( isIntConstant(function, right, 0) ) { makeCopy(value, left); return true; }
+        if ( isIntConstant(function, left, 0) ) { makeCopy(value, right); return true; }
+        break;
+
+    case IrOp::Sub:
+        if ( isIntConstant(function, right, 0) ) { makeCopy(value, left); return true; }
+        break;
+
+    case IrOp::Mul:
+        if ( isIntConstant(function, right, 1) ) { makeCopy(value, left); return true; }
+        if ( isIntConstant(function, left, 1) ) { makeCopy(value, right); return true; }
+
+        if ( isIntConstant(function, left, 0) || isIntConstant(function, right, 0) ) {
+            value.intValue = 0;
+            makeConstant(value, DataType::Int32);
+            return true;
+        }
+        break;
+
+    case IrOp::Div:
+        if ( isIntConstant(function, right, 1) ) { makeCopy(value, left); return true; }
+        break;
+
+    case IrOp::Pow:
+        if ( isIntConstant(function, right, 1) ) { makeCopy(value, left); return true; }
+
+        if ( isIntConstant(function, right, 0) ) {
+            value.intValue = 1;
+            makeConstant(value, DataType::Int32);
+            return true;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return false;
+}
+
+bool foldConstants(IrFunction * function) {
+    bool changed = false;
+
+    for ( IrValue & value : function->values ) {
+        if ( !isLive(value) )
+            continue;
+
+        // A phi of equal values is that value
+        if ( value.op == IrOp::Phi && !value.operands.isEmpty() ) {
+            bool equal = true;
+
+            for ( ValueId operand : value.operands ) {
+                equal = equal && operand == value.operands.first();
+            }
+
+            if ( equal ) {
+                makeCopy(value, value.operands.first());
+                changed = true;
+            }
+
+            continue;
+        }
+
+        if ( value.op == IrOp::Call || value.op == IrOp::Copy || value.op == IrOp::Phi ||
+             value.op == IrOp::Constant || value.op == IrOp::Parameter ) {
+            continue;
+        }
+
+        bool allConstant = true;
+
+        for ( ValueId operand : value.operands ) {
+            allConstant = allConstant && function->values.at(operand).op == IrOp::Constant;
+        }
+
+        if ( !allConstant ) {
+            changed = simplifyIntOp(function, value) || changed;
+            continue;
+        }
+
+        const IrValue & left = function->values.at(value.operands.at(0));
+
+        if ( value.op == IrOp::IntToFloat ) {
+            value.floatValue = float(left.intValue);
+            makeConstant(value, DataType::Float);
+            changed = true;
+        }
+        else if ( value.op == IrOp::FloatToInt ) {
+            value.intValue = truncateFloat(left.floatValue);
+            makeConstant(value, DataType::Int32);
+            changed = true;
+        }
+        else {
+            const IrValue & right = function->values.at(value.operands.at(1));
+
+            if ( left.type == DataType::Float )
+                changed = foldFloatOp(value, left.floatValue, right.floatValue) || changed;
+            else
+                changed = foldIntOp(value, left.intValue, right.intValue) || changed;
+        }
+    }
+
+    return changed;
+}
+
+bool propagateCopies(IrFunction * function) {
+    bool changed = false;
+
+    for ( ValueId id = 0; id < function->values.size(); ++id ) {
+        if ( function->values.at(id).op != IrOp::Copy )
+            continue;
+
+        // Copies of copies end at the first real value
+        ValueId source = function->values.at(id).operands.at(0);
+
+        while ( function->values.at(source).op == IrOp::Copy ) {
+            source = function->values.at(source).operands.at(0);
+        }
+
+        replaceUses(function, id, source);
+        removeValue(function, id);
+
+        changed = true;
+    }
+
+    return changed;
+}
+
+///////////////////////////////////////////
+
+QVector<BlockId> getReversePostorder(const IrFunction * function) {
+    QVector<BlockId> postorder;
+    QVector<bool> visited(function->blocks.size(), false);
+
+    // Explicit stack of blocks and their next successor
+    QVector<QPair<BlockId, int> > stack;
+    stack.append(qMakePair(BlockId(0), 0));
+    visited[0] = true;
+
+    while ( !stack.isEmpty() ) {
+        BlockId block = stack.last().first;
+        int & next = stack.last().second;
+
+        const IrBlock & irBlock = function->blocks.at(block);
+        int successorCount = irBlock.terminator == IrTerminator::Branch ? 2 :
+                             irBlock.terminator == IrTerminator::Jump ? 1 : 0;
+
+        if ( next < successorCount ) {
+            BlockId successor = irBlock.successors[next++];
+
+            if ( !visited.at(successor) ) {
+                visited[successor] = true;
+                stack.append(qMakePair(successor, 0));
+            }
+        }
+        else {
+            postorder.append(block);
+            stack.removeLast();
+        }
+    }
+
+    QVector<BlockId> order;
+
+    for ( int i = postorder.size() - 1; i >= 0; --i ) {
+        order.append(postorder.at(i));
+    }
+
+    return order;
+}
+
+// Immediate dominators after Cooper, Harvey and Kennedy
+QVector<BlockId> getDominators(const IrFunction * function, const QVector<BlockId> & order) {
+    QVector<int> orderIndex(function->blocks.size(), -1);
+
+    for ( int i = 0; i < order.size(); ++i ) {
+        orderIndex[order.at(i)] = i;
+    }
+
+    QVector<BlockId> dominators(function->blocks.size(), NoBlock);
+    dominators[0] = 0;
+
+    bool changed = true;
+
+    while ( changed ) {
+        changed = false;
+
+        for ( int i = 1; i < order.size(); ++i ) {
+            BlockId block = order.at(i);
+            BlockId dominator = NoBlock;
+
+            for ( BlockId predecessor : function->blocks.at(block).predecessors ) {
+                if ( dominators.at(predecessor) == NoBlock )
+                    continue;
+
+                if ( dominator == NoBlock ) {
+                    dominator = predecessor;
+                    continue;
+                }
+
+                BlockId other = predecessor;
+
+                while ( dominator != other ) {
+                    while ( orderIndex.at(dominator) > orderIndex.at(other) )
+                        dominator = dominators.at(dominator);
+                    while ( orderIndex.at(other) > orderIndex.at(dominator) )
+                        other = dominators.at(other);
+                }
+            }
+
+            if ( dominators.at(block) != dominator ) {
+                dominators[block] = dominator;
+                changed = true;
+            }
+        }
+    }
+
+    return dominators;
+}
+
+struct ExpressionKey {
+    IrOp op;
+    DataType type;
+    qint32 bits;
+    ValueId left;
+    ValueId right;
+
+    bool operator==(const ExpressionKey & other) const {
+        return op == other.op && type == other.type && bits == other.bits &&
+               left == other.left && right == other.right;
+    }
+};
+
+inline uint qHash(const ExpressionKey & key, uint seed = 0) {
+    return ::qHash(( uint(key.op) << 24 ) ^ ( uint(key.type) << 16 ) ^ uint(key.bits), seed) ^
+           ::qHash(key.left * 31 + key.right, seed);
+}
+
+bool isCommutative(IrOp op) {
+    return op == IrOp::Add || op == IrOp::Mul || op == IrOp::And || op == IrOp::Or || op == IrOp::Xor;
+}
+
+bool eliminateCommonSubexpressions(IrFunction * function) {
+    QVector<BlockId> order = getReversePostorder(function);
+    QVector<BlockId> dominators = getDominators(function, order);
+
+    QVector<QVector<BlockId> > children(function->blocks.size());
+
+    for ( BlockId block : order ) {
+        if ( block != 0 )
+            children[dominators.at(block)].append(block);
+    }
+
+    // Values of all dominating blocks, removed again when the walk
+    // leaves a block
+    QHash<ExpressionKey, ValueId> available;
+    QVector<QPair<BlockId, int> > stack;
+    QVector<QVector<ExpressionKey> > added(function->blocks.size());
+
+    bool changed = false;
+
+    stack.append(qMakePair(BlockId(0), -1));
+
+    while ( !stack.isEmpty() ) {
+        BlockId block = stack.last().first;
+        int & next = stack.last().second;
+
+        if ( next < 0 ) {
+            QVector<ValueId> values = function->blocks.at(block).values;
+
+            for ( ValueId id : values ) {
+                const IrValue & value = function->values.at(id);
+
+                if ( value.op == IrOp::Call || value.op == IrOp::Phi || value.op == IrOp::Parameter ||
+                     value.op == IrOp::Copy || value.op == IrOp::Nop ) {
+                    continue;
+                }
+
+                ExpressionKey key;
+                key.op = value.op;
+                key.type = value.type;
+                key.bits = value.op == IrOp::Constant ? value.intValue : 0;
+                key.left = value.operands.size() > 0 ? value.operands.at(0) : NoValue;
+                key.right = value.operands.size() > 1 ? value.operands.at(1) : NoValue;
+
+                if ( isCommutative(key.op) && key.left > key.right )
+                    qSwap(key.left, key.right);
+
+                ValueId existing = available.value(key, NoValue);
+
+                if ( existing != NoValue ) {
+                    replaceUses(function, id, existing);
+                    removeValue(function, id);
+                    changed = true;
+                }
+                else {
+                    available.insert(key, id);
+                    added[block].append(key);
+                }
+            }
+
+            next = 0;
+        }
+
+        if ( next < children.at(block).size() ) {
+            stack.append(qMakePair(children.at(block).at(next++), -1));
+        }
+        else {
+            for ( const ExpressionKey & key : added.at(block) ) {
+                available.remove(key);
+            }
+
+            stack.removeLast();
+        }
+    }
+
+    return changed;
+}
+
+///////////////////////////////////////////
+
+void removePredecessor(IrFunction * function, BlockId block, BlockId predecessor) {
+    IrBlock & irBlock = function->blocks[block];
+    int index = irBlock.predecessors.indexOf(predecessor);
+
+    if ( index < 0 )
+        return;
+
+    irBlock.predecessors.remove(index);
+
+    for ( ValueId id : irBlock.values ) {
+        IrValue & value = function->values[id];
+
+        if ( value.op == IrOp::Phi )
+            value.operands.remove(index);
+    }
+}
+
+bool simplifyBranches(IrFunction * function) {
+    bool changed = false;
+
+    // Branches on constants
+    for ( BlockId b = 0; b < function->blocks.size(); ++b ) {
+        IrBlock & block = function->blocks[b];
+
+        if ( block.isDead || block.terminator != IrTerminator::Branch )
+            continue;
+
+        const IrValue & condition = function->values.at(block.value);
+
+        if ( condition.op != IrOp::Constant )
+            continue;
+
+        BlockId taken = condition.intValue ? block.successors[0] : block.successors[1];
+        BlockId skipped = condition.intValue ? block.successors[1] : block.successors[0];
+
+        block.terminator = IrTerminator::Jump;
+        block.value = NoValue;
+        block.successors[0] = taken;
+        block.successors[1] = NoBlock;
+
+        removePredecessor(function, skipped, b);
+        changed = true;
+    }
+
+    // Unreachable blocks
+    QVector<BlockId> order = getReversePostorder(function);
+    QVector<bool> reachable(function->blocks.size(), false);
+
+    for ( BlockId b : order ) {
+        reachable[b] = true;
+    }
+
+    for ( BlockId b = 0; b < function->blocks.size(); ++b ) {
+        IrBlock & block = function->blocks[b];
+
+        if ( block.isDead || reachable.at(b) )
+            continue;
+
+        for ( BlockId successor : block.successors ) {
+            if ( successor != NoBlock )
+                removePredecessor(function, successor, b);
+        }
+
+        for ( ValueId id : block.values ) {
+            function->values[id].op = IrOp::Nop;
+            function->values[id].operands.clear();
+        }
+
+        block.values.clear();
+        block.terminator = IrTerminator::None;
+        block.isDead = true;
+        changed = true;
+    }
+
+    // Blocks which are only reached from the block before them
+    for ( BlockId b : order ) {
+        IrBlock & block = function->blocks[b];
+
+        if ( block.isDead )
+            continue;
+
+        while ( block.terminator == IrTerminator::Jump ) {
+            BlockId next = block.successors[0];
+            IrBlock & nextBlock = function->blocks[next];
+
+            if ( next == 0 || nextBlock.predecessors.size() != 1 )
+                break;
+
+            QVector<ValueId> values = nextBlock.values;
+
+            for ( ValueId id : values ) {
+                IrValue & value = function->values[id];
+
+                // With a single predecessor a phi is its only operand
+                if ( value.op == IrOp::Phi ) {
+                    makeCopy(value, value.operands.at(0));
+                }
+
+                value.block = b;
+                block.values.append(id);
+            }
+
+            block.terminator = nextBlock.terminator;
+            block.value = nextBlock.value;
+            block.successors[0] = nextBlock.successors[0];
+            block.successors[1] = nextBlock.successors[1];
+
+            for ( BlockId successor : block.successors ) {
+                if ( successor == NoBlock )
+                    continue;
+
+                QVector<BlockId> & predecessors = function->blocks[successor].predecessors;
+                predecessors[predecessors.indexOf(next)] = b;
+            }
+
+            nextBlock.values.clear();
+            nextBlock.predecessors.clear();
+            nextBlock.terminator = IrTerminator::None;
+            nextBlock.isDead = true;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+bool mayFail(const IrFunction * function, const IrValue & value) {
+    if ( value.type != DataType::Int32 )
+        return false;
+
+    const IrValue & divisor = function->values.at(value.operands.at(1));
+    return divisor.op != IrOp::Constant || divisor.intValue == 0 || divisor.intValue == -1;
+}
+
+bool eliminateDeadCode(IrFunction * function) {
+    QVector<bool> live(function->values.size(), false);
+    QVector<ValueId> work;
+
+    // Calls stay since they may not return and so do divisions which
+    // may fail
+    for ( const IrBlock & block : function->blocks ) {
+        if ( block.isDead )
+            continue;
+
+        if ( block.value != NoValue )
+            work.append(block.value);
+
+        for ( ValueId id : block.values ) {
+            const IrValue & value = function->values.at(id);
+
+            if ( value.op == IrOp::Call || value.op == IrOp::Parameter || ( value.op == IrOp::Div && mayFail(function, value) ) )
+                work.append(id);
+        }
+    }
+
+    while ( !work.isEmpty() ) {
+        ValueId id = work.takeLast();
+
+        if ( live.at(id) )
+            continue;
+
+        live[id] = true;
+
+        for ( ValueId operand : function->values.at(id).operands ) {
+            work.append(operand);
+        }
+    }
+
+    bool changed = false;
+
+    for ( ValueId id = 0; id < function->values.size(); ++id ) {
+        if ( !live.at(id) && isLive(function->values.at(id)) ) {
+            removeValue(function, id);
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+void optimizeIr(IrFunction * function) {
+    for ( int round = 0; round < MaxOptimizationRounds; ++round ) {
+        bool changed = false;
+
+        changed = foldConstants(function) || changed;
+        changed = propagateCopies(function) || changed;
+        changed = simplifyBranches(function) || changed;
+        changed = propagateCopies(function) || changed;
+        changed = eliminateCommonSubexpressions(function) || changed;
+        changed = eliminateDeadCode(function) || changed;
+
+        if ( !changed )
+            break;
+    }
+}
+
+///////////////////////////////////////////
+
+struct InliningData {
+    const IrProgram * program;
+
+    // Functions which are inlined at the moment, their calls stay
+    QList<Symbol> functions;
+
+    // Instructions the outermost function may still grow by
+    int budget;
+};
+
+BlockId appendBlock(IrFunction * function) {
+    IrBlock block;
+    block.terminator = IrTerminator::None;
+    block.value = NoValue;
+    block.successors[0] = NoBlock;
+    block.successors[1] = NoBlock;
+    block.isDead = false;
+
+    function->blocks.append(block);
+
+    return function->blocks.size() - 1;
+}
+
+// Moves the terminator of a block to another one
+void moveTerminator(IrFunction * function, BlockId from, BlockId to) {
+    IrBlock & source = function->blocks[from];
+    IrBlock & target = function->blocks[to];
+
+    target.terminator = source.terminator;
+    target.value = source.value;
+    target.successors[0] = source.successors[0];
+    target.successors[1] = source.successors[1];
+
+    for ( BlockId successor : target.successors ) {
+        if ( successor == NoBlock )
+            continue;
+
+        for ( BlockId & predecessor : function->blocks[successor].predecessors ) {
+            if ( predecessor == from )
+                predecessor = to;
+        }
+    }
+
+    source.terminator = IrTerminator::None;
+    source.value = NoValue;
+    source.successors[0] = NoBlock;
+    source.successors[1] = NoBlock;
+}
+
+void jump(IrFunction * function, BlockId from, BlockId to) {
+    IrBlock & block = function->blocks[from];
+    block.terminator = IrTerminator::Jump;
+    block.value = NoValue;
+    block.successors[0] = to;
+    block.successors[1] = NoBlock;
+
+    function->blocks[to].predecessors.append(from);
+}
+
+// Copies the callee behind the block of the call. The block ends with
+// a jump into the callee, its returns jump to the rest of the block and
+// the call becomes the phi of their values.
+void inlineCall(IrFunction * function, ValueId call, const IrFunction & callee) {
+    BlockId block = function->values.at(call).block;
+    BlockId rest = appendBlock(function);
+
+    QVector<ValueId> values = function->blocks.at(block).values;
+    int position = values.indexOf(call);
+
+    for ( int i = position; i < values.size(); ++i ) {
+        function->values[values.at(i)].block = rest;
+        function->blocks[rest].values.append(values.at(i));
+    }
+
+    function->blocks[block].values.resize(position);
+    moveTerminator(function, block, rest);
+
+    ValueId valueOffset = function->values.size();
+    BlockId blockOffset = function->blocks.size();
+    QVector<ValueId> arguments = function->values.at(call).operands;
+    quint32 line = function->values.at(call).line;
+
+    for ( IrValue value : callee.values ) {
+        for ( ValueId & operand : value.operands ) {
+            operand += valueOffset;
+        }
+
+        value.block += blockOffset;
+        value.line = line;
+
+        if ( value.op == IrOp::Parameter )
+            makeCopy(value, arguments.at(value.index));
+
+        function->values.append(value);
+    }
+
+    QVector<ValueId> results;
+
+    for ( IrBlock block : callee.blocks ) {
+        for ( ValueId & id : block.values ) {
+            id += valueOffset;
+        }
+
+        for ( BlockId & predecessor : block.predecessors ) {
+            predecessor += blockOffset;
+        }
+
+        for ( BlockId & successor : block.successors ) {
+            if ( successor != NoBlock )
+                successor += blockOffset;
+        }
+
+        if ( block.value != NoValue )
+            block.value += valueOffset;
+
+        function->blocks.append(block);
+
+        if ( block.terminator == IrTerminator::Return && !block.isDead ) {
+            results.append(block.value);
+            jump(function, function->blocks.size() - 1, rest);
+        }
+    }
+
+    jump(function, block, blockOffset);
+
+    IrValue & result = function->values[call];
+    result.op = IrOp::Phi;
+    result.function = NoSymbol;
+    result.operands = results;
+}
+
+bool inlineCalls(InliningData * data, IrFunction * function);
+
+// Callee as it would be inlined, false if it is too big
+bool prepareInlining(InliningData * data, Symbol symbol, IrFunction * callee) {
+    FunctionExpression * expr = data->program->function(symbol);
+
+    if ( !expr || data->functions.contains(symbol) || data->functions.size() > MaxInlineDepth )
+        return false;
+
+    if ( !buildFunctionIr(*data->program, expr, callee) )
+        return false;
+
+    data->functions.append(symbol);
+    inlineCalls(data, callee);
+    data->functions.removeLast();
+
+    optimizeIr(callee);
+
+    return callee->instructionCount() <= qMin(MaxInlineSize, data->budget);
+}
+
+bool inlineCalls(InliningData * data, IrFunction * function) {
+    bool changed = false;
+    int valueCount = function->values.size();
+
+    for ( ValueId id = 0; id < valueCount; ++id ) {
+        const IrValue & value = function->values.at(id);
+
+        if ( value.op != IrOp::Call )
+            continue;
+
+        IrFunction callee;
+
+        if ( !prepareInlining(data, value.function, &callee) )
+            continue;
+
+        inlineCall(function, id, callee);
+
+        data->budget -= callee.instructionCount();
+        changed = true;
+    }
+
+    return changed;
+}
+
+bool inlineCalls(const IrProgram & program, IrFunction * function) {
+    InliningData data;
+    data.program = &program;
+    data.budget = MaxInlineGrowth;
+
+    if ( function->symbol != NoSymbol )
+        data.functions.append(function->symbol);
+
+    return inlineCalls(&data, function);
+}
+
+///////////////////////////////////////////
+
+bool isSelfCall(const IrFunction * function, BlockId b, ValueId id) {
+    const IrBlock & block = function->blocks.at(b);
+    const IrValue & value = function->values.at(id);
+
+    return value.op == IrOp::Call && value.function == function->symbol &&
+           value.block == b && block.values.last() == id;
+}
+
+// Blocks which only pass a self call or a phi on to a block which
+// returns its single phi return that value themselves
+bool moveReturns(IrFunction * function) {
+    bool changed = false;
+
+    for ( BlockId b = 0; b < function->blocks.size(); ++b ) {
+        const IrBlock & block = function->blocks.at(b);
+
+        if ( block.isDead || block.terminator != IrTerminator::Return || block.values.size() != 1 ||
+             block.values.first() != block.value || function->values.at(block.value).op != IrOp::Phi ) {
+            continue;
+        }
+
+        QVector<BlockId> predecessors = block.predecessors;
+        QVector<ValueId> operands = function->values.at(block.value).operands;
+
+        for ( int i = 0; i < predecessors.size(); ++i ) {
+            BlockId predecessor = predecessors.at(i);
+            ValueId operand = operands.at(i);
+            const IrBlock & from = function->blocks.at(predecessor);
+
+            bool isPhi = function->values.at(operand).op == IrOp::Phi && from.values.size() == 1 &&
+                         from.values.first() == operand;
+
+            if ( !isPhi && !isSelfCall(function, predecessor, operand) )
+                continue;
+
+            removePredecessor(function, b, predecessor);
+
+            IrBlock & returning = function->blocks[predecessor];
+            returning.terminator = IrTerminator::Return;
+            returning.value = operand;
+            returning.successors[0] = NoBlock;
+
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+bool eliminateTailCalls(IrFunction * function) {
+    if ( function->symbol == NoSymbol )
+        return false;
+
+    bool changed = false;
+
+    while ( moveReturns(function) ) {
+        changed = true;
+    }
+
+    QList<ValueId> calls;
+
+    for ( BlockId b = 0; b < function->blocks.size(); ++b ) {
+        const IrBlock & block = function->blocks.at(b);
+
+        if ( !block.isDead && block.terminator == IrTerminator::Return && isSelfCall(function, b, block.value) )
+            calls.append(block.value);
+    }
+
+    if ( calls.isEmpty() )
+        return changed;
+
+    // Parameters stay in the entry block, everything else is the loop
+    BlockId loop = appendBlock(function);
+    QVector<ValueId> parameters(function->parameterTypes.size(), NoValue);
+    QVector<ValueId> entryValues = function->blocks.at(0).values;
+
+    function->blocks[0].values.clear();
+
+    for ( ValueId id : entryValues ) {
+        IrValue & value = function->values[id];
+
+        if ( value.op == IrOp::Parameter ) {
+            parameters[value.index] = id;
+            function->blocks[0].values.append(id);
+        }
+        else {
+            value.block = loop;
+            function->blocks[loop].values.append(id);
+        }
+    }
+
+    moveTerminator(function, 0, loop);
+    jump(function, 0, loop);
+
+    QVector<ValueId> phis;
+
+    for ( int i = 0; i < parameters.size(); ++i ) {
+        IrValue phi;
+        phi.op = IrOp::Phi;
+        phi.type = function->parameterTypes.at(i);
+        phi.intValue = 0;
+        phi.function = NoSymbol;
+        phi.block = loop;
+        phi.line = 0;
+
+        function->values.append(phi);
+        ValueId id = function->values.size() - 1;
+
+        replaceUses(function, parameters.at(i), id);
+        function->values[id].operands.append(parameters.at(i));
+
+        phis.append(id);
+    }
+
+    function->blocks[loop].values = phis + function->blocks.at(loop).values;
+
+    // The arguments of every tail call are the next parameters
+    for ( ValueId call : calls ) {
+        BlockId b = function->values.at(call).block;
+        QVector<ValueId> arguments = function->values.at(call).operands;
+
+        removeValue(function, call);
+        jump(function, b, loop);
+
+        for ( int i = 0; i < phis.size(); ++i ) {
+            function->values[phis.at(i)].operands.append(arguments.at(i));
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,38 @@
+#ifndef IRPASSES_H
+#define IRPASSES_H
+
+#include "ir.h"
+
+// Every pass returns true if it changed the function
+
+// Computes operations on constants and removes neutral operands
+bool foldConstants(IrFunction * function);
+
+// Uses the source of every copy directly
+bool propagateCopies(IrFunction * function);
+
+// Replaces a value by an equal one of a dominating block
+bool eliminateCommonSubexpressions(IrFunction * function);
+
+// Turns branches on constants into jumps, removes unreachable blocks
+// and merges blocks with a single predecessor
+bool simplifyBranches(IrFunction * function);
+
+// Removes values which nothing uses
+bool eliminateDeadCode(IrFunction * function);
+
+// Whether the division can fail at runtime, by 0 or INT_MIN by -1
+bool mayFail(const IrFunction * function, const IrValue & value);
+
+// Runs all passes until nothing changes anymore
+void optimizeIr(IrFunction * function);
+
+// Replaces calls of small functions by their body. Callees are inlined
+// up to a few levels deep, recursive calls are never inlined.
+bool inlineCalls(const IrProgram & program, IrFunction * function);
+
+// Turns calls of the function to itself whose result is returned into
+// jumps back to its start, the parameters become phis of the loop
+bool eliminateTailCalls(IrFunction * function);
+
+#endif // IRPASSES_H
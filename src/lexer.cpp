@@ -0,0 +1,218 @@
+#include "lexer.h"
+#include "profiler.h"
+
+// Adds the cycles until it goes out of scope to the counter, if there is one
+class ScanTimer
+{
+public:
+    explicit ScanTimer(quint64 * cycles) :
+        m_cycles(cycles),
+        m_start(cycles ? Profiler::cycles() : 0)
+    {
+    }
+
+    ~ScanTimer() {
+        if ( m_cycles )
+            *m_cycles += Profiler::cycles() - m_start;
+    }
+
+private:
+    quint64 * m_cycles;
+    quint64 m_start;
+};
+
+Lexer::Lexer() :
+    m_mapped(0),
+    m_position(0),
+    m_end(0),
+    m_linePosition(0),
+    m_line(1),
+    m_timed(false),
+    m_tokenCount(0),
+    m_scanCycles(0)
+{
+}
+
+Lexer::~Lexer()
+{
+    close();
+}
+
+bool Lexer::open(const QString & fileName)
+{
+    close();
+
+    m_file.setFileName(fileName);
+
+    if ( !m_file.open(QIODevice::ReadOnly) )
+        return false;
+
+    qint64 size = m_file.size();
+
+    if ( size == 0 ) {
+        setBuffer(0, 0);
+        return true;
+    }
+
+    m_mapped = m_file.map(0, size);
+
+    if ( m_mapped ) {
+        setBuffer(reinterpret_cast<const char *>(m_mapped), int(size));
+    }
+    else {
+        // Compressed resources can't be mapped
+        m_content = m_file.readAll();
+        setBuffer(m_content.constData(), m_content.size());
+    }
+
+    return true;
+}
+
+void Lexer::setBuffer(const char * data, int size)
+{
+    m_position = data;
+    m_end = data + size;
+    m_linePosition = data;
+    m_line = 1;
+    m_tokenCount = 0;
+    m_scanCycles = 0;
+}
+
+quint32 Lexer::line() const
+{
+    // Looking ahead only goes back a few characters
+    while ( m_linePosition > m_position ) {
+        if ( *--m_linePosition == '\n' )
+            --m_line;
+    }
+
+    for ( ; m_linePosition < m_position; ++m_linePosition ) {
+        if ( *m_linePosition == '\n' )
+            ++m_line;
+    }
+
+    return m_line;
+}
+
+void Lexer::close()
+{
+    if ( m_mapped ) {
+        m_file.unmap(m_mapped);
+        m_mapped = 0;
+    }
+
+    if ( m_file.isOpen() ) {
+        m_file.close();
+    }
+
+    m_content.clear();
+    setBuffer(0, 0);
+}
+
+QLatin1String Lexer::scanIdentifier()
+{
+    ScanTimer timer(m_timed ? &m_scanCycles : 0);
+    ++m_tokenCount;
+
+    const char * start = m_position;
+
+    if ( isIdentifierStart(current()) ) {
+        while ( isIdentifierPart(current()) ) {
+            ++m_position;
+        }
+    }
+
+    return QLatin1String(start, int(m_position - start));
+}
+
+QLatin1String Lexer::scanPath()
+{
+    ScanTimer timer(m_timed ? &m_scanCycles : 0);
+    ++m_tokenCount;
+
+    const char * start = m_position;
+
+    while ( isIdentifierPart(current()) || current() == '.' ) {
+        ++m_position;
+    }
+
+    return QLatin1String(start, int(m_position - start));
+}
+
+QLatin1String Lexer::scanNumber()
+{
+    ScanTimer timer(m_timed ? &m_scanCycles : 0);
+    ++m_tokenCount;
+
+    const char * start = m_position;
+    bool hasDot = false;
+
+    while ( isDigit(current()) || ( !hasDot && current() == '.' ) ) {
+        hasDot = hasDot || current() == '.';
+        ++m_position;
+    }
+
+    return QLatin1String(start, int(m_position - start));
+}
+
+QLatin1String Lexer::scanString()
+{
+    ScanTimer timer(m_timed ? &m_scanCycles : 0);
+    ++m_tokenCount;
+
+    // Opening "
+    advance();
+
+    const char * start = m_position;
+
+    while ( !atEnd() && current() != '"' ) {
+        ++m_position;
+    }
+
+    QLatin1String content(start, int(m_position - start));
+
+    // Closing "
+    advance();
+
+    return content;
+}
+
+bool Lexer::skipSpace(uint * indentation)
+{
+    ScanTimer timer(m_timed ? &m_scanCycles : 0);
+
+    bool hasSpace = isSpace(current());
+
+    if ( hasSpace && indentation ) {
+        *indentation = 0;
+    }
+
+    while ( isSpace(current()) ) {
+
+        if ( indentation ) {
+            // Only the spaces of the last line count as indentation
+            if ( isReturn(current()) )
+                *indentation = 0;
+            else
+                (*indentation)++;
+        }
+
+        ++m_position;
+    }
+
+    return hasSpace;
+}
+
+void Lexer::skipInlineSpace()
+{
+    while ( current() == ' ' || current() == '\t' ) {
+        ++m_position;
+    }
+}
+
+void Lexer::skipLine()
+{
+    while ( !atEnd() && !isReturn(current()) ) {
+        ++m_position;
+    }
+}
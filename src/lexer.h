@@ -0,0 +1,103 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QLatin1String>
+#include <QtCore/qglobal.h>
+
+///////////////////////////////////////////
+///
+/// Reads the source directly from a memory mapped file or a borrowed
+/// buffer. Tokens are returned as views into that buffer, nothing is
+/// copied or decoded until an expression needs to own the text.
+///
+
+class Lexer
+{
+public:
+    Lexer();
+    ~Lexer();
+
+    // Maps the file, falls back to reading it if it can't be mapped
+    bool open(const QString & fileName);
+
+    // The buffer must stay alive as long as the lexer and its tokens
+    void setBuffer(const char * data, int size);
+
+    // Characters
+    char current() const { return m_position < m_end ? *m_position : '\0'; }
+    char peek(int offset = 1) const {
+        return m_position + offset < m_end ? m_position[offset] : '\0';
+    }
+
+    void advance() {
+        if ( m_position < m_end )
+            ++m_position;
+    }
+
+    bool atEnd() const { return m_position >= m_end; }
+    const char * end() const { return m_end; }
+
+    // Position for going back after looking ahead
+    const char * position() const { return m_position; }
+    void setPosition(const char * position) { m_position = position; }
+
+    // Line of the current position, the first one is 1
+    quint32 line() const;
+
+    // Tokens
+    QLatin1String scanIdentifier();
+    QLatin1String scanPath();
+    QLatin1String scanNumber();
+    QLatin1String scanString();
+
+    // Skips all white space and returns false if there was none. If the
+    // indentation is given it is set to the number of spaces after the
+    // last line break.
+    bool skipSpace(uint * indentation = 0);
+    void skipInlineSpace();
+    void skipLine();
+
+    // Character classes
+    static bool isSpace(char c) { return c == ' ' || c == '\t' || isReturn(c); }
+    static bool isReturn(char c) { return c == '\r' || c == '\n'; }
+    static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+    // Bytes of multibyte UTF-8 characters count as letters
+    static bool isLetter(char c) {
+        return ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) || ( c & 0x80 );
+    }
+
+    static bool isIdentifierStart(char c) { return isLetter(c) || c == '_'; }
+    static bool isIdentifierPart(char c) { return isIdentifierStart(c) || isDigit(c); }
+    static bool isNumberStart(char c) { return isDigit(c) || c == '.'; }
+
+    // Scanned tokens since the buffer was set, while the lexer is timed
+    // the cycles of the scanners are counted as well, see Profiler::cycles()
+    void setTimed(bool timed) { m_timed = timed; }
+    int tokenCount() const { return m_tokenCount; }
+    quint64 scanCycles() const { return m_scanCycles; }
+
+private:
+    Q_DISABLE_COPY(Lexer)
+
+    void close();
+
+    QFile m_file;
+    uchar * m_mapped;
+    QByteArray m_content;
+
+    const char * m_position;
+    const char * m_end;
+
+    // Lines are counted from the last asked position on
+    mutable const char * m_linePosition;
+    mutable quint32 m_line;
+
+    bool m_timed;
+    int m_tokenCount;
+    quint64 m_scanCycles;
+};
+
+#endif // LEXER_H
@@ -1,7 +1,9 @@
 #include <QCoreApplication>
+#include <QFile>
+#include <QStandardPaths>
 
 #include "virtualmachine.h"
-#include "parser.h"
+#include "project.h"
 #include "compiler.h"
 
 int main(int argc, char* argv[]) {
@@ -9,10 +11,95 @@ int main(int argc, char* argv[]) {
 
     VirtualMachine machine;
 
-    Parser parser(":/examples/ex_01.hound");
-    QList< QSharedPointer<Expression> > expressions = parser.parse();
+    // Private to the user, cached code is run without checking it again.
+    // Empty if there is no cache location, which turns caching off.
+    QString cacheDirectory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
 
-    VmCompiler comp;
+    Project project;
+    project.setCacheDirectory(cacheDirectory);
+
+    if ( !project.load(":/examples/ex_01.hound") ) {
+        return 1;
+    }
+
+    QStringList arguments = app.arguments();
+
+    // Compiled code shows up in "perf report" with its name, or with
+    // source lines after "perf inject --jit"
+    int perfOutput = 0;
+
+    if ( arguments.contains("--perf-map") )
+        perfOutput |= PerfMap::PerfMapFile;
+    if ( arguments.contains("--jitdump") )
+        perfOutput |= PerfMap::JitDumpFile;
+
+    machine.codeHeap()->setPerfOutput(perfOutput);
+
+    // Everything compiled before it runs
+    if ( arguments.contains("--jit") ) {
+        VmCompiler comp(&machine);
+        comp.setCodeCacheDirectory(cacheDirectory);
+
+        if ( !comp.compile(project.expressions()) ) {
+            return 1;
+        }
+
+        qDebug() << "Result: " << comp.execute();
+
+        return 0;
+    }
+
+    // Cold scripts run without paying for the compiler
+    if ( arguments.contains("--interpret") ) {
+        machine.setTierUpThreshold(-1);
+    }
+    else if ( arguments.contains("--tier-up") ) {
+        machine.setTierUpThreshold(arguments.value(arguments.indexOf("--tier-up") + 1).toInt());
+    }
+
+    machine.setCodeCacheDirectory(cacheDirectory);
+
+    if ( !machine.load(project.expressions()) ) {
+        return 1;
+    }
+
+    // Counters and samples as JSON, or the sampled stacks for flame graphs
+    QString profileFile = arguments.value(arguments.indexOf("--profile") + 1);
+    QString stacksFile = arguments.value(arguments.indexOf("--profile-stacks") + 1);
+
+    if ( arguments.contains("--profile") || arguments.contains("--profile-stacks") ) {
+        machine.setProfilingMode(Profiler::Counting | Profiler::Sampling);
+    }
+
+    qDebug() << "Result: " << machine.execute();
+
+    machine.setProfilingMode(0);
+
+    if ( arguments.contains("--profile") ) {
+        QFile file(profileFile);
+
+        if ( !file.open(QIODevice::WriteOnly) || file.write(machine.profiler()->toJson()) < 0 )
+            qDebug() << "Could not write profile " << profileFile;
+    }
+
+    if ( arguments.contains("--profile-stacks") ) {
+        QFile file(stacksFile);
+
+        if ( !file.open(QIODevice::WriteOnly) || file.write(machine.profiler()->toCollapsedStacks()) < 0 )
+            qDebug() << "Could not write profile " << stacksFile;
+    }
+
+    machine.waitForCompiler();
+
+    CompilerStatistics compiler = machine.compilerStatistics();
+    qDebug() << "Compiled " << compiler.compiledFunctions << " functions, "
+             << compiler.failedFunctions << " failed, latency up to "
+             << compiler.maxLatency / 1000 << " us, "
+             << compiler.deoptimizations << " deoptimizations";
+
+    CodeHeap::Statistics heap = machine.codeHeap()->statistics();
+    qDebug() << "Code heap: " << heap.usedBytes << " of " << heap.reservedBytes << " bytes used in "
+             << heap.functionCount << " functions";
 
     return 0;
 }
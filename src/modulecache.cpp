@@ -0,0 +1,323 @@
+#include "modulecache.h"
+#include "cachedirectory.h"
+#include "flattree.h"
+#include "version.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QSaveFile>
+
+#include <string.h>
+
+// Has to change with every change of the layout below or of FlatNode
+static const quint32 CacheFormatVersion = 2;
+
+struct CacheHeader {
+    char magic[4];
+    quint32 formatVersion;
+    quint32 keySize;
+    quint32 nodeCount;
+    quint32 operandCount;
+    quint32 rootCount;
+    quint32 floatCount;
+    quint32 stringCount;
+    quint32 symbolCount;
+};
+
+// After the header:
+// - key
+// - nodes, their symbols are indices into the symbol texts
+// - operands, roots, floats
+// - symbol texts and strings, each one as size and UTF-8 data
+
+///////////////////////////////////////////
+
+class CacheReader
+{
+public:
+    CacheReader(const uchar * data, qint64 size) :
+        m_position(data),
+        m_end(data + size)
+    {
+    }
+
+    bool read(void * destination, qint64 size) {
+        if ( size < 0 || m_end - m_position < size )
+            return false;
+
+        memcpy(destination, m_position, size_t(size));
+        m_position += size;
+
+        return true;
+    }
+
+    bool readText(QByteArray & text) {
+        quint32 size;
+
+        if ( !read(&size, sizeof(size)) || m_end - m_position < qint64(size) )
+            return false;
+
+        text = QByteArray(reinterpret_cast<const char *>(m_position), int(size));
+        m_position += size;
+
+        return true;
+    }
+
+private:
+    const uchar * m_position;
+    const uchar * m_end;
+};
+
+void appendRaw(QByteArray & buffer, const void * data, qint64 size) {
+    buffer.append(static_cast<const char *>(data), int(size));
+}
+
+void appendText(QByteArray & buffer, const QByteArray & text) {
+    quint32 size = quint32(text.size());
+    appendRaw(buffer, &size, sizeof(size));
+    buffer.append(text);
+}
+
+// Number of operands every node type needs, -1 for any
+int expectedOperandCount(ExpressionType type) {
+    switch ( type )
+    {
+    case ExpressionType::BinaryExpr:
+    case ExpressionType::If:
+        return 2;
+
+    case ExpressionType::Else:
+        return 1;
+
+    case ExpressionType::FunctionExpressionType:
+    case ExpressionType::FunctionInvokation:
+    case ExpressionType::CodeBlock:
+        return -1;
+
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+// Operands are stored before their nodes and none of them may be missing.
+// Those the tree casts to a certain expression have to be one.
+bool isValidOperand(const FlatTree & flat, const FlatNode & node, NodeIndex index, int i) {
+    NodeIndex operand = flat.operand(node, i);
+
+    if ( operand == NoNode || operand >= index )
+        return false;
+
+    const FlatNode & operandNode = flat.node(operand);
+
+    switch ( node.type )
+    {
+    case ExpressionType::If:
+        return i != 0 || operandNode.is(ExpressionType::BinaryExpr);
+
+    case ExpressionType::FunctionExpressionType:
+        return i == 0 || operandNode.is(ExpressionType::Variable);
+
+    default:
+        break;
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////
+
+ModuleCache::ModuleCache(const QString & directory) :
+    m_directory(directory)
+{
+}
+
+QByteArray ModuleCache::sourceKey(const QByteArray & source)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+
+    hash.addData(HOUND_VERSION);
+    hash.addData(reinterpret_cast<const char *>(&CacheFormatVersion), sizeof(CacheFormatVersion));
+    hash.addData(source);
+
+    return hash.result();
+}
+
+QString ModuleCache::fileName(const QByteArray & key) const
+{
+    return QDir(m_directory).filePath(QString::fromLatin1(key.toHex()) + ".houndc");
+}
+
+QSharedPointer<SyntaxTree> ModuleCache::load(const QByteArray & key) const
+{
+    QFile file(fileName(key));
+
+    if ( !file.open(QIODevice::ReadOnly) )
+        return QSharedPointer<SyntaxTree>();
+
+    if ( !isPrivateCacheFile(file, m_directory) )
+        return QSharedPointer<SyntaxTree>();
+
+    qint64 size = file.size();
+    uchar * mapped = file.map(0, size);
+
+    if ( !mapped )
+        return QSharedPointer<SyntaxTree>();
+
+    // Everything is copied out, the file isn't needed after loading
+    QSharedPointer<SyntaxTree> tree;
+
+    CacheReader reader(mapped, size);
+    CacheHeader header;
+    QByteArray storedKey;
+
+    if ( reader.read(&header, sizeof(header)) &&
+         memcmp(header.magic, "HNDC", 4) == 0 &&
+         header.formatVersion == CacheFormatVersion &&
+         header.keySize == quint32(key.size()) &&
+         qint64(sizeof(FlatNode)) * header.nodeCount +
+         qint64(sizeof(quint32)) * ( qint64(header.operandCount) + header.rootCount + header.floatCount ) <= size ) {
+
+        storedKey.resize(int(header.keySize));
+
+        FlatTree flat;
+        flat.m_nodes.resize(int(header.nodeCount));
+        flat.m_operands.resize(int(header.operandCount));
+        flat.m_roots.resize(int(header.rootCount));
+        flat.m_floats.resize(int(header.floatCount));
+
+        bool valid =
+            reader.read(storedKey.data(), header.keySize) && storedKey == key &&
+            reader.read(flat.m_nodes.data(), qint64(sizeof(FlatNode)) * header.nodeCount) &&
+            reader.read(flat.m_operands.data(), qint64(sizeof(NodeIndex)) * header.operandCount) &&
+            reader.read(flat.m_roots.data(), qint64(sizeof(NodeIndex)) * header.rootCount) &&
+            reader.read(flat.m_floats.data(), qint64(sizeof(float)) * header.floatCount);
+
+        // Symbols of this process for the symbols of the file
+        QVector<Symbol> symbols;
+        symbols.append(NoSymbol);
+
+        for ( quint32 i = 0; valid && i < header.symbolCount; ++i ) {
+            QByteArray text;
+            valid = reader.readText(text);
+            symbols.append(SymbolTable::global().intern(QLatin1String(text.constData(), text.size())));
+        }
+
+        for ( quint32 i = 0; valid && i < header.stringCount; ++i ) {
+            QByteArray text;
+            valid = reader.readText(text);
+            flat.m_strings.append(QString::fromUtf8(text));
+        }
+
+        // A broken file must not lead to a broken tree
+        for ( int i = 0; valid && i < flat.m_nodes.size(); ++i ) {
+            FlatNode & node = flat.m_nodes[i];
+            int expectedOperands = expectedOperandCount(node.expressionType());
+
+            valid = node.type <= ExpressionType::BinaryExpr &&
+                    node.dataType <= DataType::StringType &&
+                    node.op <= LanguageOperator::PowerOfOperator &&
+                    node.symbol < quint32(symbols.size()) &&
+                    quint64(node.firstOperand) + node.operandCount <= header.operandCount &&
+                    ( expectedOperands < 0 || node.operandCount == quint32(expectedOperands) ) &&
+                    ( node.type != ExpressionType::FunctionExpressionType || node.operandCount > 0 );
+
+            if ( valid && node.type == ExpressionType::RawData ) {
+                if ( node.dataType == DataType::Float )
+                    valid = node.value < header.floatCount;
+                else if ( node.dataType != DataType::Int32 )
+                    valid = node.value < header.stringCount;
+            }
+
+            for ( quint32 k = 0; valid && k < node.operandCount; ++k ) {
+                valid = isValidOperand(flat, node, NodeIndex(i), int(k));
+            }
+
+            node.symbol = symbols.value(int(node.symbol));
+        }
+
+        for ( int i = 0; valid && i < flat.m_roots.size(); ++i ) {
+            valid = flat.m_roots.at(i) < NodeIndex(flat.m_nodes.size());
+        }
+
+        if ( valid ) {
+            tree = flat.toSyntaxTree();
+        }
+        else {
+            qDebug() << "Ignoring broken cache file: " << file.fileName();
+        }
+    }
+
+    file.unmap(mapped);
+
+    return tree;
+}
+
+bool ModuleCache::store(const QByteArray & key, const FlatTree & tree) const
+{
+    if ( !createCacheDirectory(m_directory) )
+        return false;
+
+    // Symbols are stored as text, their ids only exist in this process
+    QHash<Symbol, quint32> localSymbols;
+    QList<QByteArray> symbolTexts;
+    QVector<FlatNode> nodes = tree.m_nodes;
+
+    for ( FlatNode & node : nodes ) {
+        if ( node.symbol == NoSymbol )
+            continue;
+
+        quint32 local = localSymbols.value(node.symbol, 0);
+
+        if ( local == 0 ) {
+            symbolTexts.append(SymbolTable::global().text(node.symbol));
+            local = quint32(symbolTexts.size());
+            localSymbols.insert(node.symbol, local);
+        }
+
+        node.symbol = local;
+    }
+
+    CacheHeader header;
+    memcpy(header.magic, "HNDC", 4);
+    header.formatVersion = CacheFormatVersion;
+    header.keySize = quint32(key.size());
+    header.nodeCount = quint32(nodes.size());
+    header.operandCount = quint32(tree.m_operands.size());
+    header.rootCount = quint32(tree.m_roots.size());
+    header.floatCount = quint32(tree.m_floats.size());
+    header.stringCount = quint32(tree.m_strings.size());
+    header.symbolCount = quint32(symbolTexts.size());
+
+    QByteArray buffer;
+    appendRaw(buffer, &header, sizeof(header));
+    buffer.append(key);
+    appendRaw(buffer, nodes.constData(), qint64(sizeof(FlatNode)) * nodes.size());
+    appendRaw(buffer, tree.m_operands.constData(), qint64(sizeof(NodeIndex)) * tree.m_operands.size());
+    appendRaw(buffer, tree.m_roots.constData(), qint64(sizeof(NodeIndex)) * tree.m_roots.size());
+    appendRaw(buffer, tree.m_floats.constData(), qint64(sizeof(float)) * tree.m_floats.size());
+
+    for ( const QByteArray & text : symbolTexts ) {
+        appendText(buffer, text);
+    }
+
+    for ( const QString & string : tree.m_strings ) {
+        appendText(buffer, string.toUtf8());
+    }
+
+    // Readers never see a half written file
+    QSaveFile file(fileName(key));
+
+    if ( !file.open(QIODevice::WriteOnly) )
+        return false;
+
+    if ( !restrictCacheFile(file) || file.write(buffer) != buffer.size() ) {
+        file.cancelWriting();
+        return false;
+    }
+
+    return file.commit();
+}
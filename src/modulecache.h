@@ -0,0 +1,42 @@
+#ifndef MODULECACHE_H
+#define MODULECACHE_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QString>
+#include <QtCore/qglobal.h>
+
+#include "expression.h"
+
+class FlatTree;
+
+///////////////////////////////////////////
+///
+/// Precompiled modules (.houndc). A module is stored as its flat tree
+/// under a key made of the source and the compiler version, so a
+/// changed source or compiler never sees an old entry. The files are
+/// written in native byte order and are only meant for the machine
+/// which wrote them.
+///
+
+class ModuleCache
+{
+public:
+    explicit ModuleCache(const QString & directory);
+
+    QString directory() const { return m_directory; }
+
+    static QByteArray sourceKey(const QByteArray & source);
+
+    // Returns a null pointer if there is no valid entry
+    QSharedPointer<SyntaxTree> load(const QByteArray & key) const;
+
+    bool store(const QByteArray & key, const FlatTree & tree) const;
+
+private:
+    QString fileName(const QByteArray & key) const;
+
+    QString m_directory;
+};
+
+#endif // MODULECACHE_H
@@ -0,0 +1,116 @@
+#include "operators.h"
+
+#include <string.h>
+
+// Word operators, the first character is already checked
+static LanguageOperator matchWordOperator(const char * position, int available,
+                                          const char * word, int wordLength,
+                                          LanguageOperator op, int * length) {
+    if ( available < wordLength || memcmp(position, word, wordLength) != 0 )
+        return LanguageOperator::UnknownOperator;
+
+    *length = wordLength;
+    return op;
+}
+
+LanguageOperator matchOperator(const char * position, const char * end, int * length) {
+    int available = int(end - position);
+
+    *length = 0;
+
+    if ( available <= 0 )
+        return LanguageOperator::UnknownOperator;
+
+    // The operator set is fixed, so the trie is just this switch
+    switch ( position[0] )
+    {
+    case '<':
+        *length = 1;
+        return LanguageOperator::LessOperator;
+
+    case '>':
+        *length = 1;
+        return LanguageOperator::GreaterOperator;
+
+    case '+':
+        *length = 1;
+        return LanguageOperator::PlusOperator;
+
+    case '-':
+        *length = 1;
+        return LanguageOperator::MinusOperator;
+
+    case '/':
+        *length = 1;
+        return LanguageOperator::DivideOperator;
+
+    case '*':
+        if ( available > 1 && position[1] == '*' ) {
+            *length = 2;
+            return LanguageOperator::PowerOfOperator;
+        }
+
+        *length = 1;
+        return LanguageOperator::MultiplyOperator;
+
+    case 'a':
+        return matchWordOperator(position, available, "and", 3, LanguageOperator::AndOperator, length);
+
+    case 'i':
+        return matchWordOperator(position, available, "in", 2, LanguageOperator::InOperator, length);
+
+    case 'n':
+        return matchWordOperator(position, available, "not", 3, LanguageOperator::NotOperator, length);
+
+    case 'o':
+        return matchWordOperator(position, available, "or", 2, LanguageOperator::OrOperator, length);
+
+    case 'x':
+        return matchWordOperator(position, available, "xor", 3, LanguageOperator::XorOperator, length);
+
+    default:
+        break;
+    }
+
+    return LanguageOperator::UnknownOperator;
+}
+
+uint operatorPriority(LanguageOperator op) {
+
+    // Higher binds stronger
+    switch ( op )
+    {
+    case LanguageOperator::OrOperator:
+        return 1;
+
+    case LanguageOperator::XorOperator:
+        return 2;
+
+    case LanguageOperator::AndOperator:
+        return 3;
+
+    case LanguageOperator::NotOperator:
+        return 4;
+
+    case LanguageOperator::InOperator:
+    case LanguageOperator::LessOperator:
+    case LanguageOperator::GreaterOperator:
+        return 5;
+
+    case LanguageOperator::PlusOperator:
+    case LanguageOperator::MinusOperator:
+        return 6;
+
+    case LanguageOperator::MultiplyOperator:
+    case LanguageOperator::DivideOperator:
+        return 7;
+
+    case LanguageOperator::PowerOfOperator:
+        return 8;
+
+    default:
+        break;
+    }
+
+    return 0;
+}
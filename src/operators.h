@@ -1,6 +1,8 @@
 #ifndef OPERATORS
 #define OPERATORS
 
+#include <QtCore/qglobal.h>
+
 enum LanguageOperator {
     UnknownOperator = 0,
 
@@ -25,5 +27,10 @@ enum LanguageOperator {
     PowerOfOperator,
 };
 
+// Longest operator at the start of the range, length is 0 if there is none
+LanguageOperator matchOperator(const char * position, const char * end, int * length);
+
+uint operatorPriority(LanguageOperator op);
+
 #endif // OPERATORS
 
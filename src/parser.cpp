@@ -1,207 +1,223 @@
 #include "parser.h"
+#include "compilestats.h"
 #include "operators.h"
+#include "profiler.h"
+#include "trace.h"
+
+#include <QtCore/QFileInfo>
+#include <QtCore/QVarLengthArray>
+#include <QtCore/QVector>
+
+#include <limits.h>
+#include <string.h>
 
 
 Parser::Parser(const QString fileName, QObject *parent) : QObject(parent),
-    m_fileName(fileName)
+    m_fileName(fileName),
+    m_parseNanoseconds(0),
+    m_parseCycles(0)
 {
 }
 
-bool isReturnCharacter(QChar c) {
-    return c == '\r' || c == '\n';
+Parser::~Parser()
+{
+    finish();
 }
 
-bool isVariableConform(QChar c, const QString & identifier) {
-    if ( identifier.isEmpty() )
-        return c.isLetter() || c == '_';
-    else
-        return c.isLetterOrNumber() || c == '_';
+void Parser::setSource(const QByteArray & source)
+{
+    m_source = source;
 }
 
-bool isNumberConform(QChar c, const QString & identifier) {
-    if ( identifier.isEmpty() )
-        return c.isNumber() || c == '.';
-    else
-        return c.isNumber() || ( !identifier.contains(".") && c == '.' );
+QByteArray tokenKey(QLatin1String token) {
+    // Only wraps the token, nothing is copied
+    return QByteArray::fromRawData(token.data(), token.size());
 }
 
-bool consumeSpace(QTextStream & stream, ParsingData * data, bool updateIndetention = false) {
+QString tokenText(QLatin1String token) {
+    return QString::fromUtf8(token.data(), token.size());
+}
 
-    bool hasSpace = data->lastChar.isSpace();
+Symbol tokenSymbol(QLatin1String token) {
+    return SymbolTable::global().intern(token);
+}
 
-    if ( hasSpace && updateIndetention ) {
-        data->previousIndent = data->currentIndent;
-        data->currentIndent = 0;
-    }
+// Reserved keywords, everything else is an identifier
+ExpressionType matchKeyword(QLatin1String token) {
+    const char * text = token.data();
+
+    switch ( token.size() )
+    {
+    case 2:
+        if ( memcmp(text, "fn", 2) == 0 )
+            return ExpressionType::FunctionExpressionType;
+        if ( memcmp(text, "if", 2) == 0 )
+            return ExpressionType::If;
+        break;
+
+    case 4:
+        if ( memcmp(text, "elif", 4) == 0 )
+            return ExpressionType::ElIf;
+        if ( memcmp(text, "else", 4) == 0 )
+            return ExpressionType::Else;
+        break;
+
+    case 6:
+        if ( memcmp(text, "import", 6) == 0 )
+            return ExpressionType::Import;
+        break;
+
+    case 7:
+        if ( memcmp(text, "package", 7) == 0 )
+            return ExpressionType::Package;
+        break;
+
+    default:
+        break;
+    }
+
+    return ExpressionType::UnknownExpression;
+}
 
-    while ( data->lastChar.isSpace() ) {
+bool consumeSpace(Lexer & lexer, ParsingData * data, bool updateIndetention = false) {
 
-        if ( updateIndetention ) {
-            data->currentIndent++;
-        }
+    if ( !updateIndetention ) {
+        return lexer.skipSpace();
+    }
 
-        stream >> data->lastChar;
+    if ( Lexer::isSpace(lexer.current()) ) {
+        data->previousIndent = data->currentIndent;
     }
 
-    return hasSpace;
+    return lexer.skipSpace(&data->currentIndent);
 }
 
 bool hasNewBlock(ParsingData * data) {
     return data->currentIndent > data->previousIndent;
 }
 
-void consumeIndetention(QTextStream & stream, ParsingData * data) {
+void consumeIndetention(Lexer & lexer, ParsingData * data) {
 
-    while ( isReturnCharacter(data->lastChar) ) {
-        consumeSpace(stream, data, true);
+    if ( Lexer::isReturn(lexer.current()) ) {
+        consumeSpace(lexer, data, true);
     }
 }
 
-bool isInValidExpr(QSharedPointer<Expression> expr) {
-    return expr.isNull() || expr->isUnknown();
+bool isInValidExpr(Expression * expr) {
+    return !expr || expr->isUnknown();
 }
 
-QSharedPointer<Expression> getEmptyExpr() {
-    return QSharedPointer<Expression>::create();
-}
-
-QSharedPointer<Expression> parseCommentExpr(QTextStream & stream, ParsingData * data) {
-    QSharedPointer<Expression> expr = QSharedPointer<CommentExpression>::create();
-
-    while ( !isReturnCharacter(data->lastChar) && !stream.atEnd() ) {
-        stream >> data->lastChar;
-    }
-
+// Expression which starts at the current position
+template<typename T>
+T * createExpr(Lexer & lexer, ParsingData * data) {
+    T * expr = data->arena->create<T>();
+    expr->setLine(lexer.line());
     return expr;
 }
 
-QSharedPointer<Expression> parsePackageExpr(QTextStream & stream, ParsingData * data) {
-    QSharedPointer<Expression> expr = QSharedPointer<PackageExpression>::create();
-
-    if ( !consumeSpace(stream, data) ) {
-        qDebug() << "No space between package and path";
-    }
+Expression * getEmptyExpr(ParsingData * data) {
+    return data->arena->create<Expression>();
+}
 
-    data->identifier.clear();
+ExpressionList createList(ParsingData * data, const QVarLengthArray<Expression *, 8> & expressions) {
+    return data->arena->createList(expressions.constData(), expressions.size());
+}
 
-    do {
-        data->identifier += data->lastChar;
-        stream >> data->lastChar;
-    }
-    while ( data->lastChar.isLetterOrNumber() || data->lastChar == '.' );
+Expression * parseCommentExpr(Lexer & lexer, ParsingData * data) {
+    Expression * expr = createExpr<CommentExpression>(lexer, data);
 
-    expr.dynamicCast<PackageExpression>()->setPath(data->identifier);
+    lexer.skipLine();
 
     return expr;
 }
 
-QSharedPointer<Expression> parseImportExpr(QTextStream & stream, ParsingData * data) {
-    QSharedPointer<Expression> expr = QSharedPointer<ImportExpression>::create();
+Expression * parsePackageExpr(Lexer & lexer, ParsingData * data) {
+    PackageExpression * expr = createExpr<PackageExpression>(lexer, data);
 
-    if ( !consumeSpace(stream, data) ) {
-        qDebug() << "No space between import and path";
+    if ( !consumeSpace(lexer, data) ) {
+        qDebug() << "No space between package and path";
     }
 
-    data->identifier.clear();
+    data->identifier = lexer.scanPath();
 
-    do {
-        data->identifier += data->lastChar;
-        stream >> data->lastChar;
-    }
-    while ( data->lastChar.isLetterOrNumber() || data->lastChar == '.' );
-
-    expr.dynamicCast<ImportExpression>()->setPath(data->identifier);
+    expr->setPath(tokenSymbol(data->identifier));
 
     return expr;
 }
 
-QSharedPointer<Expression> parseVariableExpr(QTextStream & stream, ParsingData * data) {
-    QSharedPointer<VariableExpression> expr = QSharedPointer<VariableExpression>::create();
-
-    data->identifier.clear();
+Expression * parseImportExpr(Lexer & lexer, ParsingData * data) {
+    ImportExpression * expr = createExpr<ImportExpression>(lexer, data);
 
-    // Read identifier
-    while ( isVariableConform( data->lastChar, data->identifier ) ) {
-        data->identifier += data->lastChar;
-        stream >> data->lastChar;
+    if ( !consumeSpace(lexer, data) ) {
+        qDebug() << "No space between import and path";
     }
 
-    if ( data->identifier.isEmpty() )
-        return QSharedPointer<Expression>::create();
+    data->identifier = lexer.scanPath();
 
-    expr->setName(data->identifier);
+    expr->setPath(tokenSymbol(data->identifier));
 
     return expr;
 }
 
-QSharedPointer<Expression> parseStringExpr(QTextStream & stream, ParsingData * data) {
-    QSharedPointer<RawDataExpression> expr = QSharedPointer<RawDataExpression>::create();
+Expression * parseStringExpr(Lexer & lexer, ParsingData * data) {
+    RawDataExpression * expr = createExpr<RawDataExpression>(lexer, data);
 
-    QString stringData;
-
-    stream >> data->lastChar;
-
-    while ( data->lastChar != '"' ) {
-        stringData += data->lastChar;
-        stream >> data->lastChar;
-    }
-
-    // Consume next after "
-    stream >> data->lastChar;
+    QLatin1String stringData = lexer.scanString();
 
     expr->setDataType(DataType::StringType);
-    expr->setData(stringData);
+    expr->setData(tokenText(stringData));
 
     return expr;
 }
 
-QSharedPointer<Expression> parseNumberExpr(QTextStream & stream, ParsingData * data) {
-    QSharedPointer<RawDataExpression> expr = QSharedPointer<RawDataExpression>::create();
+Expression * parseNumberExpr(Lexer & lexer, ParsingData * data) {
+    RawDataExpression * expr = createExpr<RawDataExpression>(lexer, data);
 
-    data->identifier.clear();
+    data->identifier = lexer.scanNumber();
 
-    data->identifier += data->lastChar;
-    stream >> data->lastChar;
+    const char * digits = data->identifier.data();
+    int size = data->identifier.size();
 
-    while ( isNumberConform(data->lastChar, data->identifier) ) {
-        data->identifier += data->lastChar;
-        stream >> data->lastChar;
-    }
-
-    if ( data->identifier.contains(".") ) {
+    if ( memchr(digits, '.', size) ) {
         expr->setDataType(DataType::Float);
-        expr->setData(data->identifier.toFloat());
+        expr->setData(tokenKey(data->identifier).toFloat());
     }
     else {
+        qint64 value = 0;
+
+        for ( int i = 0; i < size; ++i ) {
+            value = value * 10 + ( digits[i] - '0' );
+
+            if ( value > INT_MAX ) {
+                qDebug() << "Integer literal is too large: " << tokenText(data->identifier);
+                return getEmptyExpr(data);
+            }
+        }
+
         expr->setDataType(DataType::Int32);
-        expr->setData(data->identifier.toInt());
+        expr->setData(int(value));
     }
 
     return expr;
 }
 
-QSharedPointer<Expression> parseParameterExpr(QTextStream & stream, ParsingData * data) {
-    QSharedPointer<Expression> expr = QSharedPointer<Expression>::create();
+Expression * parseParameterExpr(Lexer & lexer, ParsingData * data) {
+    Expression * expr = getEmptyExpr(data);
 
     // Comment
-    if ( data->lastChar == '#' ) {
-        expr = parseCommentExpr(stream, data);
+    if ( lexer.current() == '#' ) {
+        expr = parseCommentExpr(lexer, data);
     }
 
     // Identifier String
-    else if ( data->lastChar.isLetter() ) {
-
-        data->identifier.clear();
+    else if ( Lexer::isLetter(lexer.current()) ) {
 
         // Read identifier
-        while ( isVariableConform( data->lastChar, data->identifier ) ) {
-            data->identifier += data->lastChar;
-            stream >> data->lastChar;
-        }
+        data->identifier = lexer.scanIdentifier();
 
         // Check if identifier is a keyword
-        if (data->keywords.contains(data->identifier)) {
-            ExpressionType type = data->keywords.value(data->identifier);
+        ExpressionType type = matchKeyword(data->identifier);
+        if ( type != ExpressionType::UnknownExpression ) {
             switch (type)
             {
             case ExpressionType::Package:
@@ -213,270 +229,325 @@ QSharedPointer<Expression> parseParameterExpr(QTextStream & stream, ParsingData
                 break;
 
             case ExpressionType::FunctionExpressionType:
-                expr = parseFunctionExpr(stream, data);
+                expr = parseFunctionExpr(lexer, data);
                 break;
 
                 default:
                 break;
             }
         }
-        else if ( data->lastChar == '(' ) {
-            expr = parseFunctionInvokationExpr(stream, data);
+        else if ( lexer.current() == '(' ) {
+            expr = parseFunctionInvokationExpr(lexer, data);
+            expr = parseOperatorTailExpr(lexer, data, expr);
         }
         else {
-            expr = QSharedPointer<VariableExpression>::create();
-            expr.dynamicCast<VariableExpression>()->setName(data->identifier);
+            VariableExpression * variable = createExpr<VariableExpression>(lexer, data);
+            variable->setSymbol(tokenSymbol(data->identifier));
+            expr = parseOperatorTailExpr(lexer, data, variable);
         }
     }
 
     // String expression
-    else if ( data->lastChar == '"' ) {
-        expr = parseStringExpr(stream, data);
+    else if ( lexer.current() == '"' ) {
+        expr = parseStringExpr(lexer, data);
+        expr = parseOperatorTailExpr(lexer, data, expr);
     }
 
     // Numbers
-    else if ( isNumberConform(data->lastChar, data->identifier) ) {
-        expr = parseNumberExpr(stream, data);
+    else if ( Lexer::isNumberStart(lexer.current()) ) {
+        expr = parseNumberExpr(lexer, data);
+        expr = parseOperatorTailExpr(lexer, data, expr);
     }
 
     return expr;
 }
 
 
-QSharedPointer<Expression> parseFunctionInvokationExpr(QTextStream & stream, ParsingData * data) {
-    QSharedPointer<FunctionInvokationExpression> expr = QSharedPointer<FunctionInvokationExpression>::create();
+Expression * parseFunctionInvokationExpr(Lexer & lexer, ParsingData * data) {
+    FunctionInvokationExpression * expr = createExpr<FunctionInvokationExpression>(lexer, data);
+
+    expr->setFunctionSymbol(tokenSymbol(data->identifier));
 
-    QString functionName = data->identifier;
+    HOUND_TRACE(Parser, Verbose) << "Calling function: " << expr->functionName();
 
-    qDebug() << "Calling function: " << functionName;
+    lexer.advance();
 
-    expr->setFunctionName(functionName);
+    consumeIndetention(lexer, data);
 
-    stream >> data->lastChar;
+    QVarLengthArray<Expression *, 8> parameters;
 
-    consumeIndetention(stream, data);
+    Expression * variableExpr = parseParameterExpr(lexer, data);
+    while ( !isInValidExpr(variableExpr) ) {
+        parameters.append(variableExpr);
+        HOUND_TRACE(Parser, Verbose) << "Parameter: " << variableExpr->toString();
 
-    QSharedPointer<Expression> variableExpr = parseParameterExpr(stream, data);
-    while ( !variableExpr.isNull() && !variableExpr->isUnknown() ) {
-        expr->addParameter(variableExpr);
-        qDebug() << "Parameter: " << variableExpr->toString();
-        variableExpr = parseParameterExpr(stream, data);
-        consumeSpace(stream, data);
+        consumeSpace(lexer, data);
+
+        // Parameters are separated by ,
+        if ( lexer.current() == ',' ) {
+            lexer.advance();
+            consumeSpace(lexer, data);
+        }
+
+        variableExpr = parseParameterExpr(lexer, data);
+        consumeSpace(lexer, data);
     }
 
-    if ( data->lastChar != ')' && data->lastUnknownChar != ')' ) {
+    if ( lexer.current() != ')' && data->lastUnknownChar != ')' ) {
         qDebug() << "Call didn't end with )";
-        return getEmptyExpr();
+        return getEmptyExpr(data);
     }
 
+    expr->setParameters(createList(data, parameters));
+
     // Consume char after )
-    stream >> data->lastChar;
+    lexer.advance();
 
     return expr;
 }
 
-bool isPossibleOperator(ParsingData * data) {
+LanguageOperator parseOperator(Lexer & lexer, ParsingData * data) {
+    const char * start = lexer.position();
+    int length = 0;
 
-    if ( data->identifier.isEmpty() ) {
-        //
-        for( const QString & key : data->operators.keys() ) {
-            if ( key.startsWith(data->lastChar) ) {
-                return true;
-            }
-        }
+    LanguageOperator myOperator = matchOperator(start, lexer.end(), &length);
+
+    lexer.setPosition(start + length);
+
+    data->identifier = QLatin1String(start, length);
+
+    // Word operators must not be the start of an identifier
+    if ( myOperator != LanguageOperator::UnknownOperator &&
+         Lexer::isLetter(start[0]) && Lexer::isIdentifierPart(lexer.current()) ) {
+        myOperator = LanguageOperator::UnknownOperator;
     }
-    else {
-        QString searchString = data->identifier + data->lastChar;
-        //
-        for( const QString & key : data->operators.keys() ) {
-            if ( key.startsWith(searchString) ) {
-                return true;
-            }
-        }
+
+    // Nothing is consumed if there is no operator
+    if ( myOperator == LanguageOperator::UnknownOperator ) {
+        lexer.setPosition(start);
     }
 
+    HOUND_TRACE(Parser, Verbose) << "Operator: " << myOperator;
 
-    return false;
+    return myOperator;
 }
 
+LanguageOperator peekOperator(Lexer & lexer, ParsingData * data) {
 
-LanguageOperator parseOperator(QTextStream & stream, ParsingData * data) {
-    LanguageOperator myOperator;
-    data->identifier.clear();
-
-    // stream >> data->lastChar;
+    // The operator after an operand is read only once and then kept
+    // until a binary expression takes it
+    if ( data->pendingOperator == LanguageOperator::UnknownOperator ) {
+        lexer.skipInlineSpace();
 
-    while ( isPossibleOperator(data) ) {
-        data->identifier += data->lastChar;
-        stream >> data->lastChar;
+        data->pendingOperator = parseOperator(lexer, data);
     }
 
-    myOperator = data->operators.value(data->identifier, LanguageOperator::UnknownOperator);
+    return data->pendingOperator;
+}
 
-    qDebug() << "Operator: " << myOperator;
+bool bindsStronger(LanguageOperator next, LanguageOperator current) {
+    uint nextPriority = operatorPriority(next);
+    uint currentPriority = operatorPriority(current);
 
-    return myOperator;
+    // Power of is right associative
+    if ( next == LanguageOperator::PowerOfOperator && current == LanguageOperator::PowerOfOperator )
+        return true;
+
+    return nextPriority > currentPriority;
 }
 
-QSharedPointer<Expression> parsePossibleComparsionExpr(QTextStream & stream, ParsingData * data) {
+Expression * parseOperandExpr(Lexer & lexer, ParsingData * data) {
     // - Variables
+    // - Function invokations
     // - Integers
     // - Floats
     // - Strings
 
-    data->identifier.clear();
+    if ( Lexer::isIdentifierStart(lexer.current()) ) {
+
+        // Read identifier
+        data->identifier = lexer.scanIdentifier();
+
+        if ( lexer.current() == '(' ) {
+            return parseFunctionInvokationExpr(lexer, data);
+        }
+
+        VariableExpression * expr = createExpr<VariableExpression>(lexer, data);
+        expr->setSymbol(tokenSymbol(data->identifier));
 
-    if ( isVariableConform( data->lastChar, data->identifier ) ) {
-        return parseVariableExpr(stream, data);
+        return expr;
     }
-    else if ( data->lastChar == '"' ) {
-        return parseStringExpr(stream, data);
+    else if ( lexer.current() == '"' ) {
+        return parseStringExpr(lexer, data);
     }
-    else if ( isNumberConform(data->lastChar, data->identifier)  ) {
-        return parseNumberExpr(stream, data);
+    else if ( Lexer::isNumberStart(lexer.current()) ) {
+        return parseNumberExpr(lexer, data);
     }
 
-    return getEmptyExpr();
+    return getEmptyExpr(data);
 }
 
+Expression * parseOperatorTailExpr(Lexer & lexer, ParsingData * data,
+                                   Expression * left, uint minPriority) {
 
-QSharedPointer<BinaryExpression> parseBinaryExpr(QTextStream & stream, ParsingData * data) {
-    QSharedPointer<BinaryExpression> expr = QSharedPointer<BinaryExpression>::create();
+    if ( isInValidExpr(left) ) {
+        return left;
+    }
 
-    data->identifier.clear();
-    //
-    stream >> data->lastChar;
+    LanguageOperator myOperator = peekOperator(lexer, data);
 
-    QSharedPointer<Expression> left = parsePossibleComparsionExpr(stream, data);
+    while ( myOperator != LanguageOperator::UnknownOperator &&
+            operatorPriority(myOperator) >= minPriority ) {
 
-    if ( isInValidExpr(left) ) {
-        qDebug() << "Invalid left expression";
-        return getEmptyExpr().dynamicCast<BinaryExpression>();
+        // Take the operator
+        data->pendingOperator = LanguageOperator::UnknownOperator;
+
+        lexer.skipInlineSpace();
+
+        Expression * right = parseOperandExpr(lexer, data);
+
+        if ( isInValidExpr(right) ) {
+            qDebug() << "Invalid right expression";
+            return getEmptyExpr(data);
+        }
+
+        LanguageOperator nextOperator = peekOperator(lexer, data);
+
+        while ( nextOperator != LanguageOperator::UnknownOperator &&
+                bindsStronger(nextOperator, myOperator) ) {
+            right = parseOperatorTailExpr(lexer, data, right, operatorPriority(nextOperator));
+
+            if ( isInValidExpr(right) ) {
+                return right;
+            }
+
+            nextOperator = peekOperator(lexer, data);
+        }
+
+        BinaryExpression * binary = createExpr<BinaryExpression>(lexer, data);
+        binary->setLeftExpression(left);
+        binary->setOperator(myOperator);
+        binary->setRightExpression(right);
+
+        left = binary;
+        myOperator = nextOperator;
     }
 
-    qDebug() << "left expression: " << left->toString();
+    return left;
+}
 
-    consumeSpace(stream, data);
+BinaryExpression * parseBinaryExpr(Lexer & lexer, ParsingData * data) {
+    lexer.skipInlineSpace();
 
-    LanguageOperator myOperator = parseOperator(stream, data);
+    Expression * left = parseOperandExpr(lexer, data);
 
-    if ( myOperator == LanguageOperator::UnknownOperator ) {
-        qDebug() << "This operator '" << data->identifier << "' is unknown";
-        return getEmptyExpr().dynamicCast<BinaryExpression>();
+    if ( isInValidExpr(left) ) {
+        qDebug() << "Invalid left expression";
+        return 0;
     }
 
-    consumeSpace(stream, data);
+    HOUND_TRACE(Parser, Verbose) << "left expression: " << left->toString();
 
-    QSharedPointer<Expression> right = parsePossibleComparsionExpr(stream, data);
+    Expression * tail = parseOperatorTailExpr(lexer, data, left);
 
-    if ( isInValidExpr(right) ) {
-        qDebug() << "Invalid right expression";
-        return getEmptyExpr().dynamicCast<BinaryExpression>();
+    if ( isInValidExpr(tail) || !tail->isBinary() ) {
+        qDebug() << "Expected a binary expression";
+        return 0;
     }
 
-    qDebug() << "right expression: " << right->toString();
+    BinaryExpression * expr = static_cast<BinaryExpression *>(tail);
 
-    expr->setLeftExpression(left);
-    expr->setOperator(myOperator);
-    expr->setRightExpression(right);
+    HOUND_TRACE(Parser, Verbose) << "right expression: " << expr->rightExpression()->toString();
 
     return expr;
 }
 
-QSharedPointer<Expression> parseIfExpr(QTextStream & stream, ParsingData * data) {
-    QSharedPointer<IfExpression> expr = QSharedPointer<IfExpression>::create();
+Expression * parseIfExpr(Lexer & lexer, ParsingData * data) {
+    IfExpression * expr = createExpr<IfExpression>(lexer, data);
 
-    QSharedPointer<BinaryExpression> condition = parseBinaryExpr(stream, data);
-    if ( condition.isNull() || condition->isUnknown() ) {
+    BinaryExpression * condition = parseBinaryExpr(lexer, data);
+    if ( !condition ) {
         qDebug() << "Could not parse binary condition expression";
-        return getEmptyExpr();
+        return getEmptyExpr(data);
     }
 
-    consumeSpace(stream, data);
+    expr->setCondition(condition);
 
-    data->identifier.clear();
+    consumeSpace(lexer, data);
 
     // Read identifier
-    while ( isVariableConform( data->lastChar, data->identifier ) ) {
-        data->identifier += data->lastChar;
-        stream >> data->lastChar;
-    }
+    data->identifier = lexer.scanIdentifier();
 
-    if ( data->identifier.toLower() != "then" ) {
+    if ( tokenText(data->identifier).toLower() != "then" ) {
         qDebug() << "Expected then after binary expression";
-        return getEmptyExpr();
+        return getEmptyExpr(data);
     }
 
-    consumeIndetention(stream, data);
+    consumeIndetention(lexer, data);
 
     if ( !hasNewBlock(data) ) {
         qDebug() << "After then comes a new block!";
-        return getEmptyExpr();
+        return getEmptyExpr(data);
     }
 
-    QSharedPointer<Expression> block = parseCodeBlockExpr(stream, data);
+    Expression * block = parseCodeBlockExpr(lexer, data);
 
     if ( isInValidExpr(block) ) {
         qDebug() << "Invalid block parsed";
-        return getEmptyExpr();
+        return getEmptyExpr(data);
     }
 
     expr->setBlock(block);
 
-    qDebug() << "Block: " << block->toString();
+    HOUND_TRACE(Parser, Verbose) << "Block: " << block->toString();
 
-    consumeIndetention(stream, data);
+    consumeIndetention(lexer, data);
 
     return expr;
 }
 
-QSharedPointer<Expression> parseElseExpr(QTextStream & stream, ParsingData * data) {
-    QSharedPointer<ElseExpression> expr = QSharedPointer<ElseExpression>::create();
+Expression * parseElseExpr(Lexer & lexer, ParsingData * data) {
+    ElseExpression * expr = createExpr<ElseExpression>(lexer, data);
 
-    consumeIndetention(stream, data);
+    consumeIndetention(lexer, data);
 
     if ( !hasNewBlock(data) ) {
         qDebug() << "After else comes a new block!";
-        return getEmptyExpr();
+        return getEmptyExpr(data);
     }
 
-    QSharedPointer<Expression> block = parseCodeBlockExpr(stream, data);
+    Expression * block = parseCodeBlockExpr(lexer, data);
 
     if ( isInValidExpr(block) ) {
         qDebug() << "Invalid block parsed";
-        return getEmptyExpr();
+        return getEmptyExpr(data);
     }
 
     expr->setBlock(block);
 
-    qDebug() << "Block: " << block->toString();
+    HOUND_TRACE(Parser, Verbose) << "Block: " << block->toString();
 
-    consumeIndetention(stream, data);
+    consumeIndetention(lexer, data);
 
     return expr;
 }
 
-QSharedPointer<Expression> parseBlockExpr(QTextStream & stream, ParsingData * data) {
-    QSharedPointer<Expression> expr = getEmptyExpr();
+Expression * parseBlockExpr(Lexer & lexer, ParsingData * data) {
+    Expression * expr = getEmptyExpr(data);
 
-    if ( data->lastChar == '#' ) {
-        expr = parseCommentExpr(stream, data);
+    if ( lexer.current() == '#' ) {
+        expr = parseCommentExpr(lexer, data);
     }
 
     // Identifier String
-    else if ( data->lastChar.isLetter() ) {
-
-        data->identifier.clear();
+    else if ( Lexer::isLetter(lexer.current()) ) {
 
         // Read identifier
-        while ( isVariableConform( data->lastChar, data->identifier ) ) {
-            data->identifier += data->lastChar;
-            stream >> data->lastChar;
-        }
+        data->identifier = lexer.scanIdentifier();
 
         // Check if identifier is a keyword
-        if (data->keywords.contains(data->identifier)) {
-            ExpressionType type = data->keywords.value(data->identifier);
+        ExpressionType type = matchKeyword(data->identifier);
+        if ( type != ExpressionType::UnknownExpression ) {
             switch (type)
             {
             case ExpressionType::Package:
@@ -488,144 +559,170 @@ QSharedPointer<Expression> parseBlockExpr(QTextStream & stream, ParsingData * da
                 break;
 
             case ExpressionType::FunctionExpressionType:
-                expr = parseFunctionExpr(stream, data);
+                expr = parseFunctionExpr(lexer, data);
                 break;
 
             case ExpressionType::If:
-                expr = parseIfExpr(stream, data);
+                expr = parseIfExpr(lexer, data);
                 break;
 
             case ExpressionType::Else:
-                expr = parseElseExpr(stream, data);
+                expr = parseElseExpr(lexer, data);
                 break;
 
             default:
                 break;
             }
         }
-        else if ( data->lastChar == '(' ) {
-            expr = parseFunctionInvokationExpr(stream, data);
+        else if ( lexer.current() == '(' ) {
+            expr = parseFunctionInvokationExpr(lexer, data);
+            expr = parseOperatorTailExpr(lexer, data, expr);
         }
         else {
-            expr = QSharedPointer<VariableExpression>::create();
-            expr.dynamicCast<VariableExpression>()->setName(data->identifier);
+            VariableExpression * variable = createExpr<VariableExpression>(lexer, data);
+            variable->setSymbol(tokenSymbol(data->identifier));
+            expr = parseOperatorTailExpr(lexer, data, variable);
         }
     }
-    else if ( isNumberConform(data->lastChar, data->identifier) ) {
-        expr = parseNumberExpr(stream, data);
+    else if ( lexer.current() == '"' ) {
+        expr = parseStringExpr(lexer, data);
+        expr = parseOperatorTailExpr(lexer, data, expr);
+    }
+    else if ( Lexer::isNumberStart(lexer.current()) ) {
+        expr = parseNumberExpr(lexer, data);
+        expr = parseOperatorTailExpr(lexer, data, expr);
     }
 
     return expr;
 }
 
-QSharedPointer<Expression> parseCodeBlockExpr(QTextStream & stream, ParsingData * data) {
-    QSharedPointer<CodeBlockExpression> expr = QSharedPointer<CodeBlockExpression>::create();
+Expression * parseCodeBlockExpr(Lexer & lexer, ParsingData * data) {
+    CodeBlockExpression * expr = createExpr<CodeBlockExpression>(lexer, data);
 
-    QSharedPointer<Expression> codeExpr = parseBlockExpr(stream, data);
+    uint blockIndent = data->currentIndent;
+
+    QVarLengthArray<Expression *, 8> expressions;
+
+    Expression * codeExpr = parseBlockExpr(lexer, data);
 
     if ( isInValidExpr(codeExpr) ) {
         qDebug() << "Invalid code block";
-        return getEmptyExpr();
+        return getEmptyExpr(data);
     }
 
     while ( !isInValidExpr(codeExpr) ) {
-        expr->addExpression(codeExpr);
-        qDebug() << "Block: " << codeExpr->toString();
-        codeExpr = parseBlockExpr(stream, data);
+        expressions.append(codeExpr);
+        HOUND_TRACE(Parser, Verbose) << "Block: " << codeExpr->toString();
+
+        // The block ends with the first line which is less indented
+        consumeIndetention(lexer, data);
+
+        if ( data->currentIndent < blockIndent || lexer.atEnd() ) {
+            break;
+        }
+
+        codeExpr = parseBlockExpr(lexer, data);
     }
 
+    expr->setExpressions(createList(data, expressions));
+
     return expr;
 }
 
-QSharedPointer<Expression> parseFunctionExpr(QTextStream & stream, ParsingData * data) {
-    QSharedPointer<FunctionExpression> expr = QSharedPointer<FunctionExpression>::create();
+Expression * parseFunctionExpr(Lexer & lexer, ParsingData * data) {
+    FunctionExpression * expr = createExpr<FunctionExpression>(lexer, data);
 
-    if ( !consumeSpace(stream, data) ) {
+    if ( !consumeSpace(lexer, data) ) {
         qDebug() << "No space between keyword and rest";
     }
 
-    data->identifier.clear();
-
-    while ( isVariableConform( data->lastChar, data->identifier ) ) {
-        data->identifier += data->lastChar;
-        stream >> data->lastChar;
-    }
+    data->identifier = lexer.scanIdentifier();
 
     if ( data->identifier.isEmpty() ) {
         expr->setAnonymous(true);
     }
     else {
-        expr->setName(data->identifier);
+        expr->setSymbol(tokenSymbol(data->identifier));
     }
 
     // Take space away if there is
-    consumeSpace(stream, data);
+    consumeSpace(lexer, data);
 
-    if ( data->lastChar != '(' && data->lastUnknownChar != '(' ) {
+    if ( lexer.current() != '(' && data->lastUnknownChar != '(' ) {
         qDebug() << "( is missing";
-        return QSharedPointer<Expression>::create();
+        return getEmptyExpr(data);
     }
 
-    stream >> data->lastChar;
-    consumeSpace(stream, data);
+    lexer.advance();
+    consumeSpace(lexer, data);
 
     // Parameter parsing
     // TODO:
 
+    QVarLengthArray<Expression *, 8> parameters;
+
     Q_FOREVER {
-        // Empty string for new parameter
-        data->identifier.clear();
+        // Next parameter
+        data->identifier = lexer.scanIdentifier();
 
-        while ( isVariableConform( data->lastChar, data->identifier ) ) {
-            data->identifier += data->lastChar;
-            stream >> data->lastChar;
+        if ( data->identifier.size() > 0 ) {
+            VariableExpression * param = createExpr<VariableExpression>(lexer, data);
+            param->setSymbol(tokenSymbol(data->identifier));
+            parameters.append(param);
         }
 
-        if ( data->identifier.size() > 0 ) {
-            QSharedPointer<VariableExpression> param = QSharedPointer<VariableExpression>::create();
-            param->setName(data->identifier);
-            expr->addParameter(param);
+        consumeSpace(lexer, data);
+
+        if ( lexer.atEnd() || lexer.current() == ')' ) {
+            break;
         }
 
-        if ( stream.atEnd() || data->lastChar == ')' ) {
+        // Parameters are separated by ,
+        if ( lexer.current() != ',' ) {
+            qDebug() << "Unexpected character in parameter list: " << lexer.current();
             break;
         }
+
+        lexer.advance();
+        consumeSpace(lexer, data);
     }
 
-    if ( data->lastChar != ')' && data->lastUnknownChar != ')' ) {
+    if ( lexer.current() != ')' && data->lastUnknownChar != ')' ) {
         qDebug() << ") is missing";
-        return QSharedPointer<Expression>::create();
+        return getEmptyExpr(data);
     }
 
-    stream >> data->lastChar;
-    consumeSpace(stream, data);
+    expr->setParameters(createList(data, parameters));
+
+    lexer.advance();
+    consumeSpace(lexer, data);
 
-    if ( data->lastChar != '-' ) {
+    if ( lexer.current() != '-' ) {
         qDebug() << "-> is missing";
-        return QSharedPointer<Expression>::create();
+        return getEmptyExpr(data);
     }
 
-    stream >> data->lastChar;
-    consumeSpace(stream, data);
+    lexer.advance();
+    consumeSpace(lexer, data);
 
-    if ( data->lastChar != '>' ){
+    if ( lexer.current() != '>' ){
         qDebug() << "-> is missing";
-        return getEmptyExpr();
+        return getEmptyExpr(data);
     }
 
     // Check for new function block
-    stream >> data->lastChar;
-    consumeIndetention(stream, data);
+    lexer.advance();
+    consumeIndetention(lexer, data);
 
     if ( !hasNewBlock(data) ) {
         qDebug() << "Function expects a function body with enough indetention";
-        return getEmptyExpr();
+        return getEmptyExpr(data);
     }
 
-    QSharedPointer<Expression> codeBlock = parseCodeBlockExpr(stream, data);
-    if ( codeBlock.isNull() ) {
+    Expression * codeBlock = parseCodeBlockExpr(lexer, data);
+    if ( !codeBlock ) {
         qDebug() << "Could not parse function block";
-        return getEmptyExpr();
+        return getEmptyExpr(data);
     }
 
     expr->setCode(codeBlock);
@@ -633,130 +730,204 @@ QSharedPointer<Expression> parseFunctionExpr(QTextStream & stream, ParsingData *
     return expr;
 }
 
-QSharedPointer<Expression> parseTopLevelExpr(QTextStream & stream, ParsingData * data) {
+Expression * parseTopLevelExpr(Lexer & lexer, ParsingData * data) {
 
-    QSharedPointer<Expression> expr;
+    Expression * expr = 0;
 
-    consumeIndetention(stream, data);
+    consumeIndetention(lexer, data);
 
     // Check if it is a 1 line comment
-    if ( data->lastChar == '#' ) {
-        expr = parseCommentExpr(stream, data);
+    if ( lexer.current() == '#' ) {
+        expr = parseCommentExpr(lexer, data);
     }
 
     // Identifier String
-    else if ( data->lastChar.isLetter() ) {
-
-        data->identifier.clear();
+    else if ( Lexer::isLetter(lexer.current()) ) {
 
         // Read identifier
-        while ( isVariableConform( data->lastChar, data->identifier ) ) {
-            data->identifier += data->lastChar;
-            stream >> data->lastChar;
-        }
+        data->identifier = lexer.scanIdentifier();
 
         // Check if identifier is a keyword
-        if (data->keywords.contains(data->identifier)) {
-            ExpressionType type = data->keywords.value(data->identifier);
+        ExpressionType type = matchKeyword(data->identifier);
+        if ( type != ExpressionType::UnknownExpression ) {
             switch (type)
             {
             case ExpressionType::Package:
-                expr = parsePackageExpr(stream, data);
+                expr = parsePackageExpr(lexer, data);
                 break;
 
             case ExpressionType::Import:
-                expr = parseImportExpr(stream, data);
+                expr = parseImportExpr(lexer, data);
                 break;
 
             case ExpressionType::FunctionExpressionType:
-                expr = parseFunctionExpr(stream, data);
+                expr = parseFunctionExpr(lexer, data);
                 break;
 
             case ExpressionType::If:
-                expr = parseIfExpr(stream, data);
+                expr = parseIfExpr(lexer, data);
                 break;
 
             case ExpressionType::Else:
-                expr = parseElseExpr(stream, data);
+                expr = parseElseExpr(lexer, data);
                 break;
 
             default:
                 break;
             }
         }
-        else if ( data->lastChar == '(' ) {
-            expr = parseFunctionInvokationExpr(stream, data);
+        else if ( lexer.current() == '(' ) {
+            expr = parseFunctionInvokationExpr(lexer, data);
+            expr = parseOperatorTailExpr(lexer, data, expr);
         }
         else {
-            expr = QSharedPointer<VariableExpression>::create();
-            expr.dynamicCast<VariableExpression>()->setName(data->identifier);
+            VariableExpression * variable = createExpr<VariableExpression>(lexer, data);
+            variable->setSymbol(tokenSymbol(data->identifier));
+            expr = parseOperatorTailExpr(lexer, data, variable);
         }
     }
 
     // If the expression is null
-    if ( expr.isNull() ) {
-        expr = getEmptyExpr();
+    if ( !expr ) {
+        expr = getEmptyExpr(data);
 
-        qDebug() << data->lastChar;
+        if ( !lexer.atEnd() ) {
+            HOUND_TRACE(Parser, Verbose) << "Unknown character: " << lexer.current();
+        }
 
-        data->lastUnknownChar = data->lastChar;
-        stream >> data->lastChar;
+        data->lastUnknownChar = lexer.current();
+        lexer.advance();
     }
 
     return expr;
 }
 
-QList< QSharedPointer<Expression> > Parser::parse()
+QSharedPointer<SyntaxTree> Parser::parse()
+{
+    QSharedPointer<SyntaxTree> tree = QSharedPointer<SyntaxTree>::create();
+
+    if ( !open() ) {
+        return tree;
+    }
+
+    QVector<Expression *> expressions;
+
+    while ( Expression * fileExpr = parseNext(tree->arena()) ) {
+        expressions.append(fileExpr);
+    }
+
+    tree->setExpressions(tree->arena()->createList(expressions.constData(), expressions.size()));
+
+    return tree;
+}
+
+bool Parser::open()
 {
-    QFile file(m_fileName);
+    finish();
 
-    if (!file.open(QIODevice::ReadOnly))
-        return QList< QSharedPointer<Expression> >();
+    // Modules are named like the files of the project
+    if ( CompileStatistics::global().isEnabled() ) {
+        m_timer.reset(new CompileTimer(m_source.isNull() ? QFileInfo(m_fileName).absoluteFilePath()
+                                                         : QString("<source>")));
+        m_timer->start(CompilePhase::Lexing);
+    }
 
-    QTextStream stream(&file);
-    QList< QSharedPointer<Expression> > expressions;
+    m_lexer.reset(new Lexer);
+    m_lexer->setTimed(!m_timer.isNull());
+
+    if ( !m_source.isNull() ) {
+        m_lexer->setBuffer(m_source.constData(), m_source.size());
+    }
+    else if ( !m_lexer->open(m_fileName) ) {
+        finish();
+        return false;
+    }
 
-    ParsingData data;
+    if ( m_timer )
+        m_timer->stop();
 
     // Init data
-    data.currentIndent = 0;
-
-    // Set operators
-    data.operators["in"] = LanguageOperator::InOperator;
-    data.operators["not"] = LanguageOperator::NotOperator;
-    data.operators["and"] = LanguageOperator::AndOperator;
-    data.operators["or"] = LanguageOperator::OrOperator;
-    data.operators["xor"] = LanguageOperator::XorOperator;
-    data.operators["<"] = LanguageOperator::LessOperator;
-    data.operators[">"] = LanguageOperator::GreaterOperator;
-    data.operators["+"] = LanguageOperator::PlusOperator;
-    data.operators["-"] = LanguageOperator::MinusOperator;
-    data.operators["*"] = LanguageOperator::MultiplyOperator;
-    data.operators["/"] = LanguageOperator::DivideOperator;
-    data.operators["**"] = LanguageOperator::PowerOfOperator;
-
-    // Set keywords
-    data.keywords["package"] = ExpressionType::Package;
-    data.keywords["import"] = ExpressionType::Import;
-    data.keywords["fn"] = ExpressionType::FunctionExpressionType;
-    data.keywords["if"] = ExpressionType::If;
-    data.keywords["elif"] = ExpressionType::ElIf;
-    data.keywords["else"] = ExpressionType::Else;
-
-    // Start reading
-    stream >> data.lastChar;
-
-    while (!stream.atEnd()) {
-        QSharedPointer<Expression> fileExpr = parseTopLevelExpr(stream, &data);
-        qDebug() << "Expression: " << fileExpr->toString();
+    m_data.arena = 0;
+    m_data.lastUnknownChar = '\0';
+    m_data.previousIndent = 0;
+    m_data.currentIndent = 0;
+    m_data.pendingOperator = LanguageOperator::UnknownOperator;
 
-        expressions.append(fileExpr);
+    m_parseNanoseconds = 0;
+    m_parseCycles = 0;
+
+    return true;
+}
+
+QSharedPointer<SyntaxTree> Parser::next()
+{
+    QSharedPointer<SyntaxTree> tree = QSharedPointer<SyntaxTree>::create();
+    Expression * fileExpr = parseNext(tree->arena());
+
+    if ( !fileExpr ) {
+        return QSharedPointer<SyntaxTree>();
     }
 
-    qDebug() << "";
+    tree->setExpressions(tree->arena()->createList(&fileExpr, 1));
 
-    file.close();
+    return tree;
+}
 
-    return expressions;
+Expression * Parser::parseNext(ExpressionArena * arena)
+{
+    if ( !m_lexer ) {
+        return 0;
+    }
+
+    // The lexer runs whenever the parser needs a token, its part of the
+    // time is estimated from the cycles of its scanners
+    QElapsedTimer parseTimer;
+    quint64 parseCycles = 0;
+    int nodeCount = arena->expressionCount();
+
+    if ( m_timer ) {
+        parseTimer.start();
+        parseCycles = Profiler::cycles();
+    }
+
+    m_data.arena = arena;
+
+    Expression * fileExpr = m_lexer->atEnd() ? 0 : parseTopLevelExpr(*m_lexer, &m_data);
+
+    // Trailing white space
+    if ( fileExpr && fileExpr->isUnknown() && m_lexer->atEnd() ) {
+        fileExpr = 0;
+    }
+
+    if ( m_timer ) {
+        m_parseNanoseconds += parseTimer.nsecsElapsed();
+        m_parseCycles += Profiler::cycles() - parseCycles;
+        m_timer->count(CompileCounter::ParsedNodes, arena->expressionCount() - nodeCount);
+    }
+
+    if ( !fileExpr ) {
+        finish();
+        return 0;
+    }
+
+    HOUND_TRACE(Parser, Info) << "Expression: " << fileExpr->toString();
+
+    return fileExpr;
 }
 
+void Parser::finish()
+{
+    if ( m_timer && m_lexer ) {
+        qint64 lexing = 0;
+
+        if ( m_parseCycles )
+            lexing = qMin(qint64(double(m_lexer->scanCycles()) * m_parseNanoseconds / m_parseCycles), m_parseNanoseconds);
+
+        m_timer->addTime(CompilePhase::Lexing, lexing);
+        m_timer->addTime(CompilePhase::Parsing, m_parseNanoseconds - lexing);
+        m_timer->count(CompileCounter::Tokens, m_lexer->tokenCount());
+    }
+
+    m_timer.reset();
+    m_lexer.reset();
+}
@@ -2,32 +2,75 @@
 #define PARSER_H
 
 #include <QtCore/QObject>
+#include <QtCore/QScopedPointer>
 #include <QtCore/qglobal.h>
 
 #include "expression.h"
+#include "lexer.h"
 
-///////////////////////////////////////////
+class CompileTimer;
 
+///////////////////////////////////////////
+///
+/// Parses a whole file at once with parse(), or streams it with open()
+/// and next(). Streamed expressions come in trees of their own, so only
+/// the ones the caller still holds stay in memory.
+///
 
 class Parser : public QObject
 {
     Q_OBJECT
 public:
     explicit Parser(const QString fileName, QObject *parent = 0);
-    QList< QSharedPointer<Expression> > parse();
+    ~Parser();
+
+    // The tree owns all parsed expressions
+    QSharedPointer<SyntaxTree> parse();
+
+    // Parses the given source instead of the file
+    void setSource(const QByteArray & source);
+
+    // Starts streaming, false if the file can't be read
+    bool open();
+
+    // Tree with the next top level expression as soon as it is parsed,
+    // null at the end
+    QSharedPointer<SyntaxTree> next();
+
+    // State carried from one top level expression to the next
+    const ParsingData & parsingData() const { return m_data; }
 
 Q_SIGNALS:
 
 public Q_SLOTS:
 
 private:
+    // Parses the next top level expression into the arena, 0 at the end
+    Expression * parseNext(ExpressionArena * arena);
+
+    // Closes the source and adds the statistics of the read
+    void finish();
+
     QString m_fileName;
+    QByteArray m_source;
+
+    // State between the top level expressions, the lexer is only set
+    // while reading
+    QScopedPointer<Lexer> m_lexer;
+    ParsingData m_data;
+
+    // Only set while the compile statistics are enabled
+    QScopedPointer<CompileTimer> m_timer;
+    qint64 m_parseNanoseconds;
+    quint64 m_parseCycles;
 };
 
 
-QSharedPointer<Expression> parseFunctionExpr(QTextStream & stream, ParsingData * data);
-QSharedPointer<Expression> parseFunctionInvokationExpr(QTextStream & stream, ParsingData * data);
-QSharedPointer<Expression> parseBlockExpr(QTextStream & stream, ParsingData * data);
-QSharedPointer<Expression> parseCodeBlockExpr(QTextStream & stream, ParsingData * data);
+Expression * parseFunctionExpr(Lexer & lexer, ParsingData * data);
+Expression * parseFunctionInvokationExpr(Lexer & lexer, ParsingData * data);
+Expression * parseBlockExpr(Lexer & lexer, ParsingData * data);
+Expression * parseCodeBlockExpr(Lexer & lexer, ParsingData * data);
+Expression * parseOperatorTailExpr(Lexer & lexer, ParsingData * data,
+                                   Expression * left, uint minPriority = 0);
 
 #endif // PARSER_H
@@ -0,0 +1,311 @@
+#include "perfmap.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(Q_OS_UNIX)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(Q_OS_LINUX)
+#include <sys/syscall.h>
+#endif
+
+// Format of the jitdump as read by perf, see tools/perf/util/jitdump.h
+static const quint32 JitDumpMagic = 0x4A695444;
+static const quint32 JitDumpVersion = 1;
+
+enum JitRecordType {
+    JitCodeLoad = 0,
+    JitCodeClose = 3,
+    JitCodeDebugInfo = 2
+};
+
+struct JitHeader {
+    quint32 magic;
+    quint32 version;
+    quint32 totalSize;
+    quint32 elfMachine;
+    quint32 padding;
+    quint32 pid;
+    quint64 timestamp;
+    quint64 flags;
+};
+
+struct JitRecordHeader {
+    quint32 id;
+    quint32 totalSize;
+    quint64 timestamp;
+};
+
+struct JitCodeLoadRecord {
+    JitRecordHeader header;
+    quint32 pid;
+    quint32 tid;
+    quint64 vma;
+    quint64 codeAddress;
+    quint64 codeSize;
+    quint64 codeIndex;
+};
+
+struct JitDebugInfoRecord {
+    JitRecordHeader header;
+    quint64 codeAddress;
+    quint64 entryCount;
+};
+
+struct JitDebugEntry {
+    quint64 address;
+    qint32 line;
+    qint32 discriminator;
+};
+
+///////////////////////////////////////////
+
+// Perf has to be told to use the same clock, "perf record -k mono"
+static quint64 timestamp() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return quint64(time.tv_sec) * 1000000000 + quint64(time.tv_nsec);
+}
+
+static quint32 processId() {
+#if defined(Q_OS_UNIX)
+    return quint32(getpid());
+#else
+    return 0;
+#endif
+}
+
+static quint32 threadId() {
+#if defined(Q_OS_LINUX) && defined(SYS_gettid)
+    return quint32(syscall(SYS_gettid));
+#else
+    return processId();
+#endif
+}
+
+static quint32 elfMachine() {
+#if defined(Q_PROCESSOR_X86_64)
+    return 62; // EM_X86_64
+#else
+    return 3; // EM_386
+#endif
+}
+
+// Creates the file for this process only. The names are predictable, so
+// a file which is there already is only replaced if it is a regular one
+// of the user, anything else could be a link to another file.
+static bool createPrivateFile(QFile & file, const QString & fileName, QIODevice::OpenMode mode) {
+    file.setFileName(fileName);
+
+#if defined(Q_OS_UNIX)
+    QByteArray path = QFile::encodeName(fileName);
+    struct stat status;
+
+    if ( lstat(path.constData(), &status) == 0 ) {
+        if ( !S_ISREG(status.st_mode) || status.st_uid != geteuid() || unlink(path.constData()) != 0 )
+            return false;
+    }
+
+    int flags = O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC | ( ( mode & QIODevice::ReadOnly ) ? O_RDWR : O_WRONLY );
+    int fd = open(path.constData(), flags, S_IRUSR | S_IWUSR);
+
+    if ( fd < 0 )
+        return false;
+
+    if ( !file.open(fd, mode, QFileDevice::AutoCloseHandle) ) {
+        close(fd);
+        return false;
+    }
+
+    return true;
+#else
+    return file.open(mode | QIODevice::Truncate);
+#endif
+}
+
+// Perf inject finds the dump by the name of its mapping, so it can be in
+// a directory of its own like the ones of the JVMTI agent, which nobody
+// else can put files into. Empty if there is none.
+static QString createJitDumpDirectory() {
+#if defined(Q_OS_UNIX)
+    QString base = QString::fromLocal8Bit(qgetenv("JITDUMPDIR"));
+
+    if ( base.isEmpty() )
+        base = QDir::homePath();
+
+    QString parent = base + "/.debug/jit";
+
+    if ( !QDir().mkpath(parent) )
+        return QString();
+
+    QByteArray path = QFile::encodeName(parent + "/hound-jit-XXXXXX");
+
+    // Created with 0700
+    if ( !mkdtemp(path.data()) )
+        return QString();
+
+    return QFile::decodeName(path);
+#else
+    return QDir::tempPath();
+#endif
+}
+
+///////////////////////////////////////////
+
+PerfMap::PerfMap(int outputs) :
+    m_marker(0),
+    m_codeIndex(0)
+{
+    if ( outputs & PerfMapFile ) {
+        // Perf only looks there
+        QString fileName = QString("/tmp/perf-%1.map").arg(processId());
+
+        if ( !createPrivateFile(m_perfMap, fileName, QIODevice::WriteOnly | QIODevice::Text) )
+            qDebug() << "Can't write perf map " << fileName;
+    }
+
+    if ( outputs & JitDumpFile )
+        openJitDump();
+}
+
+PerfMap::~PerfMap()
+{
+    closeJitDump();
+}
+
+void PerfMap::addCode(const void * code, quint64 size, const QString & name,
+                      const QString & fileName, const QVector<CodeLine> & lines)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if ( m_perfMap.isOpen() ) {
+        m_perfMap.write(QString("%1 %2 %3\n")
+                        .arg(quint64(quintptr(code)), 0, 16)
+                        .arg(size, 0, 16)
+                        .arg(name).toUtf8());
+        m_perfMap.flush();
+    }
+
+    if ( m_jitDump.isOpen() ) {
+        // Perf expects the lines before the code they belong to
+        if ( !lines.isEmpty() && !fileName.isEmpty() )
+            writeDebugInfo(code, fileName, lines);
+
+        writeCodeLoad(code, size, name);
+        m_jitDump.flush();
+    }
+}
+
+bool PerfMap::openJitDump()
+{
+    QString directory = createJitDumpDirectory();
+    QString fileName = QString("%1/jit-%2.dump").arg(directory).arg(processId());
+
+    if ( directory.isEmpty() || !createPrivateFile(m_jitDump, fileName, QIODevice::ReadWrite) ) {
+        qDebug() << "Can't write jitdump " << fileName;
+        return false;
+    }
+
+#if defined(Q_OS_UNIX)
+    // The executable mapping shows up in the recording, that's how perf
+    // inject finds the dump
+    long pageSize = sysconf(_SC_PAGESIZE);
+    m_marker = mmap(0, size_t(pageSize), PROT_READ | PROT_EXEC, MAP_PRIVATE, m_jitDump.handle(), 0);
+
+    if ( m_marker == MAP_FAILED ) {
+        qDebug() << "Can't map jitdump " << m_jitDump.fileName();
+        m_marker = 0;
+    }
+#endif
+
+    JitHeader header;
+    header.magic = JitDumpMagic;
+    header.version = JitDumpVersion;
+    header.totalSize = sizeof(header);
+    header.elfMachine = elfMachine();
+    header.padding = 0;
+    header.pid = processId();
+    header.timestamp = timestamp();
+    header.flags = 0;
+
+    m_jitDump.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    m_jitDump.flush();
+
+    return true;
+}
+
+void PerfMap::closeJitDump()
+{
+    if ( !m_jitDump.isOpen() )
+        return;
+
+    JitRecordHeader record;
+    record.id = JitCodeClose;
+    record.totalSize = sizeof(record);
+    record.timestamp = timestamp();
+
+    m_jitDump.write(reinterpret_cast<const char *>(&record), sizeof(record));
+
+#if defined(Q_OS_UNIX)
+    if ( m_marker )
+        munmap(m_marker, size_t(sysconf(_SC_PAGESIZE)));
+#endif
+
+    m_marker = 0;
+    m_jitDump.close();
+}
+
+void PerfMap::writeDebugInfo(const void * code, const QString & fileName, const QVector<CodeLine> & lines)
+{
+    QByteArray file = fileName.toUtf8();
+    QByteArray entries;
+
+    for ( const CodeLine & line : lines ) {
+        JitDebugEntry entry;
+        entry.address = quint64(quintptr(code)) + line.offset;
+        entry.line = qint32(line.line);
+        entry.discriminator = 0;
+
+        entries.append(reinterpret_cast<const char *>(&entry), sizeof(entry));
+        entries.append(file.constData(), file.size() + 1);
+    }
+
+    JitDebugInfoRecord record;
+    record.header.id = JitCodeDebugInfo;
+    record.header.totalSize = quint32(sizeof(record) + entries.size());
+    record.header.timestamp = timestamp();
+    record.codeAddress = quint64(quintptr(code));
+    record.entryCount = quint64(lines.size());
+
+    m_jitDump.write(reinterpret_cast<const char *>(&record), sizeof(record));
+    m_jitDump.write(entries);
+}
+
+void PerfMap::writeCodeLoad(const void * code, quint64 size, const QString & name)
+{
+    QByteArray symbol = name.toUtf8();
+
+    JitCodeLoadRecord record;
+    record.header.id = JitCodeLoad;
+    record.header.totalSize = quint32(sizeof(record) + symbol.size() + 1 + size);
+    record.header.timestamp = timestamp();
+    record.pid = processId();
+    record.tid = threadId();
+    record.vma = quint64(quintptr(code));
+    record.codeAddress = quint64(quintptr(code));
+    record.codeSize = size;
+    record.codeIndex = m_codeIndex++;
+
+    m_jitDump.write(reinterpret_cast<const char *>(&record), sizeof(record));
+    m_jitDump.write(symbol.constData(), symbol.size() + 1);
+    m_jitDump.write(static_cast<const char *>(code), qint64(size));
+}
@@ -0,0 +1,57 @@
+#ifndef PERFMAP_H
+#define PERFMAP_H
+
+#include <QtCore/QFile>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtCore/qglobal.h>
+
+// Code at the offset and up to the next entry belongs to the source line
+struct CodeLine {
+    quint32 offset;
+    quint32 line;
+};
+
+///////////////////////////////////////////
+///
+/// Describes compiled code to Linux perf. The perf map only names the
+/// code, the jitdump also carries the code itself and its source lines
+/// and is merged into a recording with "perf inject --jit".
+///
+
+class PerfMap
+{
+public:
+    enum Output {
+        PerfMapFile = 0x1,
+        JitDumpFile = 0x2
+    };
+
+    explicit PerfMap(int outputs);
+    ~PerfMap();
+
+    bool isEnabled() const { return m_perfMap.isOpen() || m_jitDump.isOpen(); }
+
+    void addCode(const void * code, quint64 size, const QString & name,
+                 const QString & fileName, const QVector<CodeLine> & lines);
+
+private:
+    Q_DISABLE_COPY(PerfMap)
+
+    bool openJitDump();
+    void closeJitDump();
+
+    void writeDebugInfo(const void * code, const QString & fileName, const QVector<CodeLine> & lines);
+    void writeCodeLoad(const void * code, quint64 size, const QString & name);
+
+    QMutex m_mutex;
+    QFile m_perfMap;
+    QFile m_jitDump;
+
+    // Perf finds the dump through this mapping of it
+    void * m_marker;
+    quint64 m_codeIndex;
+};
+
+#endif // PERFMAP_H
@@ -0,0 +1,454 @@
+#include "profiler.h"
+#include "codeheap.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+
+#include <algorithm>
+#include <string.h>
+
+#if defined(Q_OS_UNIX)
+#include <pthread.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#endif
+
+// Deeper calls are counted, but not timed or sampled
+static const int MaxDepth = 64 * 1024;
+
+// Samples of about a minute, further ones are dropped
+static const int MaxSamples = 64 * 1024;
+static const int MaxSampleDepth = 64;
+
+static const int DefaultSamplingInterval = 1000;
+
+#if defined(Q_PROCESSOR_X86) && ( defined(Q_CC_MSVC) || defined(Q_CC_GNU) )
+static const char * const CycleUnit = "tsc";
+#else
+static const char * const CycleUnit = "ns";
+#endif
+
+///////////////////////////////////////////
+///
+/// SIGPROF of an interval timer. The timer measures the time of the
+/// whole process, so samples of other threads like the compiler ones
+/// are dropped.
+///
+
+class SamplingSignal
+{
+public:
+    static bool start(Profiler * profiler, int interval);
+    static void stop();
+
+private:
+#if defined(Q_OS_UNIX)
+    static void handler(int signal, siginfo_t * info, void * context);
+
+    static Profiler * volatile s_profiler;
+    static pthread_t s_thread;
+    static struct sigaction s_previousAction;
+#endif
+};
+
+#if defined(Q_OS_UNIX)
+Profiler * volatile SamplingSignal::s_profiler = 0;
+pthread_t SamplingSignal::s_thread;
+struct sigaction SamplingSignal::s_previousAction;
+#endif
+
+// Address the signal interrupted, 0 if the system doesn't tell
+static quintptr programCounter(void * context) {
+#if defined(Q_OS_LINUX) && defined(Q_PROCESSOR_X86_64)
+    return quintptr(static_cast<ucontext_t *>(context)->uc_mcontext.gregs[REG_RIP]);
+#elif defined(Q_OS_LINUX) && defined(Q_PROCESSOR_X86_32)
+    return quintptr(static_cast<ucontext_t *>(context)->uc_mcontext.gregs[REG_EIP]);
+#else
+    Q_UNUSED(context)
+    return 0;
+#endif
+}
+
+bool SamplingSignal::start(Profiler * profiler, int interval)
+{
+#if defined(Q_OS_UNIX)
+    if ( s_profiler ) {
+        qDebug() << "Another profiler is sampling already";
+        return false;
+    }
+
+    s_thread = pthread_self();
+    s_profiler = profiler;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = &SamplingSignal::handler;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+
+    if ( sigaction(SIGPROF, &action, &s_previousAction) != 0 ) {
+        s_profiler = 0;
+        return false;
+    }
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = interval / 1000000;
+    timer.it_interval.tv_usec = interval % 1000000;
+    timer.it_value = timer.it_interval;
+
+    if ( setitimer(ITIMER_PROF, &timer, 0) != 0 ) {
+        sigaction(SIGPROF, &s_previousAction, 0);
+        s_profiler = 0;
+        return false;
+    }
+
+    return true;
+#else
+    Q_UNUSED(profiler)
+    Q_UNUSED(interval)
+    qDebug() << "Sampling is not supported on this system";
+    return false;
+#endif
+}
+
+void SamplingSignal::stop()
+{
+#if defined(Q_OS_UNIX)
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, 0);
+
+    sigaction(SIGPROF, &s_previousAction, 0);
+    s_profiler = 0;
+#endif
+}
+
+#if defined(Q_OS_UNIX)
+void SamplingSignal::handler(int signal, siginfo_t * info, void * context)
+{
+    Q_UNUSED(signal)
+    Q_UNUSED(info)
+
+    Profiler * profiler = s_profiler;
+
+    if ( profiler && pthread_equal(pthread_self(), s_thread) )
+        profiler->takeSample(programCounter(context));
+}
+#endif
+
+///////////////////////////////////////////
+
+Profiler::Profiler(CodeHeap * heap) :
+    m_heap(heap),
+    m_mode(0),
+    m_samplingInterval(DefaultSamplingInterval),
+    m_depth(0),
+    m_sampleCount(0),
+    m_droppedSamples(0),
+    m_sampleData(0),
+    m_sampleSlotData(0),
+    m_frameData(0)
+{
+    m_frames.resize(MaxDepth);
+}
+
+Profiler::~Profiler()
+{
+    setMode(0);
+
+    if ( !m_samples.isEmpty() )
+        m_heap->setCodeMapEnabled(false);
+}
+
+void Profiler::setMode(int mode)
+{
+    if ( ( mode & Sampling ) && !( m_mode & Sampling ) ) {
+        if ( !startSampling() )
+            mode &= ~Sampling;
+    }
+    else if ( !( mode & Sampling ) && ( m_mode & Sampling ) ) {
+        stopSampling();
+    }
+
+    // Calls which started before don't have a start time
+    unwind();
+
+    m_mode = mode;
+}
+
+void Profiler::setFunctionNames(const QStringList & names)
+{
+    m_functionNames = names;
+
+    if ( m_counters.size() == names.size() )
+        return;
+
+    FunctionCounters counters;
+    counters.calls = 0;
+    counters.inclusiveCycles = 0;
+    counters.exclusiveCycles = 0;
+    counters.samples = 0;
+
+    m_counters.fill(counters, names.size());
+    m_activeCalls.fill(0, names.size());
+    unwind();
+}
+
+void Profiler::clear()
+{
+    for ( FunctionCounters & counters : m_counters ) {
+        counters.calls = 0;
+        counters.inclusiveCycles = 0;
+        counters.exclusiveCycles = 0;
+    }
+
+    m_sampleCount = 0;
+    m_droppedSamples = 0;
+    m_sampleCode.clear();
+}
+
+Profiler::FunctionCounters Profiler::counters(int slot) const
+{
+    FunctionCounters counters = m_counters.at(slot);
+    counters.samples = 0;
+
+    for ( int i = 0; i < m_sampleCount; ++i ) {
+        if ( sampleSlot(m_samples.at(i)) == slot )
+            counters.samples++;
+    }
+
+    return counters;
+}
+
+int Profiler::sampleSlot(const Sample & sample) const
+{
+    int recorded = qMin(qMin(sample.depth, m_frames.size()), MaxSampleDepth);
+
+    if ( recorded == 0 || sample.depth > m_frames.size() )
+        return -1;
+
+    return m_sampleSlots.at(sample.offset + recorded - 1);
+}
+
+bool Profiler::startSampling()
+{
+    // Allocated once, the signal handler only fills them
+    if ( m_samples.isEmpty() ) {
+        m_samples.resize(MaxSamples);
+        m_sampleSlots.resize(MaxSamples * MaxSampleDepth);
+    }
+
+    m_sampleData = m_samples.data();
+    m_sampleSlotData = m_sampleSlots.data();
+    m_frameData = m_frames.constData();
+
+    m_heap->setCodeMapEnabled(true);
+
+    if ( !SamplingSignal::start(this, m_samplingInterval) ) {
+        m_heap->setCodeMapEnabled(false);
+        return false;
+    }
+
+    return true;
+}
+
+void Profiler::stopSampling()
+{
+    SamplingSignal::stop();
+    resolveSamples();
+}
+
+void Profiler::takeSample(quintptr pc)
+{
+    int index = m_sampleCount;
+
+    if ( index >= m_samples.size() ) {
+        m_droppedSamples = m_droppedSamples + 1;
+        return;
+    }
+
+    int depth = m_depth;
+    std::atomic_signal_fence(std::memory_order_acquire);
+
+    int recorded = qMin(qMin(depth, m_frames.size()), MaxSampleDepth);
+    int first = qMin(depth, m_frames.size()) - recorded;
+
+    Sample * sample = m_sampleData + index;
+    sample->pc = pc;
+    sample->depth = depth;
+    sample->offset = index * MaxSampleDepth;
+
+    int * slots = m_sampleSlotData + sample->offset;
+    const Frame * frames = m_frameData;
+
+    for ( int i = 0; i < recorded; ++i ) {
+        slots[i] = frames[first + i].slot;
+    }
+
+    m_sampleCount = index + 1;
+}
+
+void Profiler::resolveSamples()
+{
+    for ( int i = m_sampleCode.size(); i < m_sampleCount; ++i ) {
+        m_sampleCode.append(sampleCode(i));
+    }
+}
+
+Profiler::SampleCode Profiler::sampleCode(int index) const
+{
+    if ( index < m_sampleCode.size() )
+        return m_sampleCode.at(index);
+
+    SampleCode sampleCode;
+    sampleCode.line = 0;
+
+    quintptr pc = m_samples.at(index).pc;
+    CodeDescription code;
+
+    if ( pc && m_heap->findCode(pc, &code) ) {
+        sampleCode.name = code.name;
+        sampleCode.line = code.line(pc);
+    }
+
+    return sampleCode;
+}
+
+QStringList Profiler::sampleStack(int index, quint32 * line) const
+{
+    const Sample & sample = m_samples.at(index);
+
+    QStringList stack;
+    int recorded = qMin(qMin(sample.depth, m_frames.size()), MaxSampleDepth);
+
+    if ( recorded < sample.depth )
+        stack.append("...");
+
+    for ( int i = 0; i < recorded; ++i ) {
+        stack.append(m_functionNames.value(m_sampleSlots.at(sample.offset + i)));
+    }
+
+    // Native code names the innermost function even before it told the
+    // profiler about its call, like bridges
+    SampleCode code = sampleCode(index);
+
+    if ( !code.name.isEmpty() && ( stack.isEmpty() || stack.last() != code.name ) )
+        stack.append(code.name);
+
+    *line = code.line;
+
+    if ( stack.isEmpty() )
+        stack.append("<host>");
+
+    return stack;
+}
+
+QByteArray Profiler::toJson() const
+{
+    QJsonObject profile;
+    profile.insert("cycleUnit", CycleUnit);
+    profile.insert("samplingInterval", m_samplingInterval);
+    profile.insert("samples", int(m_sampleCount));
+    profile.insert("droppedSamples", int(m_droppedSamples));
+
+    QVector<quint64> samples(m_counters.size(), 0);
+    QHash<QString, int> lineSamples;
+
+    for ( int i = 0; i < m_sampleCount; ++i ) {
+        const Sample & sample = m_samples.at(i);
+        int slot = sampleSlot(sample);
+
+        if ( slot >= 0 )
+            samples[slot]++;
+
+        quint32 line;
+        QStringList stack = sampleStack(i, &line);
+
+        if ( line )
+            lineSamples[stack.last() + ":" + QString::number(line)]++;
+    }
+
+    QJsonArray functions;
+
+    for ( int slot = 0; slot < m_counters.size(); ++slot ) {
+        const FunctionCounters & counters = m_counters.at(slot);
+
+        if ( counters.calls == 0 && samples.at(slot) == 0 )
+            continue;
+
+        QJsonObject function;
+        function.insert("name", m_functionNames.value(slot));
+        function.insert("calls", qint64(counters.calls));
+        function.insert("inclusiveCycles", qint64(counters.inclusiveCycles));
+        function.insert("exclusiveCycles", qint64(counters.exclusiveCycles));
+        function.insert("samples", qint64(samples.at(slot)));
+
+        functions.append(function);
+    }
+
+    profile.insert("functions", functions);
+
+    QList<QString> lineKeys = lineSamples.keys();
+    std::sort(lineKeys.begin(), lineKeys.end());
+
+    QJsonArray lines;
+
+    for ( const QString & key : lineKeys ) {
+        int separator = key.lastIndexOf(':');
+
+        QJsonObject line;
+        line.insert("function", key.left(separator));
+        line.insert("line", key.mid(separator + 1).toInt());
+        line.insert("samples", lineSamples.value(key));
+
+        lines.append(line);
+    }
+
+    profile.insert("lines", lines);
+
+    return QJsonDocument(profile).toJson();
+}
+
+QByteArray Profiler::toCollapsedStacks() const
+{
+    QHash<QString, int> stacks;
+
+    for ( int i = 0; i < m_sampleCount; ++i ) {
+        quint32 line;
+        QStringList stack = sampleStack(i, &line);
+
+        if ( line )
+            stack.last() += ":" + QString::number(line);
+
+        stacks[stack.join(";")]++;
+    }
+
+    QList<QString> keys = stacks.keys();
+    std::sort(keys.begin(), keys.end());
+
+    QByteArray collapsed;
+
+    for ( const QString & key : keys ) {
+        collapsed.append(key.toUtf8());
+        collapsed.append(' ');
+        collapsed.append(QByteArray::number(stacks.value(key)));
+        collapsed.append('\n');
+    }
+
+    return collapsed;
+}
+
+quint64 Profiler::clockNanoseconds()
+{
+    static QElapsedTimer clock;
+
+    if ( !clock.isValid() )
+        clock.start();
+
+    return quint64(clock.nsecsElapsed());
+}
@@ -0,0 +1,225 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+#include <QtCore/qglobal.h>
+
+#include <atomic>
+
+#if defined(Q_PROCESSOR_X86) && defined(Q_CC_MSVC)
+#include <intrin.h>
+#elif defined(Q_PROCESSOR_X86) && defined(Q_CC_GNU)
+#include <x86intrin.h>
+#endif
+
+class CodeHeap;
+
+///////////////////////////////////////////
+///
+/// Profile of the functions of a program. The interpreter and
+/// instrumented native code report every call and return, so there
+/// is a stack of the running functions. Counting measures the time
+/// of every call, sampling records that stack on every SIGPROF.
+///
+/// Everything but the dumps has to be used by the thread which runs
+/// the program.
+///
+
+class Profiler
+{
+public:
+    enum Mode {
+        Counting = 0x1,
+        Sampling = 0x2
+    };
+
+    struct FunctionCounters {
+        quint64 calls;
+
+        // Recursive calls only count once for the inclusive cycles
+        quint64 inclusiveCycles;
+        quint64 exclusiveCycles;
+
+        // Samples taken while the function was on top of the stack
+        quint64 samples;
+    };
+
+    explicit Profiler(CodeHeap * heap);
+    ~Profiler();
+
+    // Nothing is recorded without a mode
+    void setMode(int mode);
+    int mode() const { return m_mode; }
+    bool isActive() const { return m_mode != 0; }
+
+    // Time between two samples
+    void setSamplingInterval(int microseconds) { m_samplingInterval = microseconds; }
+    int samplingInterval() const { return m_samplingInterval; }
+
+    // Functions by slot, existing counters are kept if the slots stay
+    void setFunctionNames(const QStringList & names);
+
+    // Forgets all counters and samples
+    void clear();
+
+    // Looks up the native code of the samples taken so far, before the
+    // code is released
+    void resolveSamples();
+
+    // All functions returned, like after a failed call
+    void unwind() {
+        m_depth = 0;
+        m_activeCalls.fill(0);
+    }
+
+    inline void enter(int slot);
+    inline void exit();
+
+    FunctionCounters counters(int slot) const;
+
+    // Counters, samples and sampled source lines
+    QByteArray toJson() const;
+
+    // Sampled stacks in the format of flame graph tools, the line is
+    // added to the innermost function if the code knows it
+    QByteArray toCollapsedStacks() const;
+
+    // Time stamp counter where there is one, nanoseconds otherwise
+    static inline quint64 cycles();
+
+private:
+    Q_DISABLE_COPY(Profiler)
+
+    struct Frame {
+        int slot;
+        quint64 start;
+
+        // Inclusive cycles of the called functions
+        quint64 children;
+    };
+
+    struct Sample {
+        quintptr pc;
+
+        // Innermost slots in the stack buffer, depth can be more
+        int depth;
+        int offset;
+    };
+
+    // Native code a sample was taken in, the name is empty if there
+    // was none
+    struct SampleCode {
+        QString name;
+        quint32 line;
+    };
+
+    SampleCode sampleCode(int index) const;
+
+    // Frame names of a sample from the outermost to the innermost one
+    QStringList sampleStack(int index, quint32 * line) const;
+
+    // Innermost function of the sample, -1 if it wasn't recorded
+    int sampleSlot(const Sample & sample) const;
+
+    friend class SamplingSignal;
+
+    bool startSampling();
+    void stopSampling();
+
+    // Called by the signal handler, nothing may allocate or lock
+    void takeSample(quintptr pc);
+
+    static quint64 clockNanoseconds();
+
+    CodeHeap * m_heap;
+    int m_mode;
+    int m_samplingInterval;
+
+    QStringList m_functionNames;
+    QVector<FunctionCounters> m_counters;
+
+    // Calls of every function which didn't return yet
+    QVector<int> m_activeCalls;
+
+    // Written by calls and read by the signal handler
+    QVector<Frame> m_frames;
+    volatile int m_depth;
+
+    // Filled by the signal handler, the buffers never grow
+    QVector<Sample> m_samples;
+    QVector<int> m_sampleSlots;
+    volatile int m_sampleCount;
+    volatile int m_droppedSamples;
+
+    // Data of the buffers, the signal handler can't call the non const
+    // members of the vectors
+    Sample * m_sampleData;
+    int * m_sampleSlotData;
+    const Frame * m_frameData;
+
+    // Of the first samples
+    QVector<SampleCode> m_sampleCode;
+};
+
+quint64 Profiler::cycles()
+{
+#if defined(Q_PROCESSOR_X86) && ( defined(Q_CC_MSVC) || defined(Q_CC_GNU) )
+    return __rdtsc();
+#else
+    return clockNanoseconds();
+#endif
+}
+
+void Profiler::enter(int slot)
+{
+    m_counters[slot].calls++;
+
+    // Deeper frames are only counted
+    if ( m_depth < m_frames.size() ) {
+        m_activeCalls[slot]++;
+
+        Frame & frame = m_frames[m_depth];
+        frame.slot = slot;
+        frame.start = ( m_mode & Counting ) ? cycles() : 0;
+        frame.children = 0;
+    }
+
+    // Samples see the frame once it is complete, the signal handler runs
+    // on this thread so a compiler fence suffices
+    std::atomic_signal_fence(std::memory_order_release);
+    m_depth = m_depth + 1;
+}
+
+void Profiler::exit()
+{
+    if ( m_depth == 0 )
+        return;
+
+    m_depth = m_depth - 1;
+
+    if ( m_depth >= m_frames.size() )
+        return;
+
+    const Frame & frame = m_frames.at(m_depth);
+    FunctionCounters & counters = m_counters[frame.slot];
+
+    m_activeCalls[frame.slot]--;
+
+    if ( !( m_mode & Counting ) )
+        return;
+
+    quint64 elapsed = cycles() - frame.start;
+
+    if ( m_activeCalls.at(frame.slot) == 0 )
+        counters.inclusiveCycles += elapsed;
+
+    counters.exclusiveCycles += elapsed - frame.children;
+
+    if ( m_depth > 0 )
+        m_frames[m_depth - 1].children += elapsed;
+}
+
+#endif // PROFILER_H
@@ -0,0 +1,234 @@
+#include "project.h"
+#include "parser.h"
+#include "flattree.h"
+
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QRunnable>
+
+///////////////////////////////////////////
+///
+/// Parses one module on the thread pool
+///
+
+class ParseTask : public QRunnable
+{
+public:
+    ParseTask(Project * project, Module * module) :
+        m_project(project),
+        m_module(module)
+    {
+    }
+
+    void run() {
+        ModuleCache * cache = m_project->m_cache.data();
+
+        if ( cache ) {
+            loadCached(cache);
+        }
+        else {
+            Parser parser(m_module->fileName);
+            m_module->tree = parser.parse();
+        }
+
+        m_project->moduleParsed(m_module);
+    }
+
+private:
+    void loadCached(ModuleCache * cache) {
+        QFile file(m_module->fileName);
+
+        if ( !file.open(QIODevice::ReadOnly) ) {
+            qDebug() << "Could not open module: " << m_module->fileName;
+            m_module->tree = QSharedPointer<SyntaxTree>::create();
+            return;
+        }
+
+        // The source is only needed for the key if the module is cached
+        qint64 size = file.size();
+        uchar * mapped = size > 0 ? file.map(0, size) : 0;
+
+        QByteArray source = mapped ?
+                    QByteArray::fromRawData(reinterpret_cast<const char *>(mapped), int(size)) :
+                    file.readAll();
+
+        QByteArray key = ModuleCache::sourceKey(source);
+
+        m_module->tree = cache->load(key);
+        m_module->fromCache = !m_module->tree.isNull();
+
+        if ( !m_module->fromCache ) {
+            Parser parser(m_module->fileName);
+            parser.setSource(source);
+            m_module->tree = parser.parse();
+
+            if ( !cache->store(key, FlatTree::fromExpressions(m_module->tree->expressions())) ) {
+                qDebug() << "Could not write cache for module: " << m_module->fileName;
+            }
+        }
+
+        if ( mapped ) {
+            file.unmap(mapped);
+        }
+    }
+
+    Project * m_project;
+    Module * m_module;
+};
+
+
+// Every spelling of a path, like ./a.hound or a symlink to it, names
+// the same module
+QString getModuleFileName(const QString & fileName) {
+    QFileInfo info(fileName);
+    QString canonical = info.canonicalFilePath();
+
+    return canonical.isEmpty() ? info.absoluteFilePath() : canonical;
+}
+
+Project::Project(QObject *parent) : QObject(parent)
+{
+}
+
+Project::~Project()
+{
+    m_pool.waitForDone();
+    clear();
+}
+
+void Project::setCacheDirectory(const QString & directory)
+{
+    if ( directory.isEmpty() )
+        m_cache.reset();
+    else
+        m_cache.reset(new ModuleCache(directory));
+}
+
+void Project::addSearchPath(const QString & path)
+{
+    m_searchPaths.append(path);
+}
+
+bool Project::load(const QString & mainFile)
+{
+    clear();
+
+    if ( !QFileInfo(mainFile).exists() ) {
+        qDebug() << "Main file doesn't exist: " << mainFile;
+        return false;
+    }
+
+    m_searchPaths.prepend(QFileInfo(mainFile).absolutePath());
+
+    // Every parsed module schedules its imports, so the pool is only
+    // done when the whole import graph is parsed
+    schedule(mainFile);
+    m_pool.waitForDone();
+
+    m_searchPaths.removeFirst();
+
+    QSet<Module *> visited;
+    sortModule(m_modules.value(getModuleFileName(mainFile)), visited);
+
+    for ( Module * module : m_order ) {
+        for ( Expression * expr : module->tree->expressions() ) {
+            m_expressions.append(expr);
+        }
+    }
+
+    return true;
+}
+
+void Project::schedule(const QString & path)
+{
+    QString fileName = getModuleFileName(path);
+    Module * module;
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        if ( m_modules.contains(fileName) )
+            return;
+
+        module = new Module;
+        module->fileName = fileName;
+        module->package = NoSymbol;
+        module->fromCache = false;
+
+        m_modules.insert(fileName, module);
+    }
+
+    m_pool.start(new ParseTask(this, module));
+}
+
+void Project::moduleParsed(Module * module)
+{
+    // Profilers and debuggers find the source through the functions
+    Symbol file = SymbolTable::global().intern(module->fileName);
+
+    for ( Expression * expr : module->tree->expressions() ) {
+
+        if ( expr->isPackage() ) {
+            module->package = static_cast<PackageExpression *>(expr)->pathSymbol();
+        }
+        else if ( expr->isFunction() ) {
+            static_cast<FunctionExpression *>(expr)->setFile(file);
+        }
+        else if ( expr->isImport() ) {
+            QString path = static_cast<ImportExpression *>(expr)->path();
+            QString fileName = resolveImport(path);
+
+            if ( fileName.isEmpty() ) {
+                qDebug() << "Could not find module for import: " << path;
+                continue;
+            }
+
+            module->imports.append(getModuleFileName(fileName));
+            schedule(fileName);
+        }
+    }
+}
+
+QString Project::resolveImport(const QString & path) const
+{
+    QStringList parts = path.split('.');
+
+    // The last parts can name something inside of the module
+    while ( !parts.isEmpty() ) {
+        QString relativePath = parts.join('/') + ".hound";
+
+        for ( const QString & searchPath : m_searchPaths ) {
+            QString fileName = QDir(searchPath).filePath(relativePath);
+
+            if ( QFileInfo(fileName).exists() )
+                return fileName;
+        }
+
+        parts.removeLast();
+    }
+
+    return QString();
+}
+
+void Project::sortModule(Module * module, QSet<Module *> & visited)
+{
+    if ( !module || visited.contains(module) )
+        return;
+
+    visited.insert(module);
+
+    for ( const QString & import : module->imports ) {
+        sortModule(m_modules.value(import), visited);
+    }
+
+    m_order.append(module);
+}
+
+void Project::clear()
+{
+    qDeleteAll(m_modules);
+    m_modules.clear();
+    m_order.clear();
+    m_expressions.clear();
+}
@@ -0,0 +1,92 @@
+#ifndef PROJECT_H
+#define PROJECT_H
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QScopedPointer>
+#include <QtCore/QSet>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QStringList>
+#include <QtCore/QThreadPool>
+#include <QtCore/QVector>
+#include <QtCore/qglobal.h>
+
+#include "expression.h"
+#include "modulecache.h"
+
+struct Module {
+    QString fileName;
+
+    // Declared package, NoSymbol if there is none
+    Symbol package;
+
+    QSharedPointer<SyntaxTree> tree;
+
+    // Files of the imported modules
+    QStringList imports;
+
+    // Loaded from a .houndc file instead of parsed
+    bool fromCache;
+};
+
+///////////////////////////////////////////
+///
+/// Front end for a whole program. Starting from the main file all
+/// imported modules are resolved to files and parsed in parallel, the
+/// results are merged into one list of top level expressions.
+///
+/// An import like hound.std.sys.process.fork is looked up as
+/// hound/std/sys/process/fork.hound and then as hound/std/sys/process.hound
+/// in every search path.
+///
+
+class Project : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Project(QObject *parent = 0);
+    ~Project();
+
+    // Parsed modules are cached there, no caching if empty
+    void setCacheDirectory(const QString & directory);
+
+    // The directory of the main file is always searched first
+    void addSearchPath(const QString & path);
+
+    // Parses the main file and everything it imports
+    bool load(const QString & mainFile);
+
+    // Modules in dependency order, the main module is the last one
+    QList<Module *> modules() const { return m_order; }
+
+    // Top level expressions of all modules in dependency order
+    ExpressionList expressions() const {
+        return ExpressionList(m_expressions.constData(), m_expressions.size());
+    }
+
+private:
+    friend class ParseTask;
+
+    // Modules are keyed by their canonical file name
+    void schedule(const QString & path);
+    void moduleParsed(Module * module);
+
+    QString resolveImport(const QString & path) const;
+    void sortModule(Module * module, QSet<Module *> & visited);
+    void clear();
+
+    QStringList m_searchPaths;
+    QScopedPointer<ModuleCache> m_cache;
+    QThreadPool m_pool;
+
+    // Guards the modules while parsing
+    QMutex m_mutex;
+    QHash<QString, Module *> m_modules;
+
+    QList<Module *> m_order;
+    QVector<Expression *> m_expressions;
+};
+
+#endif // PROJECT_H
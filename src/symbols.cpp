@@ -0,0 +1,81 @@
+#include "symbols.h"
+
+SymbolTable::SymbolTable()
+{
+    // Symbol 0 stays empty
+    m_texts.append(QByteArray());
+}
+
+SymbolTable & SymbolTable::global()
+{
+    static SymbolTable table;
+    return table;
+}
+
+Symbol SymbolTable::intern(QLatin1String text)
+{
+    if ( text.size() == 0 )
+        return NoSymbol;
+
+    // Most identifiers are already known, the key only wraps the source
+    QByteArray key = QByteArray::fromRawData(text.data(), text.size());
+
+    {
+        QReadLocker locker(&m_lock);
+
+        Symbol symbol = m_symbols.value(key, NoSymbol);
+
+        if ( symbol != NoSymbol )
+            return symbol;
+    }
+
+    QWriteLocker locker(&m_lock);
+
+    // Somebody else could have been faster
+    Symbol symbol = m_symbols.value(key, NoSymbol);
+
+    if ( symbol == NoSymbol ) {
+        // The table outlives the source buffer
+        QByteArray ownedKey(text.data(), text.size());
+
+        symbol = Symbol(m_texts.size());
+        m_texts.append(ownedKey);
+        m_symbols.insert(ownedKey, symbol);
+    }
+
+    return symbol;
+}
+
+Symbol SymbolTable::intern(const QString & text)
+{
+    QByteArray utf8 = text.toUtf8();
+    return intern(QLatin1String(utf8.constData(), utf8.size()));
+}
+
+Symbol SymbolTable::lookup(QLatin1String text) const
+{
+    QReadLocker locker(&m_lock);
+    return m_symbols.value(QByteArray::fromRawData(text.data(), text.size()), NoSymbol);
+}
+
+Symbol SymbolTable::lookup(const QString & text) const
+{
+    QByteArray utf8 = text.toUtf8();
+    return lookup(QLatin1String(utf8.constData(), utf8.size()));
+}
+
+QByteArray SymbolTable::text(Symbol symbol) const
+{
+    QReadLocker locker(&m_lock);
+
+    if ( symbol >= Symbol(m_texts.size()) )
+        return QByteArray();
+
+    return m_texts.at(symbol);
+}
+
+int SymbolTable::size() const
+{
+    QReadLocker locker(&m_lock);
+    return m_texts.size();
+}
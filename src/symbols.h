@@ -0,0 +1,52 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QLatin1String>
+#include <QtCore/QReadWriteLock>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtCore/qglobal.h>
+
+// Compact id of an interned identifier or path, 0 is no symbol
+typedef quint32 Symbol;
+
+const Symbol NoSymbol = 0;
+
+///////////////////////////////////////////
+///
+/// Maps every identifier, package and import path to a symbol. The
+/// table is shared by all parsers, symbols are dense and can be used
+/// as indices by the later stages.
+///
+
+class SymbolTable
+{
+public:
+    static SymbolTable & global();
+
+    // Returns the existing symbol or creates a new one
+    Symbol intern(QLatin1String text);
+    Symbol intern(const QString & text);
+
+    // Returns NoSymbol instead of creating one
+    Symbol lookup(QLatin1String text) const;
+    Symbol lookup(const QString & text) const;
+
+    QByteArray text(Symbol symbol) const;
+    QString name(Symbol symbol) const { return QString::fromUtf8(text(symbol)); }
+
+    // All symbols are smaller than the size
+    int size() const;
+
+private:
+    SymbolTable();
+    Q_DISABLE_COPY(SymbolTable)
+
+    mutable QReadWriteLock m_lock;
+    QHash<QByteArray, Symbol> m_symbols;
+    QVector<QByteArray> m_texts;
+};
+
+#endif // SYMBOLS_H
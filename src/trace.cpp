@@ -0,0 +1,69 @@
+#include "trace.h"
+
+#include <QtCore/QList>
+
+static const char * const CategoryNames[] = { "parser" };
+
+static const char * const LevelNames[] = { "off", "info", "verbose" };
+
+static const char * const ConfigurationVariable = "HOUND_TRACE";
+
+QAtomicInt Tracing::s_levels[int(TraceCategory::CategoryCount)];
+
+bool Tracing::configure(const QByteArray & configuration)
+{
+    bool ok = true;
+
+    for ( const QByteArray & entry : configuration.split(',') ) {
+        QByteArray name = entry.trimmed();
+        QByteArray levelName = "verbose";
+
+        if ( name.isEmpty() )
+            continue;
+
+        int separator = name.indexOf('=');
+
+        if ( separator >= 0 ) {
+            levelName = name.mid(separator + 1).trimmed();
+            name = name.left(separator).trimmed();
+        }
+
+        int category = -1;
+        int level = -1;
+
+        for ( int i = 0; i < int(TraceCategory::CategoryCount); ++i ) {
+            if ( name == CategoryNames[i] )
+                category = i;
+        }
+
+        for ( int i = 0; i <= int(TraceLevel::Verbose); ++i ) {
+            if ( levelName == LevelNames[i] )
+                level = i;
+        }
+
+        if ( category < 0 || level < 0 ) {
+            qDebug() << "Unknown trace category or level: " << entry;
+            ok = false;
+            continue;
+        }
+
+        setLevel(TraceCategory(category), TraceLevel(level));
+    }
+
+    return ok;
+}
+
+QDebug Tracing::message(TraceCategory category)
+{
+    QDebug debug = qDebug();
+    debug.nospace() << CategoryNames[int(category)] << ":";
+
+    return debug.space();
+}
+
+// Levels are set before any trace point can run
+static bool configureFromEnvironment() {
+    return Tracing::configure(qgetenv(ConfigurationVariable));
+}
+
+static const bool configuredFromEnvironment = configureFromEnvironment();
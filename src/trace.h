@@ -0,0 +1,74 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QDebug>
+#include <QtCore/qglobal.h>
+
+enum class TraceCategory {
+    Parser,
+
+    CategoryCount
+};
+
+enum class TraceLevel {
+    Off,
+    // Once per top level expression
+    Info,
+    // Every construct, like operators and blocks
+    Verbose
+};
+
+// Bit of every category whose trace points are compiled in. Debug builds
+// have all of them, release builds none unless they are defined, like
+// DEFINES += HOUND_TRACE_CATEGORIES=0x1 for the parser ones.
+#ifndef HOUND_TRACE_CATEGORIES
+#  if defined(QT_NO_DEBUG)
+#    define HOUND_TRACE_CATEGORIES 0
+#  else
+#    define HOUND_TRACE_CATEGORIES 0xffffffff
+#  endif
+#endif
+
+///////////////////////////////////////////
+///
+/// Levels of the compiled in categories, all of them are off until they
+/// are set. HOUND_TRACE sets them at start, like "parser" for all trace
+/// points of the parser or "parser=info" for the ones of a level.
+///
+
+class Tracing
+{
+public:
+    static bool isCompiledIn(TraceCategory category) {
+        return ( quint32(HOUND_TRACE_CATEGORIES) >> int(category) ) & 1;
+    }
+
+    static bool isEnabled(TraceCategory category, TraceLevel level) {
+        return s_levels[int(category)].load() >= int(level);
+    }
+
+    static void setLevel(TraceCategory category, TraceLevel level) {
+        s_levels[int(category)].store(int(level));
+    }
+
+    // Parses the value of HOUND_TRACE, returns false for unknown names
+    static bool configure(const QByteArray & configuration);
+
+    static QDebug message(TraceCategory category);
+
+private:
+    static QAtomicInt s_levels[int(TraceCategory::CategoryCount)];
+};
+
+// Starts a trace message. Nothing after it is evaluated unless the trace
+// point is compiled in and enabled, so messages cost nothing while they
+// are off and the whole statement is gone in builds without the category.
+//
+//     HOUND_TRACE(Parser, Verbose) << "Block: " << block->toString();
+#define HOUND_TRACE(category, level) \
+    if ( !( Tracing::isCompiledIn(TraceCategory::category) && \
+            Tracing::isEnabled(TraceCategory::category, TraceLevel::level) ) ) {} \
+    else Tracing::message(TraceCategory::category)
+
+#endif // TRACE_H
@@ -0,0 +1,342 @@
+#include "typeinference.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QHash>
+
+struct InferenceData {
+    // All functions of the program, indexed by their slot
+    QVector<FunctionExpression *> functions;
+    QHash<Symbol, int> functionSlots;
+
+    // Types found so far, indexed by slot. NoDataType until something
+    // is known about the value.
+    QVector<QVector<DataType> > parameterTypes;
+    QVector<DataType> returnTypes;
+
+    // Function which is inferred at the moment, -1 for the top level
+    // expressions, and its parameter indexes by symbol
+    int slot;
+    QHash<Symbol, int> parameters;
+
+    // Set whenever a type widens, inference runs until it stays unset
+    bool changed;
+    bool failed;
+};
+
+int getNumberRank(DataType type) {
+    switch ( type )
+    {
+    case DataType::Int8:   return 1;
+    case DataType::Int16:  return 2;
+    case DataType::Int32:  return 3;
+    case DataType::Int64:  return 4;
+    case DataType::Float:  return 5;
+    case DataType::Double: return 6;
+    default:               return 0;
+    }
+}
+
+DataType joinDataTypes(DataType first, DataType second, bool * conflict) {
+    *conflict = false;
+
+    if ( first == DataType::NoDataType || first == second )
+        return second;
+    if ( second == DataType::NoDataType )
+        return first;
+
+    int firstRank = getNumberRank(first);
+    int secondRank = getNumberRank(second);
+
+    if ( firstRank == 0 || secondRank == 0 ) {
+        *conflict = true;
+        return first;
+    }
+
+    return firstRank > secondRank ? first : second;
+}
+
+// Join of two types, fails on incompatible types
+DataType joinTypes(InferenceData * data, DataType first, DataType second, const QString & context) {
+    bool conflict;
+    DataType joined = joinDataTypes(first, second, &conflict);
+
+    if ( conflict ) {
+        qDebug() << "Polymorphic types are not supported: " << context << " is"
+                 << getDataTypeName(first) << "and" << getDataTypeName(second);
+        data->failed = true;
+    }
+
+    return joined;
+}
+
+// Widens a type the next round depends on
+void widenType(InferenceData * data, DataType * type, DataType other, const QString & context) {
+    DataType joined = joinTypes(data, *type, other, context);
+
+    if ( joined != *type ) {
+        *type = joined;
+        data->changed = true;
+    }
+}
+
+DataType inferExpr(InferenceData * data, Expression * expr);
+
+DataType inferVariableExpr(InferenceData * data, VariableExpression * expr) {
+    int index = data->parameters.value(expr->symbol(), -1);
+
+    // Unknown variables are reported by the compilers
+    if ( index < 0 || data->slot < 0 ) {
+        return DataType::NoDataType;
+    }
+
+    DataType type = data->parameterTypes.at(data->slot).at(index);
+    expr->setDataType(type);
+
+    return type;
+}
+
+DataType inferBinaryExpr(InferenceData * data, BinaryExpression * expr) {
+    DataType left = inferExpr(data, expr->leftExpression());
+    DataType right = inferExpr(data, expr->rightExpression());
+
+    // Mixed operands are computed as floats. An operand which isn't known
+    // yet doesn't change the type, the next round sees it.
+    DataType operandType;
+    DataType type;
+
+    switch ( expr->theOperator() )
+    {
+    case LanguageOperator::AndOperator:
+    case LanguageOperator::OrOperator:
+    case LanguageOperator::XorOperator:
+        operandType = joinTypes(data, left, right, "Operands of a logical operator");
+
+        // Types only widen, a float stays one
+        if ( operandType != DataType::NoDataType && operandType != DataType::Int32 ) {
+            qDebug() << "Logical operators need integers";
+            data->failed = true;
+        }
+
+        type = DataType::Int32;
+        break;
+
+    // Comparisons are 0 or 1
+    case LanguageOperator::LessOperator:
+    case LanguageOperator::GreaterOperator:
+        operandType = joinTypes(data, left, right, "Operands of a comparison");
+        type = DataType::Int32;
+        break;
+
+    default:
+        operandType = joinTypes(data, left, right, "Operands of a calculation");
+        type = operandType;
+        break;
+    }
+
+    expr->setOperandType(operandType);
+    expr->setDataType(type);
+
+    return type;
+}
+
+DataType inferIfExpr(InferenceData * data, IfExpression * ifExpr, ElseExpression * elseExpr) {
+    inferExpr(data, ifExpr->condition());
+
+    // Without else the value is 0 of the type of the if
+    DataType type = inferExpr(data, ifExpr->block());
+
+    if ( elseExpr ) {
+        type = joinTypes(data, type, inferExpr(data, elseExpr->block()), "Value of if and else");
+    }
+
+    ifExpr->setDataType(type);
+
+    return type;
+}
+
+DataType inferCodeBlockExpr(InferenceData * data, CodeBlockExpression * expr) {
+    ExpressionList expressions = expr->expressions();
+    DataType type = DataType::Int32;
+
+    // The value of a block is the value of its last expression
+    for ( int i = 0; i < expressions.size(); ++i ) {
+        Expression * codeExpr = expressions.at(i);
+
+        if ( codeExpr->isComment() || codeExpr->isElse() ) {
+            continue;
+        }
+
+        if ( codeExpr->isIf() ) {
+            IfExpression * ifExpr = static_cast<IfExpression *>(codeExpr);
+            type = inferIfExpr(data, ifExpr, takeElse(expressions, &i));
+        }
+        else {
+            type = inferExpr(data, codeExpr);
+        }
+    }
+
+    return type;
+}
+
+DataType inferFunctionInvokationExpr(InferenceData * data, FunctionInvokationExpression * expr) {
+    int slot = data->functionSlots.value(expr->functionSymbol(), -1);
+    ExpressionList parameters = expr->parameters();
+
+    // Wrong calls are reported by the compilers
+    if ( slot < 0 || parameters.size() != data->parameterTypes.at(slot).size() ) {
+        return DataType::NoDataType;
+    }
+
+    for ( int i = 0; i < parameters.size(); ++i ) {
+        DataType argument = inferExpr(data, parameters.at(i));
+
+        widenType(data, &data->parameterTypes[slot][i], argument,
+                  "Parameter " + QString::number(i + 1) + " of " + expr->functionName());
+    }
+
+    return data->returnTypes.at(slot);
+}
+
+DataType inferExpr(InferenceData * data, Expression * expr) {
+
+    if ( !expr ) {
+        return DataType::NoDataType;
+    }
+
+    switch ( expr->type() )
+    {
+    case ExpressionType::RawData:
+        return static_cast<RawDataExpression *>(expr)->dataType();
+
+    case ExpressionType::Variable:
+        return inferVariableExpr(data, static_cast<VariableExpression *>(expr));
+
+    case ExpressionType::BinaryExpr:
+        return inferBinaryExpr(data, static_cast<BinaryExpression *>(expr));
+
+    case ExpressionType::CodeBlock:
+        return inferCodeBlockExpr(data, static_cast<CodeBlockExpression *>(expr));
+
+    case ExpressionType::FunctionInvokation:
+        return inferFunctionInvokationExpr(data, static_cast<FunctionInvokationExpression *>(expr));
+
+    case ExpressionType::If:
+        return inferIfExpr(data, static_cast<IfExpression *>(expr), 0);
+
+    default:
+        break;
+    }
+
+    return DataType::NoDataType;
+}
+
+void inferFunction(InferenceData * data, int slot) {
+    FunctionExpression * function = data->functions.at(slot);
+    ExpressionList parameters = function->parameters();
+
+    data->slot = slot;
+    data->parameters.clear();
+
+    for ( int i = 0; i < parameters.size(); ++i ) {
+        VariableExpression * param = static_cast<VariableExpression *>( parameters.at(i) );
+
+        data->parameters.insert(param->symbol(), i);
+        param->setDataType(data->parameterTypes.at(slot).at(i));
+    }
+
+    DataType result = inferExpr(data, function->code());
+
+    widenType(data, &data->returnTypes[slot], result, "Result of " + function->name());
+    function->setReturnType(data->returnTypes.at(slot));
+}
+
+// One round over all functions and the top level expressions
+void inferProgram(InferenceData * data, const QList<Expression *> & entryExpressions) {
+    for ( int slot = 0; slot < data->functions.size(); ++slot ) {
+        inferFunction(data, slot);
+    }
+
+    data->slot = -1;
+    data->parameters.clear();
+
+    for ( Expression * expr : entryExpressions ) {
+        inferExpr(data, expr);
+    }
+}
+
+// Parameters nobody passes a value to are integers, so are results of
+// functions which never return a value. Returns false if all types are
+// known already.
+bool setDefaultTypes(InferenceData * data) {
+    bool parameterSet = false;
+
+    for ( QVector<DataType> & types : data->parameterTypes ) {
+        for ( DataType & type : types ) {
+            if ( type == DataType::NoDataType ) {
+                type = DataType::Int32;
+                parameterSet = true;
+            }
+        }
+    }
+
+    // Results may still change with the new parameter types
+    if ( parameterSet ) {
+        return true;
+    }
+
+    bool resultSet = false;
+
+    for ( DataType & type : data->returnTypes ) {
+        if ( type == DataType::NoDataType ) {
+            type = DataType::Int32;
+            resultSet = true;
+        }
+    }
+
+    return resultSet;
+}
+
+bool inferTypes(ExpressionList expressions, const ObservedTypes & observed) {
+    InferenceData data;
+    ProgramParts program;
+
+    if ( !splitProgram(expressions, &program) ) {
+        return false;
+    }
+
+    data.functions = program.functions;
+
+    for ( FunctionExpression * function : data.functions ) {
+        data.functionSlots.insert(function->symbol(), data.functionSlots.size());
+        data.parameterTypes.append(QVector<DataType>(function->parameters().size(), DataType::NoDataType));
+        data.returnTypes.append(DataType::NoDataType);
+    }
+
+    // Observed types are where the parameters start to widen from
+    for ( ObservedTypes::const_iterator it = observed.constBegin(); it != observed.constEnd(); ++it ) {
+        int slot = data.functionSlots.value(it.key(), -1);
+
+        if ( slot >= 0 && it.value().size() == data.parameterTypes.at(slot).size() ) {
+            data.parameterTypes[slot] = it.value();
+        }
+    }
+
+    data.failed = false;
+
+    // Types only widen and there are only a few of them, so this ends
+    do {
+        do {
+            data.changed = false;
+            inferProgram(&data, program.entryExpressions);
+
+            if ( data.failed ) {
+                return false;
+            }
+        } while ( data.changed );
+    } while ( setDefaultTypes(&data) );
+
+    // Writes the final types into the expressions
+    inferProgram(&data, program.entryExpressions);
+
+    return !data.failed;
+}
@@ -0,0 +1,19 @@
+#ifndef TYPEINFERENCE_H
+#define TYPEINFERENCE_H
+
+#include "expression.h"
+
+// Numbers widen to the bigger type, Int32 and Float become Float
+DataType joinDataTypes(DataType first, DataType second, bool * conflict);
+
+// Argument types seen at runtime, by function
+typedef QHash<Symbol, QVector<DataType> > ObservedTypes;
+
+// Sets the types of all parameters, variables, ifs and function results
+// of the program. Parameters get the join of the arguments of all calls
+// and of the observed types, parameters of functions which are never
+// called become Int32. Fails if a value would need more than one kind
+// of type, e.g. String and Int32.
+bool inferTypes(ExpressionList expressions, const ObservedTypes & observed = ObservedTypes());
+
+#endif // TYPEINFERENCE_H
@@ -0,0 +1,9 @@
+#ifndef VERSION_H
+#define VERSION_H
+
+// Set by the project file, everything cached on disk depends on it
+#ifndef HOUND_VERSION
+#define HOUND_VERSION "unknown"
+#endif
+
+#endif // VERSION_H
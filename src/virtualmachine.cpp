@@ -1,7 +1,707 @@
 #include "virtualmachine.h"
+#include "compiler.h"
 
-VirtualMachine::VirtualMachine(QObject *parent) : QObject(parent)
+#include <QtCore/QDebug>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QRunnable>
+#include <QtCore/QThread>
+
+#include <cmath>
+
+// Labels as values make every handler jump directly to the next one
+#if defined(__GNUC__)
+#define HOUND_COMPUTED_GOTO
+#endif
+
+static const int StackSize = 256 * 1024;
+static const int MaxCallDepth = 64 * 1024;
+
+static const int DefaultTierUpThreshold = 1000;
+
+///////////////////////////////////////////
+
+class CompileTask : public QRunnable
+{
+public:
+    CompileTask(VirtualMachine * machine, int slot) :
+        m_machine(machine),
+        m_slot(slot)
+    {
+        m_queued.start();
+    }
+
+    virtual void run() {
+        m_machine->compile(m_slot, m_queued);
+    }
+
+private:
+    VirtualMachine * m_machine;
+    int m_slot;
+    QElapsedTimer m_queued;
+};
+
+///////////////////////////////////////////
+
+VirtualMachine::VirtualMachine(QObject *parent) : QObject(parent),
+    m_profiler(&m_codeHeap),
+    m_tierUpThreshold(DefaultTierUpThreshold),
+    m_stackTop(0),
+    m_frameTop(0),
+    m_failed(false)
+{
+    // One core stays with the interpreter
+    setCompilerThreadCount(qBound(1, QThread::idealThreadCount() - 1, 4));
+
+    m_compilerStatistics = CompilerStatistics();
+}
+
+VirtualMachine::~VirtualMachine()
+{
+    waitForCompiler();
+}
+
+void VirtualMachine::setCompilerThreadCount(int count)
+{
+    m_compilerThreadCount = count;
+
+    if ( count > 0 ) {
+        m_compilerPool.setMaxThreadCount(count);
+    }
+}
+
+void VirtualMachine::waitForCompiler()
+{
+    m_compilerPool.waitForDone();
+}
+
+CompilerStatistics VirtualMachine::compilerStatistics() const
 {
+    QMutexLocker locker(&m_statisticsMutex);
+
+    CompilerStatistics statistics = m_compilerStatistics;
+    statistics.queueDepth = m_queueDepth.load();
+
+    return statistics;
+}
+
+bool VirtualMachine::load(ExpressionList expressions)
+{
+    // Nothing may be compiled for the old program anymore
+    waitForCompiler();
+    m_compiler.reset();
+
+    {
+        QMutexLocker locker(&m_statisticsMutex);
+        m_compilerStatistics = CompilerStatistics();
+    }
+
+    m_expressions = expressions;
+    m_observedTypes.clear();
+    m_profiles.clear();
+    m_profiler.clear();
+
+    return specialize(m_observedTypes);
+}
+
+bool VirtualMachine::specialize(const ObservedTypes & observed)
+{
+    // Native code is only valid for the old types
+    waitForCompiler();
+    m_profiler.resolveSamples();
+    m_compiler.reset();
+
+    if ( !inferTypes(m_expressions, observed) || !lowerProgram(m_expressions, &m_program) ) {
+        m_program = BytecodeProgram();
+        m_profiles.clear();
+        return false;
+    }
+
+    // Functions keep their counts, hot ones are compiled again with
+    // their next call
+    if ( m_profiles.size() == m_program.functions.size() ) {
+        for ( FunctionProfile & profile : m_profiles ) {
+            profile.nativeEntry = 0;
+            profile.state = FunctionProfile::Interpreted;
+        }
+    }
+    else {
+        FunctionProfile profile;
+        profile.calls = 0;
+        profile.backEdges = 0;
+        profile.nativeEntry = 0;
+        profile.state = FunctionProfile::Interpreted;
+
+        m_profiles.fill(profile, m_program.functions.size());
+    }
+
+    QStringList names;
+
+    for ( const BytecodeFunction & function : m_program.functions ) {
+        names.append(function.symbol == NoSymbol ? QString("<top level>") : SymbolTable::global().name(function.symbol));
+    }
+
+    m_profiler.setFunctionNames(names);
+
+    // Only collects the functions, nothing is compiled before it is hot
+    if ( m_tierUpThreshold >= 0 ) {
+        m_compiler.reset(new VmCompiler(this));
+        m_compiler->setInterpreterEntry(&VirtualMachine::enterFromNative, this);
+        m_compiler->setDivisionErrorEntry(&VirtualMachine::divisionErrorFromNative, this);
+        m_compiler->setCodeCacheDirectory(m_codeCacheDirectory);
+        m_compiler->setProfiler(m_profiler.isActive() ? &m_profiler : 0);
+
+        if ( !m_compiler->prepare(m_expressions) ) {
+            qDebug() << "Program can't be compiled, it is only interpreted";
+            m_compiler.reset();
+        }
+    }
+
+    return true;
+}
+
+bool VirtualMachine::deoptimize(int slot, const QVector<DataType> & types)
+{
+    const BytecodeFunction & function = m_program.functions.at(slot);
+
+    ObservedTypes observed = m_observedTypes;
+    QVector<DataType> & widened = observed[function.symbol];
+
+    widened = function.parameterTypes;
+
+    for ( int i = 0; i < types.size(); ++i ) {
+        bool conflict;
+        widened[i] = joinDataTypes(widened.at(i), types.at(i), &conflict);
+
+        if ( conflict ) {
+            qDebug() << "Polymorphic types are not supported: Parameter" << ( i + 1 ) << "of"
+                     << SymbolTable::global().name(function.symbol) << "is"
+                     << getDataTypeName(function.parameterTypes.at(i)) << "and" << getDataTypeName(types.at(i));
+            return false;
+        }
+    }
+
+    if ( !specialize(observed) ) {
+        // The old types worked before
+        specialize(m_observedTypes);
+        return false;
+    }
+
+    m_observedTypes = observed;
+
+    QMutexLocker locker(&m_statisticsMutex);
+    m_compilerStatistics.deoptimizations++;
+
+    return true;
+}
+
+void VirtualMachine::setProfilingMode(int mode)
+{
+    if ( mode == m_profiler.mode() )
+        return;
+
+    waitForCompiler();
+    m_profiler.setMode(mode);
+
+    // Code of the old mode doesn't report its calls or isn't in the
+    // code map of the samples
+    if ( m_compiler )
+        specialize(m_observedTypes);
+}
+
+void VirtualMachine::resetStack()
+{
+    if ( m_stack.isEmpty() ) {
+        m_stack.resize(StackSize);
+        m_frames.resize(MaxCallDepth);
+    }
+
+    m_stackTop = m_stack.data();
+    m_frameTop = m_frames.data();
+    m_failed = false;
+
+    m_profiler.unwind();
+}
+
+// Type of a value passed by the host, NoDataType if it isn't supported
+static DataType getArgumentType(const QVariant & argument) {
+    switch ( argument.userType() )
+    {
+    case QMetaType::Bool:
+    case QMetaType::Int:
+        return DataType::Int32;
+
+    case QMetaType::Float:
+    case QMetaType::Double:
+        return DataType::Float;
+
+    default:
+        return DataType::NoDataType;
+    }
+}
+
+QVariant VirtualMachine::call(const QString & name, const QVariantList & arguments)
+{
+    int slot = m_program.slot(SymbolTable::global().lookup(name));
+
+    if ( slot < 0 ) {
+        qDebug() << "Unknown function: " << name;
+        return QVariant();
+    }
+
+    if ( arguments.size() != m_program.functions.at(slot).parameterCount ) {
+        qDebug() << "Wrong number of parameters for function: " << name;
+        return QVariant();
+    }
+
+    QVector<DataType> types;
+
+    for ( const QVariant & argument : arguments ) {
+        DataType type = getArgumentType(argument);
+
+        if ( type == DataType::NoDataType ) {
+            qDebug() << "Unsupported argument type: " << argument.typeName();
+            return QVariant();
+        }
+
+        types.append(type);
+    }
+
+    // Guard of the specialized function, its parameters have to hold
+    // the arguments without widening
+    const QVector<DataType> & parameterTypes = m_program.functions.at(slot).parameterTypes;
+
+    for ( int i = 0; i < types.size(); ++i ) {
+        bool conflict;
+
+        if ( joinDataTypes(parameterTypes.at(i), types.at(i), &conflict) != parameterTypes.at(i) || conflict ) {
+            if ( !deoptimize(slot, types) ) {
+                return QVariant();
+            }
+            break;
+        }
+    }
+
+    const BytecodeFunction & function = m_program.functions.at(slot);
+    FunctionProfile & profile = m_profiles[slot];
+
+    resetStack();
+
+    Register * base = m_stackTop;
+
+    for ( int i = 0; i < arguments.size(); ++i ) {
+        if ( function.parameterTypes.at(i) == DataType::Float )
+            base[i].float32 = arguments.at(i).toFloat();
+        else
+            base[i].int32 = arguments.at(i).toInt();
+    }
+
+    if ( profile.state.load() == FunctionProfile::Interpreted &&
+         ++profile.calls + profile.backEdges >= tierUpLimit() ) {
+        tierUp(slot);
+    }
+
+    Register result;
+
+    if ( void * native = profile.nativeEntry.loadAcquire() ) {
+        result.int32 = reinterpret_cast<NativeEntry>(native)(base);
+    }
+    else if ( !interpret(slot, base, &result) ) {
+        return QVariant();
+    }
+
+    if ( m_failed ) {
+        return QVariant();
+    }
+
+    if ( function.returnType == DataType::Float )
+        return QVariant(result.float32);
+
+    return QVariant(result.int32);
+}
+
+int VirtualMachine::execute()
+{
+    if ( m_program.entry < 0 ) {
+        qDebug() << "Nothing loaded to execute";
+        return 0;
+    }
+
+    resetStack();
+
+    Register result;
+
+    if ( !interpret(m_program.entry, m_stackTop, &result) ) {
+        return 0;
+    }
+
+    if ( m_program.functions.at(m_program.entry).returnType == DataType::Float )
+        return truncateFloat(result.float32);
 
+    return result.int32;
 }
 
+void VirtualMachine::tierUp(int slot)
+{
+    FunctionProfile & profile = m_profiles[slot];
+
+    if ( !m_compiler ) {
+        profile.state = FunctionProfile::Failed;
+        return;
+    }
+
+    profile.state = FunctionProfile::Queued;
+    m_queueDepth.ref();
+
+    if ( m_compilerThreadCount > 0 ) {
+        m_compilerPool.start(new CompileTask(this, slot));
+    }
+    else {
+        QElapsedTimer queued;
+        queued.start();
+
+        compile(slot, queued);
+    }
+}
+
+void VirtualMachine::compile(int slot, const QElapsedTimer & queued)
+{
+    FunctionProfile & profile = m_profiles[slot];
+    Symbol symbol = m_program.functions.at(slot).symbol;
+
+    QElapsedTimer compileTimer;
+    compileTimer.start();
+
+    void * code = reinterpret_cast<void *>(m_compiler->compileNativeEntry(symbol));
+
+    qint64 compileTime = compileTimer.nsecsElapsed();
+
+    if ( code ) {
+        profile.nativeEntry.storeRelease(code);
+        profile.state.storeRelease(FunctionProfile::Compiled);
+    }
+    else {
+        qDebug() << "Function stays interpreted: " << SymbolTable::global().name(symbol);
+        profile.state.storeRelease(FunctionProfile::Failed);
+    }
+
+    qint64 latency = queued.nsecsElapsed();
+
+    {
+        QMutexLocker locker(&m_statisticsMutex);
+
+        if ( code )
+            m_compilerStatistics.compiledFunctions++;
+        else
+            m_compilerStatistics.failedFunctions++;
+
+        m_compilerStatistics.totalLatency += latency;
+        m_compilerStatistics.maxLatency = qMax(m_compilerStatistics.maxLatency, latency);
+        m_compilerStatistics.compileTime += compileTime;
+    }
+
+    m_queueDepth.deref();
+}
+
+int VirtualMachine::enterFromNative(void * context, Symbol function, const qint32 * arguments)
+{
+    VirtualMachine * machine = static_cast<VirtualMachine *>(context);
+
+    int slot = machine->m_program.slot(function);
+    int parameterCount = machine->m_program.functions.at(slot).parameterCount;
+
+    Register * base = machine->m_stackTop;
+    CallFrame * frameTop = machine->m_frameTop;
+
+    if ( base + parameterCount > machine->m_stack.data() + machine->m_stack.size() ) {
+        qDebug() << "Stack overflow";
+        machine->m_failed = true;
+        return 0;
+    }
+
+    for ( int i = 0; i < parameterCount; ++i ) {
+        base[i].int32 = arguments[i];
+    }
+
+    FunctionProfile & profile = machine->m_profiles[slot];
+
+    // Bridges are only used until the function itself is hot
+    if ( profile.state.load() == FunctionProfile::Interpreted &&
+         ++profile.calls + profile.backEdges >= machine->tierUpLimit() ) {
+        machine->tierUp(slot);
+    }
+
+    if ( void * native = profile.nativeEntry.loadAcquire() ) {
+        return reinterpret_cast<NativeEntry>(native)(base);
+    }
+
+    Register result;
+    bool interpreted = machine->interpret(slot, base, &result);
+
+    // Everything above the native caller is free again
+    machine->m_stackTop = base;
+    machine->m_frameTop = frameTop;
+
+    if ( !interpreted ) {
+        machine->m_failed = true;
+        return 0;
+    }
+
+    return result.int32;
+}
+
+void VirtualMachine::divisionErrorFromNative(void * context)
+{
+    VirtualMachine * machine = static_cast<VirtualMachine *>(context);
+
+    // The native code continues until it returns, only the first error
+    // is reported
+    if ( !machine->m_failed )
+        qDebug() << "Integer division error";
+
+    machine->m_failed = true;
+}
+
+bool VirtualMachine::interpret(int slot, Register * base, Register * result)
+{
+    const BytecodeFunction * functions = m_program.functions.constData();
+    const BytecodeFunction * function = &functions[slot];
+
+    FunctionProfile * profiles = m_profiles.data();
+    quint32 threshold = tierUpLimit();
+
+    Profiler * profiler = m_profiler.isActive() ? &m_profiler : 0;
+
+    Register * stackEnd = m_stack.data() + m_stack.size();
+
+    CallFrame * firstFrame = m_frameTop;
+    CallFrame * frame = firstFrame;
+    CallFrame * frameEnd = m_frames.data() + m_frames.size();
+
+    const Instruction * pc = function->code.constData();
+    const Register * constants = function->constants.constData();
+
+    Instruction instruction;
+
+    if ( base + function->registerCount > stackEnd ) {
+        qDebug() << "Stack overflow";
+        return false;
+    }
+
+    if ( profiler )
+        profiler->enter(slot);
+
+#define R(i) base[i]
+
+#ifdef HOUND_COMPUTED_GOTO
+    static const void * const dispatchTable[] = {
+#define HOUND_OPCODE_LABEL(name) &&op_##name,
+        HOUND_OPCODES(HOUND_OPCODE_LABEL)
+#undef HOUND_OPCODE_LABEL
+    };
+
+#define CASE(name) op_##name:
+#define DISPATCH() instruction = *pc++; goto *dispatchTable[int(opcodeOf(instruction))]
+
+    DISPATCH();
+#else
+#define CASE(name) case Opcode::name:
+#define DISPATCH() continue
+
+    for (;;) {
+        instruction = *pc++;
+
+        switch ( opcodeOf(instruction) )
+        {
+#endif
+
+    CASE(LoadInt)
+        R(argA(instruction)).int32 = argSBx(instruction);
+        DISPATCH();
+
+    CASE(LoadConstant)
+        R(argA(instruction)) = constants[argBx(instruction)];
+        DISPATCH();
+
+    CASE(Move)
+        R(argA(instruction)) = R(argB(instruction));
+        DISPATCH();
+
+    CASE(IntToFloat)
+        R(argA(instruction)).float32 = float(R(argB(instruction)).int32);
+        DISPATCH();
+
+    CASE(FloatToInt)
+        R(argA(instruction)).int32 = truncateFloat(R(argB(instruction)).float32);
+        DISPATCH();
+
+    CASE(AddInt)
+        R(argA(instruction)).int32 = wrapInt(quint32(R(argB(instruction)).int32) + quint32(R(argC(instruction)).int32));
+        DISPATCH();
+
+    CASE(SubInt)
+        R(argA(instruction)).int32 = wrapInt(quint32(R(argB(instruction)).int32) - quint32(R(argC(instruction)).int32));
+        DISPATCH();
+
+    CASE(MulInt)
+        R(argA(instruction)).int32 = wrapInt(quint32(R(argB(instruction)).int32) * quint32(R(argC(instruction)).int32));
+        DISPATCH();
+
+    CASE(DivInt) {
+        qint32 left = R(argB(instruction)).int32;
+        qint32 right = R(argC(instruction)).int32;
+
+        if ( right == 0 || ( right == -1 && left == qint32(0x80000000) ) ) {
+            qDebug() << "Integer division error";
+            return false;
+        }
+
+        R(argA(instruction)).int32 = left / right;
+        DISPATCH();
+    }
+
+    CASE(PowInt)
+        R(argA(instruction)).int32 = powInt(R(argB(instruction)).int32, R(argC(instruction)).int32);
+        DISPATCH();
+
+    CASE(LessInt)
+        R(argA(instruction)).int32 = R(argB(instruction)).int32 < R(argC(instruction)).int32;
+        DISPATCH();
+
+    CASE(GreaterInt)
+        R(argA(instruction)).int32 = R(argB(instruction)).int32 > R(argC(instruction)).int32;
+        DISPATCH();
+
+    CASE(AddFloat)
+        R(argA(instruction)).float32 = R(argB(instruction)).float32 + R(argC(instruction)).float32;
+        DISPATCH();
+
+    CASE(SubFloat)
+        R(argA(instruction)).float32 = R(argB(instruction)).float32 - R(argC(instruction)).float32;
+        DISPATCH();
+
+    CASE(MulFloat)
+        R(argA(instruction)).float32 = R(argB(instruction)).float32 * R(argC(instruction)).float32;
+        DISPATCH();
+
+    CASE(DivFloat)
+        R(argA(instruction)).float32 = R(argB(instruction)).float32 / R(argC(instruction)).float32;
+        DISPATCH();
+
+    CASE(PowFloat)
+        R(argA(instruction)).float32 = std::pow(R(argB(instruction)).float32, R(argC(instruction)).float32);
+        DISPATCH();
+
+    CASE(LessFloat)
+        R(argA(instruction)).int32 = R(argB(instruction)).float32 < R(argC(instruction)).float32;
+        DISPATCH();
+
+    CASE(GreaterFloat)
+        R(argA(instruction)).int32 = R(argB(instruction)).float32 > R(argC(instruction)).float32;
+        DISPATCH();
+
+    CASE(And)
+        R(argA(instruction)).int32 = R(argB(instruction)).int32 && R(argC(instruction)).int32;
+        DISPATCH();
+
+    CASE(Or)
+        R(argA(instruction)).int32 = R(argB(instruction)).int32 || R(argC(instruction)).int32;
+        DISPATCH();
+
+    CASE(Xor)
+        R(argA(instruction)).int32 = ( R(argB(instruction)).int32 != 0 ) != ( R(argC(instruction)).int32 != 0 );
+        DISPATCH();
+
+    CASE(Jump)
+        // Loops count like calls, the next call runs the native code
+        if ( argSBx(instruction) < 0 )
+            ++profiles[function - functions].backEdges;
+
+        pc += argSBx(instruction);
+        DISPATCH();
+
+    CASE(JumpIfFalse)
+        if ( !R(argA(instruction)).int32 )
+            pc += argSBx(instruction);
+        DISPATCH();
+
+    CASE(Call) {
+        int calleeSlot = argBx(instruction);
+        const BytecodeFunction * callee = &functions[calleeSlot];
+        FunctionProfile * profile = &profiles[calleeSlot];
+        Register * calleeBase = base + argA(instruction);
+
+        if ( profile->state.load() == FunctionProfile::Interpreted &&
+             ++profile->calls + profile->backEdges >= threshold ) {
+            tierUp(calleeSlot);
+        }
+
+        // Compiler threads install the code while the caller is interpreted
+        if ( void * native = profile->nativeEntry.loadAcquire() ) {
+            // Bridges called by the native code continue above this frame
+            m_stackTop = calleeBase;
+            m_frameTop = frame;
+
+            qint32 value = reinterpret_cast<NativeEntry>(native)(calleeBase);
+
+            if ( m_failed ) {
+                return false;
+            }
+
+            calleeBase[0].int32 = value;
+            DISPATCH();
+        }
+
+        if ( frame == frameEnd || calleeBase + callee->registerCount > stackEnd ) {
+            qDebug() << "Stack overflow";
+            return false;
+        }
+
+        frame->returnAddress = pc;
+        frame->base = base;
+        frame->function = function;
+        ++frame;
+
+        if ( profiler )
+            profiler->enter(calleeSlot);
+
+        function = callee;
+        base = calleeBase;
+        pc = function->code.constData();
+        constants = function->constants.constData();
+        DISPATCH();
+    }
+
+    CASE(Return) {
+        // The caller finds the result in the first register of the callee
+        Register value = R(argA(instruction));
+
+        if ( profiler )
+            profiler->exit();
+
+        if ( frame == firstFrame ) {
+            *result = value;
+            return true;
+        }
+
+        base[0] = value;
+
+        --frame;
+        pc = frame->returnAddress;
+        base = frame->base;
+        function = frame->function;
+        constants = function->constants.constData();
+        DISPATCH();
+    }
+
+#ifndef HOUND_COMPUTED_GOTO
+        default:
+            qDebug() << "Unknown opcode: " << int(opcodeOf(instruction));
+            return false;
+        }
+    }
+#endif
+
+#undef CASE
+#undef DISPATCH
+#undef R
+}
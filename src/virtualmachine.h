@@ -1,9 +1,59 @@
 #ifndef VIRTUALMACHINE_H
 #define VIRTUALMACHINE_H
 
+#include <QtCore/QAtomicInt>
+#include <QtCore/QAtomicPointer>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QMutex>
 #include <QtCore/QObject>
+#include <QtCore/QScopedPointer>
+#include <QtCore/QThreadPool>
+#include <QtCore/QVariant>
+#include <QtCore/QVector>
 #include <QtCore/qglobal.h>
 
+#include "bytecode.h"
+#include "codeheap.h"
+#include "profiler.h"
+#include "typeinference.h"
+
+class VmCompiler;
+
+struct FunctionProfile {
+    enum State {
+        Interpreted,
+        Queued,
+        Compiled,
+        Failed      // The compiler can't handle it, it stays interpreted
+    };
+
+    quint32 calls;
+    quint32 backEdges;
+
+    // NativeEntry of the compiled function, 0 while it is interpreted.
+    // Both are set by the compiler threads.
+    QAtomicPointer<void> nativeEntry;
+    QAtomicInt state;
+};
+
+struct CompilerStatistics {
+    // Functions waiting for or in the compiler
+    int queueDepth;
+
+    int compiledFunctions;
+    int failedFunctions;
+
+    // Nanoseconds from the tier up until the code is installed
+    qint64 totalLatency;
+    qint64 maxLatency;
+
+    // Nanoseconds spent in the compiler
+    qint64 compileTime;
+
+    // Calls whose argument types didn't fit the specialized functions
+    int deoptimizations;
+};
+
 /// LANGUAGE CONECEPTS
 ///
 /// Features:
@@ -29,10 +79,127 @@ class VirtualMachine : public QObject
     Q_OBJECT
 public:
     explicit VirtualMachine(QObject *parent = 0);
+    ~VirtualMachine();
+
+    // Executable memory of all compiled modules
+    CodeHeap * codeHeap() { return &m_codeHeap; }
+
+    // Lowers the program to bytecode. Hot functions are compiled from
+    // the expressions later, so they have to stay alive.
+    bool load(ExpressionList expressions);
+
+    // Interprets the top level expressions and returns the value of the last one
+    int execute();
+
+    // Calls a function of the program with Int32 or Float arguments.
+    // Functions are specialized for the types their callers pass, other
+    // arguments widen the types and recompile the program. The result
+    // is invalid if the call failed.
+    QVariant call(const QString & name, const QVariantList & arguments);
+
+    const BytecodeProgram & program() const { return m_program; }
+
+    // Calls plus back edges after which a function is compiled,
+    // negative to interpret everything
+    void setTierUpThreshold(int threshold) { m_tierUpThreshold = threshold; }
+    int tierUpThreshold() const { return m_tierUpThreshold; }
+
+    // Hot functions are compiled by that many threads while the
+    // interpreter goes on, 0 compiles them on the interpreter thread
+    void setCompilerThreadCount(int count);
+    int compilerThreadCount() const { return m_compilerThreadCount; }
+
+    // Blocks until all queued functions are compiled
+    void waitForCompiler();
+
+    CompilerStatistics compilerStatistics() const;
+
+    // Compiled functions are cached there, no caching if empty
+    void setCodeCacheDirectory(const QString & directory) { m_codeCacheDirectory = directory; }
+
+    // Indexed by the slots of the program
+    const QVector<FunctionProfile> & profiles() const { return m_profiles; }
+
+    // Modes of the Profiler, only between calls. Native code is dropped
+    // and compiled again with or without the profiler calls.
+    void setProfilingMode(int mode);
+
+    Profiler * profiler() { return &m_profiler; }
 
 Q_SIGNALS:
 
 public Q_SLOTS:
+
+private:
+    friend class CompileTask;
+
+    struct CallFrame {
+        const Instruction * returnAddress;
+        Register * base;
+        const BytecodeFunction * function;
+    };
+
+    bool interpret(int slot, Register * base, Register * result);
+
+    // Infers the types with the observed ones and lowers the program
+    // again, all native code is dropped
+    bool specialize(const ObservedTypes & observed);
+
+    // Widens the parameters of the function by the argument types
+    bool deoptimize(int slot, const QVector<DataType> & types);
+
+    // Empty stack for the next entry from the host
+    void resetStack();
+
+    quint32 tierUpLimit() const {
+        return m_tierUpThreshold < 0 ? 0xffffffff : quint32(m_tierUpThreshold);
+    }
+
+    // Queues the function for the compiler
+    void tierUp(int slot);
+
+    // Compiles the function and lets its callers switch to the native code
+    void compile(int slot, const QElapsedTimer & queued);
+
+    // Entry of native code into the interpreter
+    static int enterFromNative(void * context, Symbol function, const qint32 * arguments);
+
+    // Native code whose division failed, the call fails once it returns
+    static void divisionErrorFromNative(void * context);
+
+    CodeHeap m_codeHeap;
+    Profiler m_profiler;
+    BytecodeProgram m_program;
+
+    // Loaded program and the argument types its functions were called
+    // with by the host
+    ExpressionList m_expressions;
+    ObservedTypes m_observedTypes;
+
+    // Destroyed before the code heap
+    QScopedPointer<VmCompiler> m_compiler;
+
+    QVector<FunctionProfile> m_profiles;
+    int m_tierUpThreshold;
+    QString m_codeCacheDirectory;
+
+    QThreadPool m_compilerPool;
+    int m_compilerThreadCount;
+
+    mutable QMutex m_statisticsMutex;
+    CompilerStatistics m_compilerStatistics;
+    QAtomicInt m_queueDepth;
+
+    // Registers of all active functions, frames of the callers
+    QVector<Register> m_stack;
+    QVector<CallFrame> m_frames;
+
+    // Free part of the stack while native code runs
+    Register * m_stackTop;
+    CallFrame * m_frameTop;
+
+    // Set if interpreting failed below native code
+    bool m_failed;
 };
 
 #endif // VIRTUALMACHINE_H
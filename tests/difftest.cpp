@@ -0,0 +1,529 @@
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QStringList>
+#include <QTemporaryDir>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "compiler.h"
+#include "flattree.h"
+#include "modulecache.h"
+#include "parser.h"
+#include "virtualmachine.h"
+
+///////////////////////////////////////////
+///
+/// Differential test of the interpreter and the compiled code. Every
+/// program runs interpreted, tiered and compiled as a whole, like with
+/// --interpret and --jit, and every way has to compute the same. The
+/// front end checks compare the other ways to get the syntax tree with
+/// parse().
+///
+/// hound_difftest [--filter TEXT] [--verbose]
+///
+
+enum class RunMode {
+    Interpreted,
+    // Every function is compiled on its first call, before it runs
+    Tiered,
+    // Compiler threads install the code while the interpreter goes on
+    TieredThreads,
+    Compiled,
+    // Compiled a second time, from the code cache of the first time
+    Cached,
+
+    ModeCount
+};
+
+static const char * const ModeNames[] = { "interpreted", "tiered", "tiered-threads", "compiled", "cached" };
+
+struct TestProgram {
+    const char * file;
+
+    // Result of the top level expression, 0 if the program fails
+    int expected;
+
+    // Too deep for the stack of the interpreter, only compiled code runs
+    // it completely
+    bool compiledOnly;
+};
+
+// The second example calls functions Hound doesn't have yet
+static const TestProgram Programs[] = {
+    { ":/examples/ex_01.hound", 102334155, false },
+    { ":/bench/fib.hound", 196418, false },
+    { ":/bench/loops.hound", 1560005, false },
+    { ":/bench/digits.hound", 1523901808, false },
+    { ":/bench/calls.hound", 121713898, false },
+    { ":/programs/divisions.hound", 2145211, false },
+    { ":/programs/divzero.hound", 0, false },
+    { ":/programs/divoverflow.hound", 0, false },
+    { ":/programs/divconstant.hound", 0, false },
+    { ":/programs/conversions.hound", qint32(0x80000000), false },
+    { ":/programs/recursion.hound", 85008, false },
+    { ":/programs/tailcalls.hound", 3500000, true },
+    { ":/programs/powers.hound", 380115739, false }
+};
+
+// Tiering compiles the hot functions right away
+static const int TieredThreshold = 0;
+static const int ThreadedThreshold = 2;
+static const int CompilerThreadCount = 2;
+
+///////////////////////////////////////////
+
+QSharedPointer<SyntaxTree> parseProgram(const QString & file) {
+    Parser parser(file);
+    return parser.parse();
+}
+
+bool runInterpreter(const QString & file, RunMode mode, int * result) {
+    QSharedPointer<SyntaxTree> tree = parseProgram(file);
+
+    if ( !tree )
+        return false;
+
+    VirtualMachine machine;
+
+    switch ( mode )
+    {
+    case RunMode::Interpreted:
+        machine.setTierUpThreshold(-1);
+        break;
+    case RunMode::Tiered:
+        machine.setTierUpThreshold(TieredThreshold);
+        machine.setCompilerThreadCount(0);
+        break;
+    default:
+        machine.setTierUpThreshold(ThreadedThreshold);
+        machine.setCompilerThreadCount(CompilerThreadCount);
+        break;
+    }
+
+    if ( !machine.load(tree->expressions()) )
+        return false;
+
+    *result = machine.execute();
+    machine.waitForCompiler();
+
+    return true;
+}
+
+// Compiles the whole program before it runs, like --jit
+bool runCompiler(const QString & file, const QString & cacheDirectory, int * result) {
+    QSharedPointer<SyntaxTree> tree = parseProgram(file);
+
+    if ( !tree )
+        return false;
+
+    VirtualMachine machine;
+    VmCompiler compiler(&machine);
+    compiler.setCodeCacheDirectory(cacheDirectory);
+
+    if ( !compiler.compile(tree->expressions()) )
+        return false;
+
+    *result = compiler.execute();
+
+    return true;
+}
+
+bool run(const TestProgram & program, RunMode mode, int * result) {
+    QString file = program.file;
+
+    switch ( mode )
+    {
+    case RunMode::Compiled:
+        return runCompiler(file, QString(), result);
+
+    case RunMode::Cached: {
+        QTemporaryDir directory;
+
+        // The first time fills the cache, both have to be right
+        if ( !directory.isValid() || !runCompiler(file, directory.path(), result) )
+            return false;
+
+        if ( *result != program.expected )
+            return true;
+
+        return runCompiler(file, directory.path(), result);
+    }
+
+    default:
+        return runInterpreter(file, mode, result);
+    }
+}
+
+bool isRunnable(const TestProgram & program, RunMode mode) {
+    // Threaded tiering may still interpret the deep calls
+    return !program.compiledOnly || ( mode != RunMode::Interpreted && mode != RunMode::TieredThreads );
+}
+
+///////////////////////////////////////////
+
+// Whole structure of an expression, toString alone leaves out the children
+QString describe(Expression * expr) {
+    if ( !expr )
+        return "-";
+
+    QString text = QString("%1@%2").arg(expr->toString()).arg(expr->line());
+    QStringList children;
+
+    switch ( expr->type() )
+    {
+    case ExpressionType::FunctionExpressionType: {
+        FunctionExpression * function = static_cast<FunctionExpression *>(expr);
+        children << describe(function->code());
+        break;
+    }
+    case ExpressionType::FunctionInvokation: {
+        FunctionInvokationExpression * call = static_cast<FunctionInvokationExpression *>(expr);
+        text += " " + call->functionName();
+
+        for ( Expression * param : call->parameters() )
+            children << describe(param);
+        break;
+    }
+    case ExpressionType::CodeBlock:
+        for ( Expression * codeExpr : static_cast<CodeBlockExpression *>(expr)->expressions() )
+            children << describe(codeExpr);
+        break;
+
+    case ExpressionType::BinaryExpr: {
+        BinaryExpression * binary = static_cast<BinaryExpression *>(expr);
+        text += " " + QString::number(int(binary->theOperator()));
+        children << describe(binary->leftExpression()) << describe(binary->rightExpression());
+        break;
+    }
+    case ExpressionType::If: {
+        IfExpression * ifExpr = static_cast<IfExpression *>(expr);
+        children << describe(ifExpr->condition()) << describe(ifExpr->block());
+        break;
+    }
+    case ExpressionType::Else:
+        children << describe(static_cast<ElseExpression *>(expr)->block());
+        break;
+
+    default:
+        break;
+    }
+
+    return children.isEmpty() ? text : text + " ( " + children.join(", ") + " )";
+}
+
+QStringList describeAll(ExpressionList expressions) {
+    QStringList descriptions;
+
+    for ( Expression * expr : expressions )
+        descriptions << describe(expr);
+
+    return descriptions;
+}
+
+QString describeState(const ParsingData & data) {
+    return QString("operator %1, indent %2 after %3").arg(int(data.pendingOperator))
+                                                     .arg(data.currentIndent).arg(data.previousIndent);
+}
+
+// Each streamed tree holds the next expression parse() finds, and the
+// state between them ends up the same
+bool checkStreaming(const TestProgram & program, QString * error) {
+    Parser parser(program.file);
+    QStringList parsed = describeAll(parser.parse()->expressions());
+    QString parsedState = describeState(parser.parsingData());
+
+    QStringList streamed;
+
+    if ( !parser.open() ) {
+        *error = "could not open";
+        return false;
+    }
+
+    while ( QSharedPointer<SyntaxTree> tree = parser.next() ) {
+        if ( tree->expressions().size() != 1 ) {
+            *error = QString("tree %1 has %2 expressions").arg(streamed.size()).arg(tree->expressions().size());
+            return false;
+        }
+
+        streamed << describe(tree->expressions().at(0));
+    }
+
+    for ( int i = 0; i < qMax(parsed.size(), streamed.size()); ++i ) {
+        if ( parsed.value(i) != streamed.value(i) ) {
+            *error = QString("expression %1 is %2 instead of %3").arg(i).arg(streamed.value(i)).arg(parsed.value(i));
+            return false;
+        }
+    }
+
+    if ( describeState(parser.parsingData()) != parsedState ) {
+        *error = QString("%1 instead of %2").arg(describeState(parser.parsingData())).arg(parsedState);
+        return false;
+    }
+
+    return true;
+}
+
+bool compareTrees(ExpressionList expected, ExpressionList actual, QString * error) {
+    QStringList expectedDescriptions = describeAll(expected);
+    QStringList actualDescriptions = describeAll(actual);
+
+    for ( int i = 0; i < qMax(expectedDescriptions.size(), actualDescriptions.size()); ++i ) {
+        if ( expectedDescriptions.value(i) != actualDescriptions.value(i) ) {
+            *error = QString("expression %1 is %2 instead of %3").arg(i)
+                     .arg(actualDescriptions.value(i)).arg(expectedDescriptions.value(i));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Writes the flat tree of the program into a module cache, returns the
+// name of the .houndc file or an empty string
+QString storeModule(const TestProgram & program, const ModuleCache & cache, QByteArray * key) {
+    QFile file(program.file);
+
+    if ( !file.open(QIODevice::ReadOnly) )
+        return QString();
+
+    *key = ModuleCache::sourceKey(file.readAll());
+    QSharedPointer<SyntaxTree> tree = parseProgram(program.file);
+
+    if ( !cache.store(*key, FlatTree::fromExpressions(tree->expressions())) )
+        return QString();
+
+    return QDir(cache.directory()).filePath(QString::fromLatin1(key->toHex()) + ".houndc");
+}
+
+// A module from the cache is the tree of the source and computes the same
+bool checkModuleCache(const TestProgram & program, QString * error) {
+    QTemporaryDir directory;
+    ModuleCache cache(directory.path());
+    QByteArray key;
+
+    if ( !directory.isValid() || storeModule(program, cache, &key).isEmpty() ) {
+        *error = "could not store";
+        return false;
+    }
+
+    QSharedPointer<SyntaxTree> loaded = cache.load(key);
+
+    if ( !loaded ) {
+        *error = "could not load";
+        return false;
+    }
+
+    if ( !compareTrees(parseProgram(program.file)->expressions(), loaded->expressions(), error) )
+        return false;
+
+    if ( program.compiledOnly )
+        return true;
+
+    VirtualMachine machine;
+    machine.setTierUpThreshold(-1);
+
+    if ( !machine.load(loaded->expressions()) ) {
+        *error = "could not run";
+        return false;
+    }
+
+    int result = machine.execute();
+
+    if ( result != program.expected ) {
+        *error = QString("%1 instead of %2").arg(result).arg(program.expected);
+        return false;
+    }
+
+    return true;
+}
+
+// Start of a .houndc file, the layout of CacheHeader in modulecache.cpp
+struct StoredHeader {
+    char magic[4];
+    quint32 formatVersion;
+    quint32 keySize;
+    quint32 nodeCount;
+    quint32 operandCount;
+    quint32 rootCount;
+    quint32 floatCount;
+    quint32 stringCount;
+    quint32 symbolCount;
+};
+
+// Index of the first node of the type with at least the operands, -1
+// if there is none
+int findNode(const QByteArray & data, ExpressionType type, quint32 operandCount, FlatNode * found) {
+    StoredHeader header;
+    memcpy(&header, data.constData(), sizeof(header));
+
+    const char * nodes = data.constData() + sizeof(header) + header.keySize;
+
+    for ( quint32 i = 0; i < header.nodeCount; ++i ) {
+        memcpy(found, nodes + i * sizeof(FlatNode), sizeof(FlatNode));
+
+        if ( found->is(type) && found->operandCount >= operandCount )
+            return int(i);
+    }
+
+    return -1;
+}
+
+// Truncated files, operands of the wrong kind and unknown operators are
+// all turned down instead of giving a broken tree
+bool checkBrokenModules(const TestProgram & program, QString * error) {
+    QTemporaryDir directory;
+    ModuleCache cache(directory.path());
+    QByteArray key;
+    QString fileName = storeModule(program, cache, &key);
+    QFile file(fileName);
+
+    if ( !directory.isValid() || fileName.isEmpty() || !file.open(QIODevice::ReadOnly) ) {
+        *error = "could not store";
+        return false;
+    }
+
+    QByteArray stored = file.readAll();
+    file.close();
+
+    StoredHeader header;
+    memcpy(&header, stored.constData(), sizeof(header));
+    int nodesStart = int(sizeof(header) + header.keySize);
+    int operandsStart = nodesStart + int(sizeof(FlatNode) * header.nodeCount);
+
+    QList<QPair<QString, QByteArray> > brokenFiles;
+    brokenFiles << qMakePair(QString("header only"), stored.left(int(sizeof(header))));
+    brokenFiles << qMakePair(QString("half of it"), stored.left(stored.size() / 2));
+    brokenFiles << qMakePair(QString("last byte missing"), stored.left(stored.size() - 1));
+
+    // The first parameter of a function becomes its code block
+    FlatNode node;
+    int index = findNode(stored, ExpressionType::FunctionExpressionType, 2, &node);
+
+    if ( index < 0 ) {
+        *error = "no function with parameters";
+        return false;
+    }
+
+    QByteArray broken = stored;
+    memcpy(broken.data() + operandsStart + ( node.firstOperand + 1 ) * sizeof(NodeIndex),
+           stored.constData() + operandsStart + node.firstOperand * sizeof(NodeIndex), sizeof(NodeIndex));
+    brokenFiles << qMakePair(QString("code block as parameter"), broken);
+
+    index = findNode(stored, ExpressionType::BinaryExpr, 2, &node);
+
+    if ( index < 0 ) {
+        *error = "no binary expression";
+        return false;
+    }
+
+    broken = stored;
+    node.op = 0xff;
+    memcpy(broken.data() + nodesStart + index * sizeof(FlatNode), &node, sizeof(FlatNode));
+    brokenFiles << qMakePair(QString("unknown operator"), broken);
+
+    // The file as it was has to load again afterwards
+    brokenFiles << qMakePair(QString(), stored);
+
+    for ( const QPair<QString, QByteArray> & brokenFile : brokenFiles ) {
+        if ( !file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(brokenFile.second) != brokenFile.second.size() ) {
+            *error = "could not write the file";
+            return false;
+        }
+
+        file.close();
+
+        if ( !cache.load(key) != !brokenFile.first.isEmpty() ) {
+            *error = brokenFile.first.isEmpty() ? "could not load the rewritten file" : "loaded with " + brokenFile.first;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Checks of the front end, they run for every program
+struct TreeCheck {
+    const char * name;
+    bool (*check)(const TestProgram & program, QString * error);
+};
+
+static const TreeCheck TreeChecks[] = {
+    { "streamed", &checkStreaming },
+    { "module-cache", &checkModuleCache },
+    { "broken-modules", &checkBrokenModules }
+};
+
+///////////////////////////////////////////
+
+static void discardMessage(QtMsgType type, const QMessageLogContext & context, const QString & message) {
+    Q_UNUSED(context)
+
+    // Division errors are expected, failures of the test are warnings
+    if ( type != QtDebugMsg )
+        fprintf(stderr, "%s\n", message.toLocal8Bit().constData());
+}
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    QStringList arguments = app.arguments();
+
+    // Only tests whose name contains it run
+    QString filter;
+
+    if ( arguments.contains("--filter") )
+        filter = arguments.value(arguments.indexOf("--filter") + 1);
+
+    if ( !arguments.contains("--verbose") )
+        qInstallMessageHandler(&discardMessage);
+
+    int passed = 0;
+    int failed = 0;
+
+    for ( const TestProgram & program : Programs ) {
+        for ( int i = 0; i < int(RunMode::ModeCount); ++i ) {
+            RunMode mode = RunMode(i);
+            QString name = QString("%1/%2").arg(QString(program.file).section('/', -1)).arg(ModeNames[i]);
+
+            if ( !isRunnable(program, mode) || ( !filter.isEmpty() && !name.contains(filter) ) )
+                continue;
+
+            int result = 0;
+
+            if ( !run(program, mode, &result) ) {
+                fprintf(stderr, "FAIL %s: could not run\n", qPrintable(name));
+                failed++;
+            }
+            else if ( result != program.expected ) {
+                fprintf(stderr, "FAIL %s: %d instead of %d\n", qPrintable(name), result, program.expected);
+                failed++;
+            }
+            else {
+                printf("ok   %s\n", qPrintable(name));
+                passed++;
+            }
+        }
+
+        for ( const TreeCheck & check : TreeChecks ) {
+            QString name = QString("%1/%2").arg(QString(program.file).section('/', -1)).arg(check.name);
+            QString error;
+
+            if ( !filter.isEmpty() && !name.contains(filter) )
+                continue;
+
+            if ( !check.check(program, &error) ) {
+                fprintf(stderr, "FAIL %s: %s\n", qPrintable(name), qPrintable(error));
+                failed++;
+            }
+            else {
+                printf("ok   %s\n", qPrintable(name));
+                passed++;
+            }
+        }
+    }
+
+    printf("%d passed, %d failed\n", passed, failed);
+
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,23 @@
+#-------------------------------------------------
+#
+# Differential test of the interpreter and the compiled code, every
+# program has to give the same result both ways
+#
+#-------------------------------------------------
+
+QT       += core
+
+QT       -= gui
+
+TARGET = hound_difftest
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+include(../src/hound.pri)
+
+SOURCES += difftest.cpp
+
+RESOURCES += \
+    difftest.qrc